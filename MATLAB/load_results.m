@@ -3,19 +3,44 @@ function [data, t, nodemap] = load_results(path)
 %   Detailed explanation goes here
 
 h5path = fullfile(path, 'results.h5');
-data = squeeze(h5read(h5path, '/Data'));
-t = h5read(h5path, '/Data_Unlimited');
-nodemap = (1:size(data, 1))-1;
-if ~h5readatt(h5path, '/Data', 'IsDataComplete')
-    nodemap = h5readatt(h5path, '/Data', 'NodeMap');
+if exist(h5path, 'file')
+    data = squeeze(h5read(h5path, '/Data'));
+    t = h5read(h5path, '/Data_Unlimited');
+    nodemap = (1:size(data, 1))-1;
+    if ~h5readatt(h5path, '/Data', 'IsDataComplete')
+        nodemap = h5readatt(h5path, '/Data', 'NodeMap');
+    end
+else
+    % -compress_voltage output
+    h5path = fullfile(path, 'voltage.h5');
+    raw = h5read(h5path, '/Data');
+    t = h5read(h5path, '/Data_Unlimited');
+    enc = h5readatt(h5path, '/Data', 'Encoding');
+    if strncmp(enc, 'float16', 7)
+        data = half_to_double(raw);
+    else
+        data = double(raw)*h5readatt(h5path, '/Data', 'Scale') + h5readatt(h5path, '/Data', 'Offset');
+        data(raw == intmin('int16')) = NaN;
+    end
+    nodemap = (1:size(data, 1))-1;
+    if ~h5readatt(h5path, '/Data', 'IsDataComplete')
+        nodemap = double(h5read(h5path, '/NodeMap'))';
+    end
 end
 
-ppath = fullfile(path, 'permutation.txt');
+perm = [];
+ppath = fullfile(path, 'permutation.h5');
 if exist(ppath, 'file')
-    file_obj=fopen(ppath);
+    p = double(h5read(ppath, '/Permutation'));
+    perm = [(0:length(p)-1)', p(:)];
+elseif exist(fullfile(path, 'permutation.txt'), 'file')
+    % outputs from before permutation.h5
+    file_obj=fopen(fullfile(path, 'permutation.txt'));
     perm=cell2mat(textscan(file_obj,'','headerlines',1,'delimiter',' ','collectoutput',1));
     fclose(file_obj);
-    
+end
+
+if ~isempty(perm)
     if ~isempty(nodemap)
         iperm = zeros(size(perm, 1), 1);
         iperm(perm(:, 2)+1) = 1:length(iperm);
@@ -27,3 +52,13 @@ if exist(ppath, 'file')
     end
 end
 
+function d = half_to_double(h)
+% IEEE half precision bits (uint16) to double
+h = double(h);
+s = 1 - 2*(h >= 32768);
+e = bitand(bitshift(h, -10), 31);
+m = bitand(h, 1023);
+d = s.*(1 + m/1024).*2.^(e - 15);
+d(e == 0) = s(e == 0).*m(e == 0)/1024*2^-14;
+d(e == 31) = s(e == 31).*Inf;
+d(e == 31 & m ~= 0) = NaN;
@@ -0,0 +1,24 @@
+function export_octave_seed(tables, path)
+%EXPORT_OCTAVE_SEED Octave Noise Seed Exporter
+%   EXPORT_OCTAVE_SEED(TABLES, PATH) Writes the permutation tables and
+%   offsets from seed_octave(n) to a HDF5 file, so that AtrialFibrosis
+%   -fibrosis PATH generates the same noise as octave(pts, TABLES)
+%
+%   /Table is n-by-3-by-256 (C order) uint8, /Offset is n-by-3 (C order)
+
+    n = length(tables);
+    T = zeros(256, 3, n, 'uint8');
+    O = zeros(3, n);
+    for i = 1:n
+        T(:, :, i) = tables(i).table;
+        O(:, i) = tables(i).offset;
+    end
+
+    if exist(path, 'file') == 2
+        delete(path)
+    end
+    h5create(path, '/Table', size(T), 'Datatype', 'uint8')
+    h5write(path, '/Table', T)
+    h5create(path, '/Offset', size(O))
+    h5write(path, '/Offset', O)
+end
@@ -4,33 +4,41 @@
 #include "SimpleStimulus.hpp"
 #include "SteadyStateRunner.hpp"
 #include "CardiacSimulationArchiver.hpp"
+#include "FakeBathCell.hpp"
+#include "DistributedTetrahedralMesh.hpp"
+#include "TrianglesMeshReader.hpp"
 
-#include "Maleckar2008_baseCvodeOpt.hpp"
-#include "Maleckar2008_cAFCvodeOpt.hpp"
-#include "Maleckar2008_LA_1h2HzCvodeOpt.hpp"
-#include "Maleckar2008_RA_1h2HzCvodeOpt.hpp"
-#include "courtemanche_ramirez_nattel_1998_SRCvodeOpt.hpp"
-#include "courtemanche_ramirez_nattel_1998_cAFCvodeOpt.hpp"
-
+#include "AtrialCellModels.hpp"
 #include "QutemuLog.hpp"
 #include "QutemuVersion.hpp"
 #include "ConductivityReader.hpp"
 #include "ActivationMapOutputModifier.hpp"
 #include "TimedStimulus.hpp"
-
-#include <sys/resource.h>
+#include "StimulusProtocol.hpp"
+#include "OctaveNoise.hpp"
+#include "AtrialConductivityModifier.hpp"
+#include "BinaryMeshCache.hpp"
+#include "BinaryMeshReader.hpp"
+#include "NodePartition.hpp"
+#include "QuiescentCell.hpp"
+#include "BatchedCell.hpp"
+#include "CostRecordingCell.hpp"
+#include "NodeCost.hpp"
+#include "TelemetryOutputModifier.hpp"
+#include "FibrillationOutputModifier.hpp"
+#include "CompressedVoltageOutputModifier.hpp"
+#include "QutemuTrace.hpp"
+#include "TraceOutputModifier.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <map>
+#include <numeric>
 #include <Version.hpp>
 #include <boost/lexical_cast.hpp>
 
-enum CellModel
-{
-    MALECKAR,
-    MALECKAR_CAF,
-    MALECKAR_ANNA,
-    COURTEMANCHE_SR,
-    COURTEMANCHE_CAF
-};
-
 template<unsigned DIM>
 class AtrialCellFactory : public AbstractCardiacCellFactory<DIM>
 {
@@ -38,6 +46,22 @@ private:
     boost::shared_ptr<AbstractStimulusFunction> p_stim_sinus;
     boost::shared_ptr<AbstractStimulusFunction> p_stim_extra;
     int p_cell_model;
+    CellSolver mSolver;
+
+    boost::shared_ptr<StimulusProtocol> mpProtocol; ///< Replaces the pacing site attribute when set
+    bool mProtocolPermuted;
+    double mStimMagnitude;
+    double mStimDuration;
+    std::map<std::pair<int, double>, boost::shared_ptr<AbstractStimulusFunction> > mProtocolStimuli; ///< By site and delay
+    std::vector<unsigned> mNodePermutation; ///< Overrides the mesh permutation, see SetNodePermutation
+    boost::shared_ptr<QuiescentStatistics> mpQuiescent; ///< Cells are wrapped in QuiescentCell when set
+    double mQuiescentTolerance;
+    double mQuiescentWake;
+    unsigned mQuiescentSettle;
+    boost::shared_ptr<CourtemancheBatch> mpBatch; ///< The cells of this process with BATCHED_RUSH_LARSEN
+    bool mRecordCost; ///< Cells are wrapped in CostRecordingCell
+    std::vector<unsigned> mPassiveNodes; ///< Given a passive cell, ascending global indices
+    double mRestingVoltage; ///< Of the cell model, for the passive cells. NaN until the first is created
 
     using AbstractCardiacCellFactory<DIM>::mpSolver;
     using AbstractCardiacCellFactory<DIM>::mpZeroStimulus;
@@ -49,14 +73,142 @@ public:
             AbstractCardiacCellFactory<DIM>(),
             p_stim_sinus(p_stim_sinus),
             p_stim_extra(p_stim_extra),
-            p_cell_model(p_cell_model)
+            p_cell_model(p_cell_model),
+            mSolver(CVODE),
+            mProtocolPermuted(false),
+            mStimMagnitude(0),
+            mStimDuration(0),
+            mQuiescentTolerance(0),
+            mQuiescentWake(0),
+            mQuiescentSettle(0),
+            mRecordCost(false),
+            mRestingVoltage(std::numeric_limits<double>::quiet_NaN())
     {
         if (p_cell_model < MALECKAR || p_cell_model > COURTEMANCHE_CAF)
             EXCEPTION("Unknown Cell Model " << p_cell_model);
     }
+
+    AtrialCellFactory(boost::shared_ptr<StimulusProtocol> pProtocol, double magnitude, double duration, int p_cell_model) :
+            AtrialCellFactory(boost::shared_ptr<AbstractStimulusFunction>(), boost::shared_ptr<AbstractStimulusFunction>(), p_cell_model)
+    {
+        mpProtocol = pProtocol;
+        mStimMagnitude = magnitude;
+        mStimDuration = duration;
+    }
+
+    /** For meshes loaded with a cached partition, which Chaste sees as unpermuted */
+    void SetNodePermutation(const std::vector<unsigned>& rPermutation) {
+        mNodePermutation = rPermutation;
+    }
+
+    void SetSolver(CellSolver solver) {
+        mSolver = solver;
+    }
+
+    /** Wraps the cells in QuiescentCell, see there for the parameters */
+    void SetQuiescent(double tolerance, double wakeVoltage, unsigned settleSteps) {
+        mpQuiescent.reset(new QuiescentStatistics());
+        mQuiescentTolerance = tolerance;
+        mQuiescentWake = wakeVoltage;
+        mQuiescentSettle = settleSteps;
+    }
+
+    void SetRecordCost(bool recordCost) {
+        mRecordCost = recordCost;
+    }
+
+    /** Nodes to give a cell without ionic current, see AtrialConductivityModifier::GetIsolatedNodes */
+    void SetPassiveNodes(const std::vector<unsigned>& rNodes) {
+        mPassiveNodes = rNodes;
+    }
+
+    /** Null unless SetQuiescent was called */
+    boost::shared_ptr<QuiescentStatistics> GetQuiescentStatistics() {
+        return mpQuiescent;
+    }
+
+    template<class CELL>
+    AbstractCardiacCellInterface* CreateCell(boost::shared_ptr<AbstractStimulusFunction> stimulus) {
+        if (mpQuiescent) {
+            if (mRecordCost)
+                return new CostRecordingCell<QuiescentCell<CELL> >(mpSolver, stimulus, mpQuiescent, mQuiescentTolerance, mQuiescentWake, mQuiescentSettle);
+            return new QuiescentCell<CELL>(mpSolver, stimulus, mpQuiescent, mQuiescentTolerance, mQuiescentWake, mQuiescentSettle);
+        }
+
+        if (mRecordCost)
+            return new CostRecordingCell<CELL>(mpSolver, stimulus);
+        return new CELL(mpSolver, stimulus);
+    }
+
+    /** A cell without ionic current or stimulus, which stays at the resting voltage of the cell model */
+    AbstractCardiacCellInterface* CreatePassiveCell() {
+        if (std::isnan(mRestingVoltage)) {
+            if (mSolver == BATCHED_RUSH_LARSEN) {
+                mRestingVoltage = CourtemancheBatch::rGetInitialConditions()[CourtemancheBatch::VOLTAGE];
+            }
+            else {
+                AbstractCardiacCellInterface* p_cell = CreateAtrialCell(p_cell_model, mSolver, false, mpSolver, mpZeroStimulus);
+                mRestingVoltage = p_cell->GetVoltage();
+                delete p_cell;
+            }
+        }
+
+        AbstractCardiacCellInterface* p_cell = new FakeBathCell(mpSolver, mpZeroStimulus);
+        p_cell->SetVoltage(mRestingVoltage);
+        return p_cell;
+    }
+
+    /** A lane of the batch of this process, created with the first cell */
+    AbstractCardiacCellInterface* CreateBatchedCell(boost::shared_ptr<AbstractStimulusFunction> stimulus, unsigned nodeIndex) {
+        if (!mpBatch)
+            mpBatch.reset(new CourtemancheBatch(GetBatchParameters(p_cell_model), HeartConfig::Instance()->GetOdeTimeStep(),
+                                                HeartConfig::Instance()->GetCapacitance()));
+
+        return new BatchedCell(mpSolver, stimulus, mpBatch, nodeIndex);
+    }
+
+    /**
+     * Batched cells are integrated a group at a time, after the tissue has cached the ionic currents of most of the
+     * group, so the batch writes the currents of each group into the tissue cache itself. Call once the problem is
+     * initialised
+     */
+    void ConnectBatch(AbstractCardiacTissue<DIM>* pTissue) {
+        if (!mpBatch)
+            return;
+
+        ReplicatableVector& r_iionic = pTissue->rGetIionicCacheReplicated();
+        mpBatch->SetIonicCurrentCallback([&r_iionic](unsigned globalIndex, double iionic) {
+            r_iionic[globalIndex] = iionic;
+        });
+    }
+
+    boost::shared_ptr<AbstractStimulusFunction> GetProtocolStimulus(unsigned nodeIndex) {
+        if (!mProtocolPermuted) {
+            if (mpProtocol->GetNumNodes() != this->GetMesh()->GetNumNodes())
+                EXCEPTION("Stimulus protocol has " << mpProtocol->GetNumNodes() << " nodes, mesh has " << this->GetMesh()->GetNumNodes());
+
+            mpProtocol->ApplyPermutation(mNodePermutation.empty() ? this->GetMesh()->rGetNodePermutation() : mNodePermutation);
+            mProtocolPermuted = true;
+        }
+
+        int site = mpProtocol->GetSite(nodeIndex);
+        if (site < 0)
+            return mpZeroStimulus;
+
+        // nodes with the same site and delay share a stimulus (and its lookup cache)
+        std::pair<int, double> key(site, mpProtocol->GetDelay(nodeIndex));
+        boost::shared_ptr<AbstractStimulusFunction>& stimulus = mProtocolStimuli[key];
+        if (!stimulus)
+            stimulus.reset(new ProtocolStimulus(mpProtocol, site, key.second, mStimMagnitude, mStimDuration));
+
+        return stimulus;
+    }
     
-    AbstractCvodeCell* CreateCardiacCellForTissueNode(Node<DIM>* pNode)
+    AbstractCardiacCellInterface* CreateCardiacCellForTissueNode(Node<DIM>* pNode)
     {
+        if (std::binary_search(mPassiveNodes.begin(), mPassiveNodes.end(), pNode->GetIndex()))
+            return CreatePassiveCell();
+
         unsigned lvrv = 1;
         unsigned pacing_site = 0;
         if (pNode->HasNodeAttributes()) {//halo nodes have no attributes
@@ -69,150 +221,131 @@ public:
             EXCEPTION("invalid lvrv " << lvrv << " at node " << pNode->GetIndex());
 
         boost::shared_ptr<AbstractStimulusFunction> stimulus;
-        switch (pacing_site) {
-            case 1:
-                stimulus = p_stim_sinus;
-                break;
-            case 2:
-                stimulus = p_stim_extra;
-                break;
-            case 0:
-                stimulus = mpZeroStimulus;
-                break;
-            default:
-                EXCEPTION("Unknown Pacing Site " << pacing_site << " at node " << pNode->GetIndex());
-        }
-
-        switch (p_cell_model) {
-            case MALECKAR:
-                return new CellMaleckar2008_baseFromCellMLCvodeOpt(mpSolver, stimulus);
-            case MALECKAR_CAF:
-                return new CellMaleckar2008_cAFFromCellMLCvodeOpt(mpSolver, stimulus);
-            case MALECKAR_ANNA:
-                if (lvrv == 1)
-                    return new CellMaleckar2008_LA_1h2HzFromCellMLCvodeOpt(mpSolver, stimulus);
-                else
-                    return new CellMaleckar2008_RA_1h2HzFromCellMLCvodeOpt(mpSolver, stimulus);
-            case COURTEMANCHE_SR:
-                return new Cellcourtemanche_ramirez_nattel_1998_SRFromCellMLCvodeOpt(mpSolver, stimulus);
-            case COURTEMANCHE_CAF:
-                return new Cellcourtemanche_ramirez_nattel_1998_cAFFromCellMLCvodeOpt(mpSolver, stimulus);
-            default:
-                EXCEPTION("Um");
-
+        if (mpProtocol)
+            stimulus = GetProtocolStimulus(pNode->GetIndex());
+        else {
+            switch (pacing_site) {
+                case 1:
+                    stimulus = p_stim_sinus;
+                    break;
+                case 2:
+                    stimulus = p_stim_extra;
+                    break;
+                case 0:
+                    stimulus = mpZeroStimulus;
+                    break;
+                default:
+                    EXCEPTION("Unknown Pacing Site " << pacing_site << " at node " << pNode->GetIndex());
+            }
         }
+
+        if (mSolver == BATCHED_RUSH_LARSEN)
+            return CreateBatchedCell(stimulus, pNode->GetIndex());
+
+        return CreateAtrialCell(p_cell_model, mSolver, lvrv == 2, *this, stimulus);
     }
 };
 
-template<unsigned DIM>
-class AtrialConductivityModifier : public AbstractConductivityModifier<DIM,DIM>
+struct EnsembleMember
 {
-private:
-	
-    c_matrix<double,DIM,DIM> mTensor;
-    AbstractTetrahedralMesh<DIM,DIM>* pMesh;
-    std::vector<float> conductivities;
-    
-public:
-    AtrialConductivityModifier() {}
+    std::string mName;
+    std::vector<std::string> mArgs;
+};
 
-    AtrialConductivityModifier(const std::vector<float> &conductivities) :
-            AbstractConductivityModifier<DIM,DIM>(),
-            mTensor(zero_matrix<double>(DIM,DIM)),
-            pMesh(NULL),
-            conductivities(conductivities)
-    {
+/** One member per line, "<name> <options...>". Blank lines and lines starting with # are ignored */
+std::vector<EnsembleMember> ReadEnsemble(const std::string& rPath)
+{
+    std::ifstream file(FileFinder(rPath, RelativeTo::AbsoluteOrCwd).GetAbsolutePath().c_str());
+    if (!file.is_open())
+        EXCEPTION("Couldn't open file: " + rPath);
+
+    std::vector<EnsembleMember> members;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::stringstream ss(line);
+        EnsembleMember member;
+        if (!(ss >> member.mName) || member.mName[0] == '#')
+            continue;
+
+        std::string arg;
+        while (ss >> arg) {
+            if (arg == "-meshfile" || arg == "-loaddir" || arg == "-ensemble" || arg == "-outdir")
+                EXCEPTION("Ensemble member " << member.mName << " can not override " << arg);
+            member.mArgs.push_back(arg);
+        }
+        members.push_back(member);
     }
 
-    void SetMesh(AbstractTetrahedralMesh<DIM,DIM>* mesh) {
-        pMesh = mesh;
-        assert(conductivities.size() == 0 || conductivities.size() == mesh->GetNumElements());
-    }
-
-    void ApplyTissueConductivity(unsigned elementIndex, unsigned tissue_class) {
-        double gll;
-        double gtt;
-        switch (tissue_class) {
-            case 32:
-            case 33:
-            case 76:
-            case 111:
-            case 112:
-            case 161:
-            case 162:
-            case 192:
-            case 193:
-            case 194:
-            case 195:
-            case 196:
-            case 197:
-            case 198:
-            case 199:
-                gll = 2.0;
-                gtt = 1.0;
-                break;
-            case 80:
-            case 81:
-            case 82:
-            case 83:
-            case 84:
-            case 85:
-            case 86:
-                // sinus node and surroundings
-                gll = 0.5;
-                gtt = 0.5;
-                break;
-            case 72:
-                // crista terminalis
-                gll = 7.7;
-                gtt = 0.7;
-                break;
-            case 74:
-            case 98:
-            case 102:
-            case 103:
-                // pectinatae muscles, Bachman Bundle
-                gll = 5.5;
-                gtt = 2.75;
-                break;
-            case 104:
-                gll = 1.1;
-                gtt = 1.1;
-                break;
-            default:
-                EXCEPTION("Unknown tissue class " << tissue_class << " at " << elementIndex);
-        }
+    if (members.empty())
+        EXCEPTION("No ensemble members in " << rPath);
+    return members;
+}
 
-        mTensor(0,0) = gll;
-        for (unsigned i = 1; i < DIM; i++)
-            mTensor(i, i) = gtt;
-    }
-    
-    c_matrix<double,DIM,DIM>& rCalculateModifiedConductivityTensor(unsigned elementIndex, const c_matrix<double,DIM,DIM>& rOriginalConductivity, unsigned domainIndex)
-    {
-        Element<DIM, DIM> *ele = pMesh->GetElement(elementIndex);
-        if (ele->GetNumElementAttributes() > 0)
-            ApplyTissueConductivity(elementIndex, (unsigned)ele->rGetElementAttributes()[0]);
-        else
-            mTensor.assign(rOriginalConductivity);
+/**
+ * Puts extra arguments in front of the command line for its lifetime. CommandLineArguments finds the first
+ * occurrence of an option, so these take precedence over the original arguments
+ */
+class OptionOverride
+{
+private:
+    int* mpOriginalArgc;
+    char*** mpOriginalArgv;
+    std::vector<std::string> mArgs;
+    std::vector<char*> mArgPointers;
+    int mArgc;
+    char** mArgv;
 
-        if (conductivities.size() > 0)
-            mTensor *= conductivities[elementIndex];
+public:
+    OptionOverride(const std::vector<std::string>& rArgs)
+    {
+        CommandLineArguments* args = CommandLineArguments::Instance();
+        mpOriginalArgc = args->p_argc;
+        mpOriginalArgv = args->p_argv;
+
+        // program name, overrides, then the original arguments
+        mArgs.push_back((*mpOriginalArgv)[0]);
+        mArgs.insert(mArgs.end(), rArgs.begin(), rArgs.end());
+        for (int i = 1; i < *mpOriginalArgc; i++)
+            mArgs.push_back((*mpOriginalArgv)[i]);
+
+        for (std::string& r_arg : mArgs)
+            mArgPointers.push_back(&r_arg[0]);
+        mArgPointers.push_back(nullptr);
+
+        mArgc = mArgs.size();
+        mArgv = &mArgPointers[0];
+        args->p_argc = &mArgc;
+        args->p_argv = &mArgv;
+    }
 
-        return mTensor;
+    ~OptionOverride()
+    {
+        CommandLineArguments::Instance()->p_argc = mpOriginalArgc;
+        CommandLineArguments::Instance()->p_argv = mpOriginalArgv;
     }
 };
 
+/** The binary cache of -meshfile if -meshcache is given, otherwise empty */
+std::string GetMeshCacheName()
+{
+    CommandLineArguments* args = CommandLineArguments::Instance();
+    if (!args->OptionExists("-meshcache") || !args->OptionExists("-meshfile"))
+        return "";
+
+    std::string dir = args->GetNumberOfArgumentsForOption("-meshcache") > 0 ? args->GetStringCorrespondingToOption("-meshcache") : "";
+    return BinaryMeshCache::GetCacheName(args->GetStringCorrespondingToOption("-meshfile"), dir);
+}
+
 template<unsigned DIM>
 class AtrialFibrosis
 {
 private:
-    double GetMemoryUsage()
-    {
-    	struct rusage rusage;
-    	getrusage( RUSAGE_SELF, &rusage );
-    	return (double)(rusage.ru_maxrss)/(1024);// Convert KB to MB
-    }
+    std::vector<boost::shared_ptr<ActivationMapOutputModifier> > mActivationMaps;
+    boost::shared_ptr<FibrillationOutputModifier> mpFibrillation; ///< With -fibrillation
+    double mMaxStimulusDelay = 0; ///< Largest -protocol node delay, added to the last stimulus time
+    boost::shared_ptr<DistributedTetrahedralMesh<DIM,DIM> > mpMesh; ///< Mesh loaded by LoadMesh, outlives the problem
+    std::vector<unsigned> mNodePermutation; ///< Mesh permutation when Chaste doesn't know it (cached partitions), otherwise empty
+    uint64_t mMeshHash; ///< Checksum of the mesh cache, 0 without one
 
     void SetSchemaLocations()
     {
@@ -230,28 +363,6 @@ private:
         HeartConfig::Instance()->SetFixedSchemaLocations(schemaLocations);
     }
 
-    void OverrideVoltageLookupRange() {
-        boost::shared_ptr<AbstractIvpOdeSolver> noSolver;
-        boost::shared_ptr<AbstractStimulusFunction> noStim;
-        AbstractLookupTableCollection *tables[] = {
-                CellMaleckar2008_baseFromCellMLCvodeOpt(noSolver, noStim).GetLookupTableCollection(),
-                CellMaleckar2008_cAFFromCellMLCvodeOpt(noSolver, noStim).GetLookupTableCollection(),
-                CellMaleckar2008_LA_1h2HzFromCellMLCvodeOpt(noSolver, noStim).GetLookupTableCollection(),
-                CellMaleckar2008_RA_1h2HzFromCellMLCvodeOpt(noSolver, noStim).GetLookupTableCollection(),
-                Cellcourtemanche_ramirez_nattel_1998_SRFromCellMLCvodeOpt(noSolver, noStim).GetLookupTableCollection(),
-                Cellcourtemanche_ramirez_nattel_1998_cAFFromCellMLCvodeOpt(noSolver, noStim).GetLookupTableCollection(),
-        };
-
-        for (unsigned int i = 0; i < (sizeof(tables) / sizeof(tables[0])); i++) {
-            AbstractLookupTableCollection *p_tables = tables[i];
-            double min, step, max;
-            p_tables->GetTableProperties("membrane__V", min, step, max);
-            min = -150.0001;
-            p_tables->SetTableProperties("membrane__V", min, step, max);
-            p_tables->RegenerateTables();
-        }
-    }
-
     template<class T>
     std::vector<T> ParseMultiValueOption(std::string optname)
     {
@@ -378,32 +489,103 @@ private:
         return boost::shared_ptr<AbstractStimulusFunction>(new TimedStimulus(-stim_amp, stim_dur, times));
     }
 
+    boost::shared_ptr<StimulusProtocol> InitProtocol(std::vector<double> &rStimTimes) {
+        std::string path = CommandLineArguments::Instance()->GetStringCorrespondingToOption("-protocol");
+        boost::shared_ptr<StimulusProtocol> protocol(new StimulusProtocol(FileFinder(path, RelativeTo::AbsoluteOrCwd)));
+
+        std::vector<double> times = protocol->GetAllTimes();
+        mMaxStimulusDelay = protocol->GetMaxDelay();
+        LOG("protocol:");
+        LOG("\tfile     : " << path);
+        LOG("\tsites    : " << protocol->GetNumSites());
+        LOG("\tduration : " << GetDoubleOption("-stim_dur", 1.0) << "ms");
+        LOG("\tamplitude: " << GetDoubleOption("-stim_amp", 80000.0));
+        LOG("\tcycles   : " << times.size());
+        if (!times.empty()) {
+            LOG("\tfirst    : " << times[0] << "ms");
+            LOG("\tlast     : " << times.back() << "ms");
+        }
+        LOG("\tmax delay: " << mMaxStimulusDelay << "ms");
+
+        rStimTimes.insert(rStimTimes.end(), times.begin(), times.end());
+        return protocol;
+    }
+
     AtrialCellFactory<DIM> InitCellFactory(std::vector<double> &rStimTimes) {
         LOG("** CELLS **")
         std::string cellopt = "courtemanche_sr";
         if (CommandLineArguments::Instance()->OptionExists("-cell"))
             cellopt = CommandLineArguments::Instance()->GetStringCorrespondingToOption("-cell");
 
-        int cell_model;
-        if (cellopt == "maleckar")
-            cell_model = CellModel::MALECKAR;
-        else if (cellopt == "maleckar_caf")
-            cell_model = CellModel::MALECKAR_CAF;
-        else if (cellopt == "maleckar_anna")
-            cell_model = CellModel::MALECKAR_ANNA;
-        else if (cellopt == "courtemanche_sr")
-            cell_model = CellModel::COURTEMANCHE_SR;
-        else if (cellopt == "courtemanche_caf")
-            cell_model = CellModel::COURTEMANCHE_CAF;
-        else
-            EXCEPTION("Unknown Cell Model: " << cellopt);
+        int cell_model = ParseCellModel(cellopt);
         LOG("cell: " << cellopt);
 
-        auto p_stim_sinus = InitStimulus("sinus", rStimTimes, 4, 0, 500);
-        auto p_stim_extra = InitStimulus("extra", rStimTimes, 6, 400, 300);
+        std::string solveropt = "cvode";
+        if (CommandLineArguments::Instance()->OptionExists("-solver"))
+            solveropt = CommandLineArguments::Instance()->GetStringCorrespondingToOption("-solver");
+        CellSolver solver = ParseCellSolver(solveropt);
+        LOG("solver: " << solveropt);
+        if (solver == BATCHED_RUSH_LARSEN) {
+            GetBatchParameters(cell_model);
+            CommandLineArguments* args = CommandLineArguments::Instance();
+            if (args->OptionExists("-loaddir") || args->OptionExists("-savedir") || args->OptionExists("-checkpoint"))
+                EXCEPTION("Batched cells can not be archived, so can not be used with -loaddir, -savedir or -checkpoint");
+            if (args->OptionExists("-svi") || args->OptionExists("-quiescent") || args->OptionExists("-record_cost"))
+                EXCEPTION("Batched cells can not be used with -svi, -quiescent or -record_cost");
+        }
+
+        AtrialCellFactory<DIM> factory;
+        mMaxStimulusDelay = 0;
+        if (CommandLineArguments::Instance()->OptionExists("-protocol")) {
+            auto p_protocol = InitProtocol(rStimTimes);
+            factory = AtrialCellFactory<DIM>(p_protocol, -GetDoubleOption("-stim_amp", 80000.0), GetDoubleOption("-stim_dur", 1.0), cell_model);
+        }
+        else {
+            auto p_stim_sinus = InitStimulus("sinus", rStimTimes, 4, 0, 500);
+            auto p_stim_extra = InitStimulus("extra", rStimTimes, 6, 400, 300);
+            factory = AtrialCellFactory<DIM>(p_stim_sinus, p_stim_extra, cell_model);
+        }
+
+        factory.SetSolver(solver);
+        factory.SetRecordCost(CommandLineArguments::Instance()->OptionExists("-record_cost"));
+        OverrideVoltageLookupRange(cell_model, solver);
+        InitQuiescent(factory);
+        return factory;
+    }
+
+    /** -quiescent stops integrating cells which have settled at rest, see QuiescentCell */
+    void InitQuiescent(AtrialCellFactory<DIM>& rFactory) {
+        CommandLineArguments* args = CommandLineArguments::Instance();
+        if (!args->OptionExists("-quiescent"))
+            return;
+
+        if (args->OptionExists("-loaddir") || args->OptionExists("-savedir") || args->OptionExists("-checkpoint"))
+            EXCEPTION("-quiescent cells can not be archived, so can not be used with -loaddir, -savedir or -checkpoint");
+
+        double tolerance = args->GetNumberOfArgumentsForOption("-quiescent") > 0 ? args->GetDoubleCorrespondingToOption("-quiescent") : 1e-4;
+        double wake = GetDoubleOption("-quiescent_wake", 0.5);
+        int settle = GetIntOption("-quiescent_settle", 50);
+        if (settle < 1)
+            EXCEPTION("-quiescent_settle must be at least 1 step, not " << settle);
+        rFactory.SetQuiescent(tolerance, wake, settle);
 
-        OverrideVoltageLookupRange();
-        return AtrialCellFactory<DIM>(p_stim_sinus, p_stim_extra, cell_model);
+        LOG("quiescent:")
+        LOG("\ttolerance: " << tolerance << "/ms")
+        LOG("\twake     : " << wake << "mV")
+        LOG("\tsettle   : " << settle << " steps")
+    }
+
+    /** Totals of the QuiescentCell counters over all processes. Collective */
+    void ReportQuiescent(AtrialCellFactory<DIM>& rFactory) {
+        boost::shared_ptr<QuiescentStatistics> p_stats = rFactory.GetQuiescentStatistics();
+        if (!p_stats)
+            return;
+
+        unsigned long long counts[3] = {p_stats->mSteps, p_stats->mSkipped, p_stats->mWakes};
+        MPI_Allreduce(MPI_IN_PLACE, counts, 3, MPI_UNSIGNED_LONG_LONG, MPI_SUM, PETSC_COMM_WORLD);
+        LOG("quiescent: skipped " << counts[1] << "/" << counts[0] << " cell steps ("
+            << std::setprecision(1) << std::fixed << (counts[0] ? 100.0 * counts[1] / counts[0] : 0.0) << "%), "
+            << counts[2] << " wakes");
     }
 
     void ApplyPerm(std::vector<unsigned int> &nodes, const std::vector<unsigned int> &permutation) {
@@ -416,6 +598,7 @@ private:
     }
 
     void AddActivationMap(MonodomainProblem<DIM> *problem, const std::vector<double> &rStimTimes) {
+        mActivationMaps.clear();
         if (CommandLineArguments::Instance()->OptionExists("-nosnapshots"))
             return;
 
@@ -423,15 +606,127 @@ private:
         unsigned local_node0 = problem->rGetMesh().GetDistributedVectorFactory()->GetLow();
         AbstractCardiacCellInterface* cell = problem->GetMonodomainTissue()->GetCardiacCell(local_node0);
         auto* system = dynamic_cast<AbstractUntemplatedParameterisedSystem *>(cell);
-        double resting = system->GetSystemInformation()->GetInitialConditions()[cell->GetVoltageIndex()];
+        // batched cells have no system information, but are still in their initial state, and passive cells stay
+        // at the resting voltage of the cell model
+        if (dynamic_cast<FakeBathCell *>(cell))
+            system = nullptr;
+        double resting = system ? system->GetSystemInformation()->GetInitialConditions()[cell->GetVoltageIndex()] : cell->GetVoltage();
         double threshold = GetDoubleOption("-activation", -40);
 
-        problem->AddOutputModifier(boost::shared_ptr<AbstractOutputModifier>(new ActivationMapOutputModifier("snapshots.h5", threshold, resting, rStimTimes)));
-        problem->AddOutputModifier(boost::shared_ptr<AbstractOutputModifier>(new ActivationMapOutputModifier("snapshots_dyn.h5", threshold, resting)));
+        int batch = GetIntOption("-snapshot_batch", 8);
+        if (batch < 1)
+            EXCEPTION("-snapshot_batch must be at least 1, not " << batch);
+
+        boost::shared_ptr<ActivationMapOutputModifier> snapshots(new ActivationMapOutputModifier("snapshots.h5", threshold, resting, rStimTimes));
+        boost::shared_ptr<ActivationMapOutputModifier> snapshots_dyn(new ActivationMapOutputModifier("snapshots_dyn.h5", threshold, resting));
+        int lag = GetIntOption("-snapshot_lag", 0);
+        bool verbose = CommandLineArguments::Instance()->OptionExists("-snapshot_verbose");
+        snapshots->SetBatchSize(batch);
+        snapshots_dyn->SetBatchSize(batch);
+        snapshots_dyn->SetTriggerLag(lag);
+        snapshots_dyn->SetVerbose(verbose);
+        bool original_order = CommandLineArguments::Instance()->OptionExists("-original_order");
+        if (original_order) {
+            snapshots->SetOriginalOrder(rGetNodePermutation(problem->rGetMesh()));
+            snapshots_dyn->SetOriginalOrder(rGetNodePermutation(problem->rGetMesh()));
+        }
+        problem->AddOutputModifier(snapshots);
+        problem->AddOutputModifier(snapshots_dyn);
+        mActivationMaps = {snapshots, snapshots_dyn};
+
+        if (CommandLineArguments::Instance()->OptionExists("-loaddir")) {
+            std::string loaddir = CommandLineArguments::Instance()->GetStringCorrespondingToOption("-loaddir");
+            for (auto& p_map : mActivationMaps) {
+                FileFinder state(loaddir + "/" + p_map->GetStateFileName(), RelativeTo::ChasteTestOutput);
+                if (state.IsFile())
+                    p_map->LoadState(state, problem->rGetMesh().GetDistributedVectorFactory());
+            }
+        }
 
         LOG("activationmap:")
         LOG("\tthreshold: " << threshold << "mV")
         LOG("\tresting  : " << resting << "mV")
+        LOG("\tbatch    : " << batch)
+        LOG("\tlag      : " << lag)
+        LOG("\torder    : " << (original_order ? "original" : "mesh"))
+    }
+
+    /** -fibrillation writes windowed conduction velocity, dominant frequency and phase singularities, see FibrillationOutputModifier */
+    void AddFibrillation(MonodomainProblem<DIM> *problem) {
+        mpFibrillation.reset();
+        CommandLineArguments* args = CommandLineArguments::Instance();
+        if (!args->OptionExists("-fibrillation"))
+            return;
+
+        double window = GetDoubleOption("-fibrillation", 2000);
+        double sample_interval = GetDoubleOption("-fibrillation_dt", 1);
+        double threshold = GetDoubleOption("-activation", -40);
+        mpFibrillation.reset(new FibrillationOutputModifier("fibrillation.h5", threshold, window, sample_interval));
+        if (args->OptionExists("-df_band")) {
+            std::vector<double> band = ParseMultiValueOption<double>("-df_band");
+            if (band.size() != 2)
+                EXCEPTION("-df_band takes a minimum and maximum frequency (Hz)");
+            mpFibrillation->SetFrequencyBand(band[0], band[1]);
+        }
+        mpFibrillation->SetMesh(problem->rGetMesh());
+        problem->AddOutputModifier(mpFibrillation);
+
+        LOG("fibrillation:")
+        LOG("\twindow   : " << window << "ms")
+        LOG("\tsample   : " << sample_interval << "ms")
+        LOG("\tthreshold: " << threshold << "mV")
+    }
+
+    /** -telemetry writes per process timings and memory to telemetry.jsonl, see TelemetryOutputModifier */
+    void AddTelemetry(MonodomainProblem<DIM> *problem) {
+        if (!CommandLineArguments::Instance()->OptionExists("-telemetry"))
+            return;
+
+        double interval = CommandLineArguments::Instance()->GetNumberOfArgumentsForOption("-telemetry") > 0
+                ? CommandLineArguments::Instance()->GetDoubleCorrespondingToOption("-telemetry") : 10.0;
+        boost::shared_ptr<TelemetryOutputModifier> p_telemetry(new TelemetryOutputModifier("telemetry.jsonl", interval));
+        for (auto& p_map : mActivationMaps)
+            p_telemetry->AddActivationMap(p_map);
+        p_telemetry->SetAppend(CommandLineArguments::Instance()->OptionExists("-loaddir"));
+        problem->AddOutputModifier(p_telemetry);
+        LOG("telemetry: every " << interval << "ms");
+    }
+
+    /**
+     * -compress_voltage writes the voltage to voltage.h5 as 16 bit values, see CompressedVoltageOutputModifier.
+     * results.h5 is then only written for -vtk, which is converted from it
+     */
+    void AddCompressedVoltage(MonodomainProblem<DIM> *problem) {
+        CommandLineArguments* args = CommandLineArguments::Instance();
+        if (!args->OptionExists("-compress_voltage"))
+            return;
+
+        std::string encoding = args->GetNumberOfArgumentsForOption("-compress_voltage") > 0
+                ? args->GetStringCorrespondingToOption("-compress_voltage") : "int16";
+        std::vector<double> range = {-100, 80};
+        if (args->OptionExists("-compress_range")) {
+            range = ParseMultiValueOption<double>("-compress_range");
+            if (range.size() != 2)
+                EXCEPTION("-compress_range takes a minimum and maximum voltage (mV)");
+        }
+
+        boost::shared_ptr<CompressedVoltageOutputModifier> p_voltage(new CompressedVoltageOutputModifier(
+                "voltage.h5", CompressedVoltageOutputModifier::ParseEncoding(encoding), range[0], range[1]));
+        if (args->OptionExists("-nodes")) {
+            std::vector<unsigned> nodes = ParseMultiValueOption<unsigned>("-nodes");
+            ApplyPerm(nodes, rGetNodePermutation(problem->rGetMesh()));
+            p_voltage->SetNodes(nodes);
+        }
+        p_voltage->SetAppend(args->OptionExists("-loaddir"));
+        problem->AddOutputModifier(p_voltage);
+        if (!args->OptionExists("-vtk"))
+            problem->PrintOutput(false);
+
+        LOG("compressed voltage:")
+        LOG("\tencoding : " << encoding)
+        if (encoding == "int16")
+            LOG("\trange    : " << range[0] << " to " << range[1] << "mV, step " << (range[1] - range[0]) / 65534 << "mV")
+        LOG("\tresults  : " << (args->OptionExists("-vtk") ? "true" : "false"))
     }
 
     chaste::parameters::v2017_1::media_type GetFibreOrientation(std::string meshfile) {
@@ -441,36 +736,186 @@ private:
         return cp::media_type::Axisymmetric;
     }
 
-    MonodomainProblem<DIM> *InitProblem(AtrialCellFactory<DIM> *cell_factory, AtrialConductivityModifier<DIM> *conductivity_modifier)
+    /** Number of nodes owned by each process. Collective */
+    std::vector<unsigned> GatherOwnership(AbstractTetrahedralMesh<DIM,DIM>& rMesh) {
+        unsigned local = rMesh.GetDistributedVectorFactory()->GetLocalOwnership();
+        std::vector<unsigned> ownership(PetscTools::GetNumProcs());
+        MPI_Allgather(&local, 1, MPI_UNSIGNED, &ownership[0], 1, MPI_UNSIGNED, PETSC_COMM_WORLD);
+        return ownership;
+    }
+
+    /** File to mesh index of each node, perm[file index] = mesh index. Empty if the mesh is not permuted */
+    const std::vector<unsigned>& rGetNodePermutation(AbstractTetrahedralMesh<DIM,DIM>& rMesh) {
+        return mNodePermutation.empty() ? rMesh.rGetNodePermutation() : mNodePermutation;
+    }
+
+    /**
+     * Partitions the mesh with the node costs of -cost_weights, recorded with -record_cost on the same mesh, so each
+     * process gets the same integration cost. Collective
+     */
+    NodePartition PartitionByCost(BinaryMeshReader<DIM>& rMeshReader) {
+        std::string path = CommandLineArguments::Instance()->GetStringCorrespondingToOption("-cost_weights");
+        const unsigned num_procs = PetscTools::GetNumProcs();
+        NodePartition partition;
+        double imbalance[2] = {1.0, 1.0}; // recorded and predicted
+        if (PetscTools::AmMaster()) {
+            try {
+                NodeCost cost;
+                cost.Load(FileFinder(path, RelativeTo::AbsoluteOrCwd));
+                if (cost.GetMeshHash() != mMeshHash || cost.GetNumNodes() != rMeshReader.GetNumNodes())
+                    EXCEPTION("Cost file " << path << " was recorded on a different mesh");
+
+                std::vector<unsigned> ranks = cost.Partition(rMeshReader.GetFileElements(), rMeshReader.GetNumElements(), DIM + 1, num_procs);
+                const std::vector<unsigned>& r_recorded = cost.rGetRank();
+                unsigned recorded_procs = r_recorded.empty() ? 1 : *std::max_element(r_recorded.begin(), r_recorded.end()) + 1;
+                imbalance[0] = NodeCost::GetImbalance(cost.GetProcessCosts(r_recorded, recorded_procs));
+                imbalance[1] = NodeCost::GetImbalance(cost.GetProcessCosts(ranks, num_procs));
+                partition = NodePartition::FromNodeRanks(mMeshHash, ranks, num_procs);
+            }
+            catch (const Exception&) {
+                PetscTools::ReplicateException(true);
+                throw;
+            }
+        }
+        PetscTools::ReplicateException(false);
+
+        partition.Broadcast();
+        LOG("partition: " << path << " (cost weighted)");
+        LOG("\timbalance: " << std::setprecision(3) << std::fixed << imbalance[0] << " recorded, " << imbalance[1] << " predicted (slowest process / mean)");
+        return partition;
+    }
+
+    /** Loads and partitions -meshfile, through the binary cache if -meshcache is given */
+    boost::shared_ptr<DistributedTetrahedralMesh<DIM,DIM> > LoadMesh() {
+        TRACE_SCOPE("LoadMesh");
+        std::string meshfile = CommandLineArguments::Instance()->GetStringCorrespondingToOption("-meshfile");
+        std::string cache = GetMeshCacheName();
+        if (cache.empty() && CommandLineArguments::Instance()->OptionExists("-cost_weights"))
+            EXCEPTION("-cost_weights needs -meshcache");
+        boost::shared_ptr<DistributedTetrahedralMesh<DIM,DIM> > p_mesh(
+                new DistributedTetrahedralMesh<DIM,DIM>(HeartConfig::Instance()->GetMeshPartitioning()));
+
+        double start_time = Timer::GetWallTime();
+        if (cache.empty()) {
+            TrianglesMeshReader<DIM,DIM> mesh_reader(meshfile);
+            p_mesh->ConstructFromMeshReader(mesh_reader);
+        }
+        else {
+            bool rebuilt = BinaryMeshCache::Update(meshfile, cache);
+            LOG("meshcache: " << cache << (rebuilt ? " (rebuilt)" : ""));
+            BinaryMeshHeader header;
+            BinaryMeshCache::ReadHeader(cache, header);
+            BinaryMeshReader<DIM> mesh_reader(cache);
+            mMeshHash = header.mChecksum;
+
+            // a partition of the same mesh on the same number of processes is reused, by presenting the nodes in
+            // partitioned order and giving each process the same range of them. A cost weighted partition is
+            // applied the same way, but not saved as the mesh's partition
+            const unsigned num_procs = PetscTools::GetNumProcs();
+            FileFinder partition_file(NodePartition::GetFileName(cache, num_procs), RelativeTo::AbsoluteOrCwd);
+            NodePartition partition;
+            bool weighted = CommandLineArguments::Instance()->OptionExists("-cost_weights");
+            if (weighted)
+                partition = PartitionByCost(mesh_reader);
+
+            if (weighted || (partition.Load(partition_file) && partition.GetMeshHash() == mMeshHash
+                    && partition.GetNumProcs() == num_procs && partition.GetNumNodes() == header.mNumNodes)) {
+                const unsigned rank = PetscTools::GetMyRank();
+                const unsigned lo = partition.GetLow(rank);
+                p_mesh.reset(new DistributedTetrahedralMesh<DIM,DIM>(DistributedTetrahedralMeshPartitionType::DUMB));
+                p_mesh->SetDistributedVectorFactory(new DistributedVectorFactory(lo, lo + partition.rGetOwnership()[rank], header.mNumNodes));
+                mesh_reader.SetNodePermutation(partition.rGetPermutation());
+                p_mesh->ConstructFromMeshReader(mesh_reader);
+                mNodePermutation = partition.rGetPermutation();
+                if (!weighted)
+                    LOG("partition: " << partition_file.GetAbsolutePath() << " (cached)");
+            }
+            else {
+                p_mesh->ConstructFromMeshReader(mesh_reader);
+                if (PetscTools::AmMaster())
+                    NodePartition(mMeshHash, GatherOwnership(*p_mesh), p_mesh->rGetNodePermutation()).Save(partition_file);
+                else
+                    GatherOwnership(*p_mesh);
+                LOG("partition: " << partition_file.GetAbsolutePath());
+            }
+        }
+        LOG("mesh load: " << std::setprecision(3) << std::fixed << (Timer::GetWallTime() - start_time) << "s");
+
+        return p_mesh;
+    }
+
+    MonodomainProblem<DIM> *InitProblem(AtrialCellFactory<DIM> *cell_factory, AtrialConductivityModifier<DIM> *conductivity_modifier,
+                                        AbstractTetrahedralMesh<DIM,DIM>* pMesh)
     {
+        TRACE_SCOPE("InitProblem");
         CommandLineArguments* args = CommandLineArguments::Instance();
         HeartConfig* heartConfig = HeartConfig::Instance();
         MonodomainProblem<DIM>* problem;
 
-        if (args->OptionExists("-svi"))
-            heartConfig->SetUseStateVariableInterpolation(true);
+        heartConfig->SetUseStateVariableInterpolation(args->OptionExists("-svi"));
+        bool passive_isolated = args->OptionExists("-passive_isolated");
+        if (passive_isolated && (args->OptionExists("-svi") || args->OptionExists("-loaddir")))
+            EXCEPTION("-passive_isolated can not be used with -svi or -loaddir");
+        bool conductivities_set = false;
 
         LOG("** PROBLEM **")
         if (args->OptionExists("-loaddir")) {
             std::string loaddir = args->GetStringCorrespondingToOption("-loaddir");
             LOG("loaddir: " << loaddir);
             problem = CardiacSimulationArchiver<MonodomainProblem<DIM> >::Load(loaddir);
+
+            // a cached partition is saved with the archive, and Chaste may have repartitioned it since
+            NodePartition partition;
+            if (partition.Load(FileFinder(loaddir + "/permutation.h5", RelativeTo::ChasteTestOutput)) && !partition.rGetPermutation().empty()) {
+                mNodePermutation = partition.rGetPermutation();
+                const std::vector<unsigned>& r_mesh_perm = problem->rGetMesh().rGetNodePermutation();
+                if (!r_mesh_perm.empty())
+                    for (unsigned& r_index : mNodePermutation)
+                        r_index = r_mesh_perm[r_index];
+            }
         }
         else {
             std::string meshfile = args->GetStringCorrespondingToOption("-meshfile");
-            LOG("meshfile: " << meshfile);
-            heartConfig->SetMeshFileName(meshfile, GetFibreOrientation(meshfile));
+            LOG("meshfile: " << meshfile << (pMesh ? " (shared)" : ""));
+            std::string cache = GetMeshCacheName();
+            // isolated nodes are found before the cells are created, so the mesh is loaded here rather than by Chaste
+            if (!pMesh && (!cache.empty() || passive_isolated)) {
+                mpMesh = LoadMesh();
+                pMesh = mpMesh.get();
+            }
+            if (passive_isolated) {
+                InitConductivityModifier(*pMesh, conductivity_modifier);
+                conductivities_set = true;
+                std::vector<unsigned> isolated = conductivity_modifier->GetIsolatedNodes();
+                cell_factory->SetPassiveNodes(isolated);
+
+                unsigned counts[2] = {(unsigned)isolated.size(), pMesh->GetDistributedVectorFactory()->GetLocalOwnership()};
+                MPI_Allreduce(MPI_IN_PLACE, counts, 2, MPI_UNSIGNED, MPI_SUM, PETSC_COMM_WORLD);
+                LOG("passive isolated: " << counts[0] << "/" << counts[1] << " nodes ("
+                    << std::setprecision(1) << std::fixed << 100.0 * counts[0] / counts[1] << "%)");
+            }
+
+            //fibres are still read from the file, the cache has a binary copy
+            std::string fibre_mesh = cache.empty() ? meshfile : cache;
+            heartConfig->SetMeshFileName(fibre_mesh, GetFibreOrientation(fibre_mesh));
 
             problem = new MonodomainProblem<DIM>(cell_factory);
+            if (pMesh)
+                problem->SetMesh(pMesh);
+            cell_factory->SetNodePermutation(mNodePermutation);
             problem->SetWriteInfo();
-            problem->Initialise();
+            {
+                TRACE_SCOPE("Initialise");
+                problem->Initialise();
+            }
+            cell_factory->ConnectBatch(problem->GetTissue());
         }
 
         LOG("svi: " << (heartConfig->GetUseStateVariableInterpolation() ? "true" : "false"))
 
         if (args->OptionExists("-nodes")) {
             std::vector<unsigned> nodes = ParseMultiValueOption<unsigned>("-nodes");
-            ApplyPerm(nodes, problem->rGetMesh().rGetNodePermutation());
+            ApplyPerm(nodes, rGetNodePermutation(problem->rGetMesh()));
             problem->SetOutputNodes(nodes);
             LOG("nodes: " << args->GetStringCorrespondingToOption("-nodes"));
         }
@@ -482,12 +927,26 @@ private:
         heartConfig->SetVisualizeWithParallelVtk(args->OptionExists("-vtk"));
         LOG("vtk: " << (heartConfig->GetVisualizeWithParallelVtk() ? "true" : "false"));
 
-        conductivity_modifier->SetMesh(&problem->rGetMesh());
+        if (!conductivities_set)
+            InitConductivityModifier(problem->rGetMesh(), conductivity_modifier);
         problem->GetTissue()->SetConductivityModifier(conductivity_modifier);
 
         return problem;
     }
 
+    /** Multipliers from -condmod and -fibrosis and the tissue table, once the mesh is partitioned */
+    void InitConductivityModifier(AbstractTetrahedralMesh<DIM,DIM>& rMesh, AtrialConductivityModifier<DIM> *conductivity_modifier) {
+        TRACE_SCOPE("InitConductivityModifier");
+        CommandLineArguments* args = CommandLineArguments::Instance();
+        conductivity_modifier->SetMesh(&rMesh);
+        if (args->OptionExists("-condmod")) {
+            std::string path = args->GetStringCorrespondingToOption("-condmod");
+            conductivity_modifier->LoadConductivities(FileFinder(path, RelativeTo::AbsoluteOrCwd));
+        }
+        ApplyFibrosis(rMesh, conductivity_modifier);
+        conductivity_modifier->BuildTensorCache(InitTissueTable());
+    }
+
     AtrialConductivityModifier<DIM> InitConductivities() {
 		double base_cond = GetDoubleOption("-base_cond", 1.75);
 		double anisotropy_ratio = GetDoubleOption("-ar", 9.21);
@@ -495,14 +954,101 @@ private:
 		LOG("\tanisotropy ratio : " << anisotropy_ratio);
         HeartConfig::Instance()->SetIntracellularConductivities(Create_c_vector(base_cond, base_cond/anisotropy_ratio, base_cond/anisotropy_ratio));
 
-        std::vector<float> conductivities;
-        if (CommandLineArguments::Instance()->OptionExists("-condmod")) {
-            std::string path = CommandLineArguments::Instance()->GetStringCorrespondingToOption("-condmod");
-            LOG("conductivities   : " << path);
-            conductivities = ConductivityReader::ReadConductivities(FileFinder(path, RelativeTo::AbsoluteOrCwd));
+        // the multipliers are read once the mesh is partitioned, see InitProblem
+        if (CommandLineArguments::Instance()->OptionExists("-condmod"))
+            LOG("conductivities   : " << CommandLineArguments::Instance()->GetStringCorrespondingToOption("-condmod"));
+
+        return AtrialConductivityModifier<DIM>();
+    }
+
+    TissueConductivityTable InitTissueTable() {
+        if (!CommandLineArguments::Instance()->OptionExists("-tissue"))
+            return TissueConductivityTable();
+
+        std::string path = CommandLineArguments::Instance()->GetStringCorrespondingToOption("-tissue");
+        TissueConductivityTable table(FileFinder(path, RelativeTo::AbsoluteOrCwd));
+        LOG("tissue table: " << path << " (" << table.GetNumClasses() << " classes)");
+        return table;
+    }
+
+    /**
+     * Generates a fibrotic pattern with octave noise over the local element centroids.
+     * Equivalent to apply_field.m (octave.m with twoD for 2D meshes), fibrotic elements have their conductivity
+     * multiplied by 0
+     */
+    void ApplyFibrosis(AbstractTetrahedralMesh<DIM,DIM>& rMesh, AtrialConductivityModifier<DIM> *conductivity_modifier) {
+        CommandLineArguments* args = CommandLineArguments::Instance();
+        if (!args->OptionExists("-fibrosis"))
+            return;
+
+        std::string seed = args->GetStringCorrespondingToOption("-fibrosis");
+        double unit = GetDoubleOption("-fibrosis_unit", 5.0);
+        int harmonics = GetIntOption("-fibrosis_harmonics", 4);
+        double roughness = GetDoubleOption("-fibrosis_roughness", 0.5);
+        double fill = GetDoubleOption("-fibrosis_fill", 0.8);
+
+        boost::shared_ptr<OctaveNoise> noise;
+        try {
+            noise.reset(new OctaveNoise(harmonics, boost::lexical_cast<unsigned>(seed)));
+        }
+        catch (const boost::bad_lexical_cast &e) {
+            noise.reset(new OctaveNoise(FileFinder(seed, RelativeTo::AbsoluteOrCwd)));
+        }
+
+        LOG("fibrosis:");
+        LOG("\tseed     : " << seed);
+        LOG("\tunit     : " << unit);
+        LOG("\tharmonics: " << harmonics);
+        LOG("\troughness: " << roughness);
+        LOG("\tfill     : " << fill);
+
+        // gather local element centroids as coordinate arrays, in the modifier's local order
+        const std::vector<unsigned>& indices = conductivity_modifier->rGetElementIndices();
+        std::vector<bool> owned;
+        std::vector<double> coords[3];
+        for (unsigned i = 0; i < indices.size(); i++)
+        {
+            c_vector<double, DIM> centroid = rMesh.GetElement(indices[i])->CalculateCentroid();
+            for (unsigned d = 0; d < DIM; d++)
+                coords[d].push_back(centroid[d]);
+
+            owned.push_back(rMesh.CalculateDesignatedOwnershipOfElement(indices[i]));
         }
 
-        return AtrialConductivityModifier<DIM>(conductivities);
+        std::vector<double> values(indices.size());
+        if (!indices.empty())
+            noise->Sample(indices.size(), &coords[0][0], &coords[1][0], DIM > 2 ? &coords[2][0] : nullptr,
+                          unit, harmonics, roughness, &values[0]);
+
+        double level = fill > 0 ? OctaveNoise::FindLevel(values, owned, fill) : 0;
+
+        std::vector<float>& conductivities = conductivity_modifier->rGetConductivities();
+        if (conductivities.empty())
+            conductivities.assign(indices.size(), 1.0f);
+
+        // fibrosis.m writes Conductivity = 1 - fib, fib is continuous noise when fill is 0
+        unsigned num_fibrotic = 0;
+        for (unsigned i = 0; i < indices.size(); i++) {
+            double fib = fill > 0 ? (values[i] <= level ? 1.0 : 0.0) : values[i];
+            conductivities[i] *= (float)(1.0 - fib);
+            if (owned[i] && fib >= 1.0)
+                num_fibrotic++;
+        }
+
+        MPI_Allreduce(MPI_IN_PLACE, &num_fibrotic, 1, MPI_UNSIGNED, MPI_SUM, PETSC_COMM_WORLD);
+        LOG("\tlevel    : " << level);
+        LOG("\tfibrotic : " << num_fibrotic << "/" << rMesh.GetNumElements() << " elements");
+    }
+
+    /** Archives the problem and the activation map state, so it can be resumed with -loaddir */
+    void SaveTo(MonodomainProblem<DIM> *problem, const std::string& rDirectory) {
+        CardiacSimulationArchiver<MonodomainProblem<DIM> >::Save(*problem, rDirectory);
+
+        OutputFileHandler handler(rDirectory, false);
+        if (!mNodePermutation.empty())
+            WritePermutation(handler, problem);
+        for (auto& p_map : mActivationMaps)
+            p_map->SaveState(handler.FindFile(p_map->GetStateFileName()));
     }
 
     void Save(MonodomainProblem<DIM> *problem) {
@@ -510,7 +1056,158 @@ private:
         {
             std::string savedir = CommandLineArguments::Instance()->GetStringCorrespondingToOption("-savedir");
             LOG("savedir: " << savedir);
-            CardiacSimulationArchiver<MonodomainProblem<DIM> >::Save(*problem, savedir);
+            SaveTo(problem, savedir);
+        }
+    }
+
+    /**
+     * -stop_quiet and -stop_reentry check, once the segment ending at time has been solved after the last stimulus
+     * ended at stimulusEnd. rBaseline is the activation count of each local node before the last stimulus.
+     * Describes the state in rOutcome. Collective
+     * @return whether a policy is met
+     */
+    bool CheckStop(double time, double stimulusEnd, const std::vector<unsigned>& rBaseline, std::string& rOutcome) {
+        const ActivationMapOutputModifier& r_map = *mActivationMaps.front();
+        double last_active = std::max(r_map.GetLastActiveTime(time), stimulusEnd);
+        MPI_Allreduce(MPI_IN_PLACE, &last_active, 1, MPI_DOUBLE, MPI_MAX, PETSC_COMM_WORLD);
+
+        // the stimulated wave is the first activation after the baseline, reentry is any after it
+        const std::vector<unsigned>& r_counts = r_map.rGetActivationCounts();
+        unsigned cycles = 0;
+        for (unsigned i = 0; i < r_counts.size(); i++)
+            cycles = std::max(cycles, r_counts[i] - rBaseline[i]);
+        MPI_Allreduce(MPI_IN_PLACE, &cycles, 1, MPI_UNSIGNED, MPI_MAX, PETSC_COMM_WORLD);
+        cycles = cycles > 0 ? cycles - 1 : 0;
+
+        std::stringstream outcome;
+        if (last_active < time)
+            outcome << "quiet from " << last_active << "ms";
+        else
+            outcome << "active";
+        outcome << ", " << cycles << " cycles of reentry";
+        rOutcome = outcome.str();
+
+        double quiet = GetDoubleOption("-stop_quiet", 0);
+        int reentry = GetIntOption("-stop_reentry", 0);
+        return (quiet > 0 && time - last_active >= quiet - 1e-6) || (reentry > 0 && cycles >= (unsigned)reentry);
+    }
+
+    /**
+     * Solves to the end of the simulation. With -checkpoint, the solve is split into segments and the
+     * problem is archived to <outdir>/checkpoint_<time> after each, keeping the last -checkpoints_kept.
+     * With -stop_quiet or -stop_reentry, it is also split every -stop_check and before the last stimulus (at
+     * lastStimulus, which ends after the largest -protocol node delay), and stops early once a policy is met. The
+     * outcome is logged
+     */
+    void Solve(MonodomainProblem<DIM> *problem, double lastStimulus) {
+        CommandLineArguments* args = CommandLineArguments::Instance();
+        double interval = GetDoubleOption("-checkpoint", 0);
+        bool stop = args->OptionExists("-stop_quiet") || args->OptionExists("-stop_reentry");
+        if (interval <= 0 && !stop) {
+            TRACE_SCOPE("Solve");
+            problem->Solve();
+            return;
+        }
+
+        HeartConfig* heartConfig = HeartConfig::Instance();
+        double printing_dt = heartConfig->GetPrintingTimeStep();
+        if (interval > 0 && fabs(interval / printing_dt - round(interval / printing_dt)) > 1e-6)
+            EXCEPTION("Checkpoint interval " << interval << "ms must be a multiple of the output interval " << printing_dt << "ms");
+
+        unsigned kept = std::max(GetIntOption("-checkpoints_kept", 2), 1);
+        if (interval > 0)
+            LOG("checkpoint: every " << interval << "ms, keeping " << kept);
+
+        double check = 0;
+        if (stop) {
+            if (mActivationMaps.empty())
+                EXCEPTION("-stop_quiet and -stop_reentry use the activation maps, so can not be used with -nosnapshots");
+            check = GetDoubleOption("-stop_check", printing_dt * ceil(50 / printing_dt - 1e-6));
+            if (check <= 0 || fabs(check / printing_dt - round(check / printing_dt)) > 1e-6)
+                EXCEPTION("Stop check interval " << check << "ms must be a multiple of the output interval " << printing_dt << "ms");
+            LOG("stop:");
+            if (args->OptionExists("-stop_quiet"))
+                LOG("\tquiet    : " << GetDoubleOption("-stop_quiet", 0) << "ms");
+            if (args->OptionExists("-stop_reentry"))
+                LOG("\treentry  : " << GetIntOption("-stop_reentry", 0) << " cycles");
+            LOG("\tcheck    : every " << check << "ms, after " << lastStimulus << "ms");
+        }
+
+        std::string outdir = heartConfig->GetOutputDirectory();
+        double end_time = heartConfig->GetSimulationDuration();
+        // a segment ends at the output step at or before the last stimulus, so the baseline is taken before it
+        double baseline_time = floor(lastStimulus / printing_dt + 1e-6) * printing_dt;
+        double stimulus_end = lastStimulus + mMaxStimulusDelay + GetDoubleOption("-stim_dur", 1.0);
+        std::deque<std::string> checkpoints;
+        std::vector<unsigned> baseline;
+        std::string outcome;
+        double time = problem->GetCurrentTime();
+        if (stop && time >= baseline_time - 1e-6) {
+            // the last stimulus is at or before the start, so no segment ends before it
+            baseline = mActivationMaps.front()->rGetActivationCounts();
+            if (baseline.empty()) // the tracker is set up by the first solve, nothing has activated yet
+                baseline.assign(problem->rGetMesh().GetDistributedVectorFactory()->GetLocalOwnership(), 0u);
+        }
+        auto next_multiple = [&time](double period) { return (floor(time / period + 1e-6) + 1) * period; };
+        while (true) {
+            double next = end_time;
+            if (interval > 0)
+                next = std::min(next, next_multiple(interval));
+            if (stop) {
+                next = std::min(next, next_multiple(check));
+                if (time < baseline_time - 1e-6)
+                    next = std::min(next, baseline_time);
+            }
+            if (next >= end_time - 1e-6)
+                break;
+
+            heartConfig->SetSimulationDuration(next);
+            {
+                TRACE_SCOPE("Solve");
+                problem->Solve();
+            }
+            time = next;
+
+            if (interval > 0 && fabs(time / interval - round(time / interval)) < 1e-6) {
+                std::stringstream dir;
+                dir << outdir << "/checkpoint_" << time << "ms";
+                double start = Timer::GetWallTime();
+                {
+                    TRACE_SCOPE("Checkpoint");
+                    SaveTo(problem, dir.str());
+                }
+                heartConfig->SetOutputDirectory(outdir); // keep writing results to outdir
+                LOG("checkpoint: " << dir.str() << " (" << std::setprecision(3) << std::fixed << Timer::GetWallTime() - start << "s)");
+
+                // only remove old checkpoints once the new one is complete
+                checkpoints.push_back(dir.str());
+                while (checkpoints.size() > kept) {
+                    if (PetscTools::AmMaster())
+                        FileFinder(checkpoints.front(), RelativeTo::ChasteTestOutput).Remove();
+                    checkpoints.pop_front();
+                }
+                PetscTools::Barrier("AtrialFibrosis::Solve");
+            }
+
+            if (stop && baseline.empty() && time >= baseline_time - 1e-6)
+                baseline = mActivationMaps.front()->rGetActivationCounts();
+            if (stop && time >= stimulus_end && CheckStop(time, stimulus_end, baseline, outcome)) {
+                LOG("outcome: " << outcome << ", stopped at " << time << "ms");
+                heartConfig->SetSimulationDuration(time);
+                return;
+            }
+        }
+
+        heartConfig->SetSimulationDuration(end_time);
+        {
+            TRACE_SCOPE("Solve");
+            problem->Solve();
+        }
+        if (stop) {
+            if (baseline.empty())
+                baseline = mActivationMaps.front()->rGetActivationCounts();
+            CheckStop(end_time, stimulus_end, baseline, outcome);
+            LOG("outcome: " << outcome << ", ran to " << end_time << "ms");
         }
     }
 
@@ -524,26 +1221,79 @@ private:
         os->close();
     }
 
-    void WritePermutation(OutputFileHandler out_dir, MonodomainProblem<DIM> *problem)
+    /**
+     * Writes the integration time of each node to <outdir>/cost.h5 for -cost_weights, see NodeCost, and logs how
+     * evenly it was spread over the processes. Collective
+     */
+    void RecordCost(OutputFileHandler out_dir, MonodomainProblem<DIM> *problem)
     {
+        if (!CommandLineArguments::Instance()->OptionExists("-record_cost"))
+            return;
+
+        AbstractTetrahedralMesh<DIM,DIM>& r_mesh = problem->rGetMesh();
+        DistributedVectorFactory* p_factory = r_mesh.GetDistributedVectorFactory();
+        std::vector<double> local;
+        for (unsigned i = p_factory->GetLow(); i < p_factory->GetHigh(); i++) {
+            auto* p_cost = dynamic_cast<RecordedCost*>(problem->GetTissue()->GetCardiacCell(i));
+            local.push_back(p_cost ? p_cost->GetCost() : 0.0);
+        }
+
+        std::vector<unsigned> ownership = GatherOwnership(r_mesh);
+        std::vector<int> counts(ownership.begin(), ownership.end());
+        std::vector<int> offsets(counts.size(), 0);
+        std::partial_sum(counts.begin(), counts.end() - 1, offsets.begin() + 1);
+        std::vector<double> cost(PetscTools::AmMaster() ? p_factory->GetProblemSize() : 0);
+        MPI_Gatherv(local.data(), local.size(), MPI_DOUBLE, cost.data(), counts.data(), offsets.data(), MPI_DOUBLE, 0, PETSC_COMM_WORLD);
         if (!PetscTools::AmMaster())
             return;
 
-        std::vector<unsigned> perm_vec = problem->rGetMesh().rGetNodePermutation();
-        if (perm_vec.size() == 0)
+        // by .node file index, as the weights are applied before the mesh is permuted
+        std::vector<unsigned> ranks(cost.size());
+        for (unsigned r = 0; r < ownership.size(); r++)
+            std::fill(ranks.begin() + offsets[r], ranks.begin() + offsets[r] + counts[r], r);
+        const std::vector<unsigned>& r_perm = rGetNodePermutation(r_mesh);
+        std::vector<double> file_cost(cost);
+        std::vector<unsigned> file_ranks(ranks);
+        for (unsigned i = 0; i < r_perm.size(); i++) {
+            file_cost[i] = cost[r_perm[i]];
+            file_ranks[i] = ranks[r_perm[i]];
+        }
+
+        NodeCost node_cost(mMeshHash, file_cost, file_ranks);
+        node_cost.Save(out_dir.FindFile("cost.h5"));
+
+        std::vector<double> process_costs = node_cost.GetProcessCosts(file_ranks, ownership.size());
+        LOG("cost: " << out_dir.GetOutputDirectoryFullPath() << "cost.h5");
+        LOG("\tslowest  : " << std::setprecision(3) << std::fixed << *std::max_element(process_costs.begin(), process_costs.end()) << "s");
+        LOG("\tfastest  : " << *std::min_element(process_costs.begin(), process_costs.end()) << "s");
+        LOG("\timbalance: " << NodeCost::GetImbalance(process_costs) << " (slowest process / mean)");
+        if (mMeshHash == 0)
+            LOG("\twarning  : recorded without -meshcache, -cost_weights will not accept this file");
+    }
+
+    /** Writes permutation.h5, see NodePartition. Collective */
+    void WritePermutation(OutputFileHandler out_dir, MonodomainProblem<DIM> *problem)
+    {
+        std::vector<unsigned> ownership = GatherOwnership(problem->rGetMesh());
+        const std::vector<unsigned>& r_perm = rGetNodePermutation(problem->rGetMesh());
+        if (!PetscTools::AmMaster() || r_perm.empty())
             return;
 
-        out_stream os = out_dir.OpenOutputFile("permutation.txt");
-        (*os) << "Meshfile Chaste" << std::endl;
-        for (unsigned i = 0; i < perm_vec.size(); ++i)
-            (*os) << i << ' ' << perm_vec[i] << std::endl;
+        NodePartition(mMeshHash, ownership, r_perm).Save(out_dir.FindFile("permutation.h5"));
     }
 
 public:
-    void RunSimulation() throw(Exception)
+    AtrialFibrosis() :
+            mMeshHash(0)
+    {}
+
+    /** Runs one simulation with the current options. pMesh is used instead of loading -meshfile if given */
+    void RunSimulation(AbstractTetrahedralMesh<DIM,DIM>* pMesh = nullptr) throw(Exception)
     {
         double start_time = Timer::GetWallTime();
         SetSchemaLocations();
+        if (QutemuTrace::IsEnabled())
+            QutemuTrace::Start();
 
         COUT("Initializing");
         OutputFileHandler out_dir = InitOutput();
@@ -551,12 +1301,21 @@ public:
         std::vector<double> stim_times;
         AtrialCellFactory<DIM> cell_factory = InitCellFactory(stim_times);
         AtrialConductivityModifier<DIM> conductivity_modifier = InitConductivities();
-        MonodomainProblem<DIM>* problem = InitProblem(&cell_factory, &conductivity_modifier);
+        MonodomainProblem<DIM>* problem = InitProblem(&cell_factory, &conductivity_modifier, pMesh);
         AddActivationMap(problem, stim_times);
+        AddFibrillation(problem);
+        AddTelemetry(problem);
+        AddCompressedVoltage(problem);
+        if (QutemuTrace::IsEnabled())
+            problem->AddOutputModifier(boost::shared_ptr<TraceOutputModifier>(new TraceOutputModifier()));
 
         COUT("Solving");
-        problem->Solve();
+        Solve(problem, stim_times.empty() ? 0.0 : *std::max_element(stim_times.begin(), stim_times.end()));
+        if (mpFibrillation)
+            mpFibrillation->FlushWindow();
         Save(problem);
+        ReportQuiescent(cell_factory);
+        RecordCost(out_dir, problem);
 
         HeartEventHandler::Headings();
         HeartEventHandler::Report();
@@ -566,12 +1325,65 @@ public:
 
         WritePermutation(out_dir, problem);
 
+        double peak_memory = TelemetryOutputModifier::GetPeakMemory();
+        MPI_Allreduce(MPI_IN_PLACE, &peak_memory, 1, MPI_DOUBLE, MPI_MAX, PETSC_COMM_WORLD);
+        LOG("peak memory: " << std::setprecision(1) << std::fixed << peak_memory << "MB (largest process)");
         LOG("finished: " << std::setprecision(3) << std::fixed << (Timer::GetWallTime() - start_time) << "s");
+        if (QutemuTrace::IsEnabled()) {
+            QutemuTrace::Write(out_dir.FindFile("trace.json"));
+            LOG("trace: " << out_dir.GetOutputDirectoryFullPath() << "trace.json");
+        }
         WriteLog(out_dir);
 
         delete problem;
         COUT("Success");
     }
+
+    /**
+     * Runs every member of the -ensemble file in <outdir>/<name>, loading and partitioning the mesh once.
+     * Each line of the file is "<name> <options...>", and the options override the command line for that member
+     */
+    void RunEnsemble() throw(Exception)
+    {
+        CommandLineArguments* args = CommandLineArguments::Instance();
+        if (args->OptionExists("-loaddir"))
+            EXCEPTION("-loaddir can not be used with -ensemble");
+
+        std::string path = args->GetStringCorrespondingToOption("-ensemble");
+        std::vector<EnsembleMember> members = ReadEnsemble(path);
+        std::string outdir = args->OptionExists("-outdir") ? args->GetStringCorrespondingToOption("-outdir") : HeartConfig::Instance()->GetOutputDirectory();
+
+        double start_time = Timer::GetWallTime();
+        std::string meshfile = args->GetStringCorrespondingToOption("-meshfile");
+        COUT("Loading mesh " << meshfile);
+        boost::shared_ptr<DistributedTetrahedralMesh<DIM,DIM> > p_mesh = LoadMesh();
+        double mesh_time = Timer::GetWallTime() - start_time;
+
+        std::stringstream summary;
+        summary << "ensemble: " << path << std::endl;
+        summary << "mesh    : " << meshfile << " (" << std::setprecision(3) << std::fixed << mesh_time << "s)" << std::endl;
+        for (const EnsembleMember& r_member : members) {
+            COUT("** ENSEMBLE MEMBER " << r_member.mName << " **");
+            std::vector<std::string> member_args = {"-outdir", outdir + "/" + r_member.mName};
+            member_args.insert(member_args.end(), r_member.mArgs.begin(), r_member.mArgs.end());
+
+            double member_start = Timer::GetWallTime();
+            {
+                OptionOverride override(member_args);
+                QutemuLog::Clear();
+                HeartEventHandler::Reset();
+                LOG("ensemble: " << path << " (" << r_member.mName << ")");
+                RunSimulation(p_mesh.get());
+            }
+            summary << r_member.mName << ": " << (Timer::GetWallTime() - member_start) << "s" << std::endl;
+        }
+
+        summary << "finished: " << (Timer::GetWallTime() - start_time) << "s" << std::endl;
+        if (PetscTools::AmMaster()) {
+            out_stream os = OutputFileHandler(outdir, false).OpenOutputFile("ensemble.txt");
+            *os << summary.str();
+        }
+    }
 };
 
 void GetNextLineFromStream(std::ifstream& rFileStream, std::string& rRawLine)
@@ -596,6 +1408,12 @@ bool Is2dMesh()
     if (!CommandLineArguments::Instance()->OptionExists("-meshfile"))
         return false;
 
+    // the cache header is used when the text mesh isn't available, BinaryMeshCache::Update checks it later
+    BinaryMeshHeader header;
+    std::string cache = GetMeshCacheName();
+    if (!cache.empty() && BinaryMeshCache::GetSourceStamp(CommandLineArguments::Instance()->GetStringCorrespondingToOption("-meshfile")) == 0)
+        return BinaryMeshCache::ReadHeader(cache, header) && header.mDimension == 2;
+
     std::string nodeFileName = CommandLineArguments::Instance()->GetStringCorrespondingToOption("-meshfile") + ".node";
     ifstream nodeFile(FileFinder(nodeFileName, RelativeTo::AbsoluteOrCwd).GetAbsolutePath().c_str());
     if (!nodeFile.is_open())
@@ -626,7 +1444,13 @@ int main(int argc, char *argv[])
 
     try
     {
-        if (Is2dMesh())
+        if (CommandLineArguments::Instance()->OptionExists("-ensemble")) {
+            if (Is2dMesh())
+                AtrialFibrosis<2>().RunEnsemble();
+            else
+                AtrialFibrosis<3>().RunEnsemble();
+        }
+        else if (Is2dMesh())
             AtrialFibrosis<2>().RunSimulation();
         else
             AtrialFibrosis<3>().RunSimulation();
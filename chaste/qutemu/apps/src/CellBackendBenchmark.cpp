@@ -0,0 +1,328 @@
+/**
+ * @file
+ *
+ * Speed and accuracy of the cell backends selectable with AtrialFibrosis -solver, against CVODE.
+ * Paces a single cell, then stimulates one edge of a monodomain slab, with each backend. Reports the wall time,
+ * and the APD90 and upstroke time (single cell) or activation time (slab) errors against the cvode run.
+ * Results are written as JSON
+ *
+ * CellBackendBenchmark [-cell <model>] [-solvers cvode,rush_larsen,...] [-odet <step>] [-beats <n>]
+ *                      [-slab <width>] [-slab_duration <ms>] [-out <file>]
+ * Times are the maximum over processes
+ */
+
+#include "ExecutableSupport.hpp"
+#include "CommandLineArguments.hpp"
+#include "MonodomainProblem.hpp"
+#include "DistributedTetrahedralMesh.hpp"
+#include "AbstractOutputModifier.hpp"
+#include "CellProperties.hpp"
+#include "RegularStimulus.hpp"
+#include "SimpleStimulus.hpp"
+#include "Timer.hpp"
+
+#include "AtrialCellModels.hpp"
+#include "ActivationTracker.hpp"
+#include "QutemuVersion.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <boost/scoped_ptr.hpp>
+
+struct BackendResult
+{
+    std::string mTest;   ///< cell or slab
+    CellSolver mSolver;
+    double mSeconds;
+    double mApd;         ///< APD90 of the last beat, single cell only
+    double mApdError;
+    double mTimeError;   ///< Upstroke time of the last beat (cell) or maximum activation time (slab) difference
+    double mRmsError;    ///< RMS activation time difference, slab only
+    unsigned mMismatched; ///< Nodes activated in only one of the runs, slab only
+};
+
+/** Stimulates the nodes within mEdge of x = 0 */
+class EdgeStimulusCellFactory : public AbstractCardiacCellFactory<2>
+{
+private:
+    int mCellModel;
+    CellSolver mSolver;
+    double mEdge;
+    boost::shared_ptr<SimpleStimulus> mpStimulus;
+
+public:
+    EdgeStimulusCellFactory(int cellModel, CellSolver solver, double edge) :
+            AbstractCardiacCellFactory<2>(),
+            mCellModel(cellModel),
+            mSolver(solver),
+            mEdge(edge),
+            mpStimulus(new SimpleStimulus(-80000.0, 1.0))
+    {}
+
+    AbstractCardiacCellInterface* CreateCardiacCellForTissueNode(Node<2>* pNode)
+    {
+        boost::shared_ptr<AbstractStimulusFunction> stimulus = mpZeroStimulus;
+        if (pNode->rGetLocation()[0] < mEdge + 1e-6)
+            stimulus = mpStimulus;
+
+        return CreateAtrialCell(mCellModel, mSolver, false, mpSolver, stimulus);
+    }
+};
+
+/** Activation time of each node, gathered to every process at the end */
+class ActivationTimeModifier : public AbstractOutputModifier
+{
+private:
+    ActivationTracker mTracker;
+    unsigned mNumNodes;
+
+public:
+    ActivationTimeModifier() :
+            AbstractOutputModifier("activation"),
+            mTracker(-40, -80),
+            mNumNodes(0)
+    {}
+
+    void InitialiseAtStart(DistributedVectorFactory *pVectorFactory) override {
+        mNumNodes = pVectorFactory->GetProblemSize();
+        mTracker.Resize(pVectorFactory->GetLocalOwnership());
+    }
+
+    void FinaliseAtEnd() override {}
+
+    void ProcessSolutionAtTimeStep(double time, Vec solution, unsigned problemDim) override {
+        double* p_solution;
+        VecGetArray(solution, &p_solution);
+        mTracker.Update(time, p_solution, problemDim);
+        VecRestoreArray(solution, &p_solution);
+    }
+
+    void ProcessPdeSolutionAtTimeStep(double time, Vec solution, unsigned problemDim) override {
+        ProcessSolutionAtTimeStep(time, solution, problemDim);
+    }
+
+    /** First activation time of every node, NaN if it never activated. Collective */
+    std::vector<float> GatherActivation() {
+        const unsigned num_procs = PetscTools::GetNumProcs();
+        int local = mTracker.GetSize();
+        std::vector<int> counts(num_procs), offsets(num_procs, 0);
+        MPI_Allgather(&local, 1, MPI_INT, &counts[0], 1, MPI_INT, PETSC_COMM_WORLD);
+        for (unsigned p = 1; p < num_procs; p++)
+            offsets[p] = offsets[p-1] + counts[p-1];
+
+        std::vector<float> activation(mNumNodes);
+        MPI_Allgatherv(mTracker.mActivation.data(), local, MPI_FLOAT, &activation[0], &counts[0], &offsets[0], MPI_FLOAT, PETSC_COMM_WORLD);
+        return activation;
+    }
+};
+
+class CellBackendBenchmark
+{
+private:
+    int mCellModel;
+    std::string mCellName;
+    std::vector<CellSolver> mSolvers;
+    double mOdeTimeStep;
+    unsigned mBeats;
+    double mSlabWidth;
+    double mSlabDuration;
+    std::vector<BackendResult> mResults;
+
+    static double MaxOverProcesses(double value) {
+        MPI_Allreduce(MPI_IN_PLACE, &value, 1, MPI_DOUBLE, MPI_MAX, PETSC_COMM_WORLD);
+        return value;
+    }
+
+    void Print(const BackendResult& r, double referenceSeconds) {
+        if (!PetscTools::AmMaster())
+            return;
+
+        std::cout << std::left << std::setw(6) << r.mTest << std::setw(16) << GetCellSolverName(r.mSolver) << std::right
+                  << std::setprecision(4) << std::setw(10) << r.mSeconds << "s" << std::setw(8) << referenceSeconds / r.mSeconds << "x";
+        if (r.mTest == "cell")
+            std::cout << "  apd90 " << std::setw(8) << r.mApd << "ms  apd error " << std::setw(8) << r.mApdError
+                      << "ms  upstroke error " << std::setw(8) << r.mTimeError << "ms";
+        else
+            std::cout << "  activation error max " << std::setw(8) << r.mTimeError << "ms  rms " << std::setw(8) << r.mRmsError
+                      << "ms  mismatched " << r.mMismatched;
+        std::cout << std::endl;
+    }
+
+    /** Paces one cell for mBeats at 1Hz. Every process runs it, the time is the slowest */
+    void BenchmarkCell() {
+        const double period = 1000.0;
+        const double duration = mBeats * period;
+        double reference_apd = 0, reference_upstroke = 0, reference_seconds = 0;
+        for (CellSolver solver : mSolvers) {
+            boost::shared_ptr<RegularStimulus> p_stimulus(new RegularStimulus(-25.5, 2.0, period, 10.0));
+            boost::shared_ptr<AbstractIvpOdeSolver> p_no_solver;
+            boost::scoped_ptr<AbstractCardiacCellInterface> p_cell(CreateAtrialCell(mCellModel, solver, false, p_no_solver, p_stimulus));
+
+            double start = Timer::GetWallTime();
+            OdeSolution solution = p_cell->Compute(0.0, duration, 0.1);
+            double seconds = MaxOverProcesses(Timer::GetWallTime() - start);
+
+            std::vector<double> voltages = solution.GetVariableAtIndex(p_cell->GetVoltageIndex());
+            CellProperties properties(voltages, solution.rGetTimes(), -40.0);
+            double apd = properties.GetLastActionPotentialDuration(90.0);
+            double upstroke = properties.GetTimeAtLastMaxUpstrokeVelocity();
+            if (solver == CVODE) {
+                reference_apd = apd;
+                reference_upstroke = upstroke;
+                reference_seconds = seconds;
+            }
+
+            BackendResult r = {"cell", solver, seconds, apd, fabs(apd - reference_apd), fabs(upstroke - reference_upstroke), 0, 0};
+            mResults.push_back(r);
+            Print(r, reference_seconds);
+        }
+    }
+
+    /** Activation times of a planar wave across a square slab, stimulated along x = 0 */
+    void BenchmarkSlab() {
+        const double space_step = 0.02;
+        HeartConfig::Instance()->SetSimulationDuration(mSlabDuration);
+        HeartConfig::Instance()->SetOdePdeAndPrintingTimeSteps(mOdeTimeStep, mOdeTimeStep, mSlabDuration);
+        HeartConfig::Instance()->SetIntracellularConductivities(Create_c_vector(1.75, 1.75));
+        HeartConfig::Instance()->SetOutputFilenamePrefix("results");
+
+        std::vector<float> reference;
+        double reference_seconds = 0;
+        for (CellSolver solver : mSolvers) {
+            HeartConfig::Instance()->SetOutputDirectory("CellBackendBenchmark/" + GetCellSolverName(solver));
+            DistributedTetrahedralMesh<2,2> mesh;
+            mesh.ConstructRegularSlabMesh(space_step, mSlabWidth, mSlabWidth);
+
+            EdgeStimulusCellFactory cell_factory(mCellModel, solver, space_step);
+            MonodomainProblem<2> problem(&cell_factory);
+            problem.SetMesh(&mesh);
+            problem.SetOutputNodes(std::vector<unsigned>(1, 0));
+            boost::shared_ptr<ActivationTimeModifier> p_activation(new ActivationTimeModifier());
+            problem.AddOutputModifier(p_activation);
+            problem.Initialise();
+
+            double start = Timer::GetWallTime();
+            problem.Solve();
+            double seconds = MaxOverProcesses(Timer::GetWallTime() - start);
+
+            std::vector<float> activation = p_activation->GatherActivation();
+            if (solver == CVODE) {
+                reference = activation;
+                reference_seconds = seconds;
+            }
+
+            BackendResult r = {"slab", solver, seconds, 0, 0, 0, 0, 0};
+            double sum_squares = 0;
+            unsigned compared = 0;
+            for (unsigned i = 0; i < activation.size() && i < reference.size(); i++) {
+                if (std::isnan(activation[i]) != std::isnan(reference[i]))
+                    r.mMismatched++;
+                if (std::isnan(activation[i]) || std::isnan(reference[i]))
+                    continue;
+
+                double error = fabs(activation[i] - reference[i]);
+                r.mTimeError = std::max(r.mTimeError, error);
+                sum_squares += error * error;
+                compared++;
+            }
+            r.mRmsError = compared ? sqrt(sum_squares / compared) : 0;
+            mResults.push_back(r);
+            Print(r, reference_seconds);
+        }
+    }
+
+public:
+    CellBackendBenchmark(const std::string& rCellName, const std::vector<CellSolver>& rSolvers, double odeTimeStep,
+                         unsigned beats, double slabWidth, double slabDuration) :
+            mCellModel(ParseCellModel(rCellName)),
+            mCellName(rCellName),
+            mSolvers(rSolvers),
+            mOdeTimeStep(odeTimeStep),
+            mBeats(beats),
+            mSlabWidth(slabWidth),
+            mSlabDuration(slabDuration)
+    {
+        // errors are against the cvode run, so it goes first
+        mSolvers.erase(std::remove(mSolvers.begin(), mSolvers.end(), CVODE), mSolvers.end());
+        mSolvers.insert(mSolvers.begin(), CVODE);
+    }
+
+    void RunAll() {
+        HeartConfig::Instance()->SetOdeTimeStep(mOdeTimeStep);
+        for (CellSolver solver : mSolvers)
+            OverrideVoltageLookupRange(mCellModel, solver);
+
+        BenchmarkCell();
+        if (mSlabWidth > 0)
+            BenchmarkSlab();
+    }
+
+    void WriteJson(const std::string& rPath) {
+        if (!PetscTools::AmMaster())
+            return;
+
+        std::ofstream os(rPath.c_str());
+        os << "{\n";
+        os << "  \"build\": \"" << QutemuVersion::GetBuildTime() << "\",\n";
+        os << "  \"procs\": " << PetscTools::GetNumProcs() << ",\n";
+        os << "  \"cell\": \"" << mCellName << "\",\n";
+        os << "  \"odet\": " << mOdeTimeStep << ",\n";
+        os << "  \"results\": [\n";
+        for (unsigned i = 0; i < mResults.size(); i++) {
+            const BackendResult& r = mResults[i];
+            os << std::setprecision(6)
+               << "    {\"test\": \"" << r.mTest << "\", \"solver\": \"" << GetCellSolverName(r.mSolver) << "\", \"seconds\": " << r.mSeconds
+               << ", \"apd\": " << r.mApd << ", \"apd_error\": " << r.mApdError << ", \"time_error\": " << r.mTimeError
+               << ", \"rms_error\": " << r.mRmsError << ", \"mismatched\": " << r.mMismatched << "}"
+               << (i + 1 < mResults.size() ? "," : "") << "\n";
+        }
+        os << "  ]\n}\n";
+        std::cout << "results: " << rPath << std::endl;
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    ExecutableSupport::InitializePetsc(&argc, &argv);
+    ExecutableSupport::ShowParallelLaunching();
+
+    int exit_code = ExecutableSupport::EXIT_OK;
+
+    try
+    {
+        CommandLineArguments* args = CommandLineArguments::Instance();
+        std::string cell = args->OptionExists("-cell") ? args->GetStringCorrespondingToOption("-cell") : "courtemanche_sr";
+        std::string out = args->OptionExists("-out") ? args->GetStringCorrespondingToOption("-out") : "backends.json";
+        double odet = args->OptionExists("-odet") ? args->GetDoubleCorrespondingToOption("-odet") : 0.02;
+        unsigned beats = args->OptionExists("-beats") ? args->GetUnsignedCorrespondingToOption("-beats") : 3;
+        double slab = args->OptionExists("-slab") ? args->GetDoubleCorrespondingToOption("-slab") : 1.0;
+        double slab_duration = args->OptionExists("-slab_duration") ? args->GetDoubleCorrespondingToOption("-slab_duration") : 50.0;
+
+        std::vector<CellSolver> solvers = {CVODE, RUSH_LARSEN, GRL1};
+#ifdef QUTEMU_BACKWARD_EULER
+        solvers.push_back(BACKWARD_EULER);
+#endif
+        if (args->OptionExists("-solvers")) {
+            solvers.clear();
+            std::stringstream ss(args->GetStringCorrespondingToOption("-solvers"));
+            std::string name;
+            while (std::getline(ss, name, ','))
+                solvers.push_back(ParseCellSolver(name));
+        }
+
+        CellBackendBenchmark benchmark(cell, solvers, odet, beats, slab, slab_duration);
+        benchmark.RunAll();
+        benchmark.WriteJson(out);
+    }
+    catch (const Exception& e)
+    {
+        ExecutableSupport::PrintError(e.GetMessage());
+        exit_code = ExecutableSupport::EXIT_ERROR;
+    }
+
+    ExecutableSupport::FinalizePetsc();
+    return exit_code;
+}
@@ -0,0 +1,355 @@
+/**
+ * @file
+ *
+ * Micro-benchmarks of the qutemu hot paths on synthetic data, each over a range of problem sizes.
+ * The activation tracker is also timed against the kernel it replaced, and checked against it.
+ * Results are written as JSON, compare two runs with pyscripts/compare_benchmarks.py
+ *
+ * QutemuBenchmark [-out <file>] [-repeats <n>] [-only <benchmark>]
+ * Times are the best of the repeats, and the maximum over processes
+ */
+
+#include "ExecutableSupport.hpp"
+#include "CommandLineArguments.hpp"
+#include "OutputFileHandler.hpp"
+#include "TetrahedralMesh.hpp"
+#include "Timer.hpp"
+
+#include "QutemuVersion.hpp"
+#include "TimedStimulus.hpp"
+#include "ActivationTracker.hpp"
+#include "ConductivityReader.hpp"
+#include "AtrialConductivityModifier.hpp"
+
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <hdf5.h>
+#include <iomanip>
+#include <limits>
+
+struct BenchmarkResult
+{
+    std::string mName;
+    unsigned mSize; ///< Problem size, meaning depends on the benchmark
+    double mOps;    ///< Operations timed per repeat
+    double mSeconds;
+};
+
+/** The scalar, branchy kernel from the original ActivationMapOutputModifier::ProcessSolutionAtTimeStep */
+class LegacyTracker
+{
+public:
+    double mThresholdVoltage;
+    double mRestingVoltage;
+    std::vector<bool> mActivationState;
+    std::vector<float> mCurrentPeak;
+    std::vector<float> mActivationTime;
+    std::vector<float> mPeakVoltage;
+    std::vector<float> mActionPotentialDuration;
+
+    LegacyTracker(double threshold, double resting, unsigned n) :
+            mThresholdVoltage(threshold),
+            mRestingVoltage(resting),
+            mActivationState(n, false),
+            mCurrentPeak(n, threshold),
+            mActivationTime(n, std::numeric_limits<float>::quiet_NaN()),
+            mPeakVoltage(n, std::numeric_limits<float>::quiet_NaN()),
+            mActionPotentialDuration(n, std::numeric_limits<float>::quiet_NaN())
+    {}
+
+    bool Update(double time, const double* p_solution, unsigned problemDim) {
+        bool any_activated = false;
+        for (unsigned local_index=0; local_index < mActivationState.size(); local_index++)
+        {
+            double v = p_solution[local_index*problemDim];
+            float& activation_time = mActivationTime[local_index];
+            float& peak = mCurrentPeak[local_index];
+
+            if (!mActivationState[local_index] && v > mThresholdVoltage) {//activation
+                mActivationState[local_index] = true;
+                activation_time = (float)time;
+                peak = (float)v; //reset peak voltage
+                any_activated = true;
+            }
+            if (mActivationState[local_index]) {
+                //update peak
+                if (v > peak)
+                    peak = (float)v;
+
+                // APD90, deactivation
+                if (v < peak - (peak - mRestingVoltage) * 0.9) {
+                    mActivationState[local_index] = false;
+                    mPeakVoltage[local_index] = peak;
+                    mActionPotentialDuration[local_index] = (float)(time - activation_time);
+                }
+            }
+        }
+        return any_activated;
+    }
+};
+
+class QutemuBenchmark
+{
+private:
+    std::vector<BenchmarkResult> mResults;
+    unsigned mRepeats;
+    std::string mOnly;
+
+    bool Enabled(const std::string& rName) {
+        return mOnly.empty() || mOnly == rName;
+    }
+
+    /** rRun returns the seconds spent on the timed part of one repeat */
+    void Run(const std::string& rName, unsigned size, double ops, std::function<double()> run) {
+        double best = std::numeric_limits<double>::infinity();
+        for (unsigned r = 0; r < mRepeats; r++) {
+            PetscTools::Barrier();
+            double seconds = run();
+            MPI_Allreduce(MPI_IN_PLACE, &seconds, 1, MPI_DOUBLE, MPI_MAX, PETSC_COMM_WORLD);
+            best = std::min(best, seconds);
+        }
+
+        mResults.push_back({rName, size, ops, best});
+        if (PetscTools::AmMaster())
+            std::cout << std::left << std::setw(20) << rName << std::right << std::setw(10) << size << " "
+                      << std::setw(12) << std::setprecision(4) << best / ops * 1e9 << "ns/op" << std::endl;
+    }
+
+    /** Wall time of fn() */
+    static double Time(std::function<void()> fn) {
+        double start = Timer::GetWallTime();
+        fn();
+        return Timer::GetWallTime() - start;
+    }
+
+    /** GetStimulus at every 0.02ms step over a schedule of size times, then again from the start */
+    void BenchmarkStimulus() {
+        const unsigned sizes[] = {10, 1000, 100000};
+        for (unsigned size : sizes) {
+            std::vector<double> times(size);
+            for (unsigned i = 0; i < size; i++)
+                times[i] = 10.0 + 300.0 * i;
+
+            const unsigned steps = 1000000;
+            const double dt = times.back() / steps;
+            volatile double sink = 0;
+            Run("stimulus", size, 2.0 * steps, [&]() {
+                TimedStimulus stimulus(-1.0, 2.0, times);
+                return Time([&]() {
+                    for (unsigned pass = 0; pass < 2; pass++)
+                        for (unsigned s = 1; s <= steps; s++)
+                            sink = sink + stimulus.GetStimulus(s * dt);
+                });
+            });
+        }
+    }
+
+    /** Writes the voltage at time of a wavefront of action potentials crossing the nodes */
+    static void TrackerVoltage(double time, std::vector<double>& rVoltage) {
+        const unsigned size = rVoltage.size();
+        for (unsigned i = 0; i < size; i++) {
+            double t = std::fmod(time + 300.0 - 200.0 * i / size, 300.0);
+            rVoltage[i] = t < 2.0 ? -80.0 + 55.0 * t : t < 200.0 ? 30.0 - 110.0 * t / 200.0 : -80.0;
+        }
+    }
+
+    /** Seconds spent in rTracker.Update over steps 0.2ms steps of TrackerVoltage */
+    template<class TRACKER>
+    static double TimeTracker(TRACKER& rTracker, std::vector<double>& rVoltage, unsigned steps) {
+        double seconds = 0;
+        for (unsigned s = 0; s < steps; s++) {
+            double time = (s + 1) * 0.2;
+            TrackerVoltage(time, rVoltage);
+            seconds += Time([&]() { rTracker.Update(time, &rVoltage[0], 1); });
+        }
+        return seconds;
+    }
+
+    static bool SameFloats(const std::vector<float>& a, const std::vector<float>& b) {
+        for (unsigned i = 0; i < a.size(); i++)
+            if (a[i] != b[i] && !(std::isnan(a[i]) && std::isnan(b[i])))
+                return false;
+        return true;
+    }
+
+    /**
+     * One ActivationTracker::Update per step, and the scalar kernel it replaced in ActivationMapOutputModifier
+     * (tracker_legacy) for comparison, which must give identical outputs
+     */
+    void BenchmarkTracker() {
+        const unsigned sizes[] = {10000, 100000, 1000000};
+        const unsigned steps = 1000;
+        for (unsigned size : sizes) {
+            std::vector<double> voltage(size);
+            LegacyTracker legacy(-40, -80, 0);
+            ActivationTracker tracker(-40, -80);
+            Run("tracker_legacy", size, (double)size * steps, [&]() {
+                legacy = LegacyTracker(-40, -80, size);
+                return TimeTracker(legacy, voltage, steps);
+            });
+            Run("tracker", size, (double)size * steps, [&]() {
+                tracker = ActivationTracker(-40, -80);
+                tracker.Resize(size);
+                return TimeTracker(tracker, voltage, steps);
+            });
+
+            bool match = SameFloats(legacy.mCurrentPeak, tracker.mCurrentPeak) &&
+                         SameFloats(legacy.mActivationTime, tracker.mActivation) &&
+                         SameFloats(legacy.mPeakVoltage, tracker.mPeak) &&
+                         SameFloats(legacy.mActionPotentialDuration, tracker.mApd);
+            for (unsigned i = 0; i < size; i++)
+                match &= legacy.mActivationState[i] == (tracker.mActive[i] != 0);
+            if (!match)
+                EXCEPTION("ActivationTracker does not match the legacy kernel for " << size << " nodes");
+        }
+    }
+
+    void WriteConductivityFile(const std::string& rPath, unsigned size) {
+        if (PetscTools::AmMaster()) {
+            std::vector<float> data(size);
+            for (unsigned i = 0; i < size; i++)
+                data[i] = 1.0f - (i % 100) / 200.0f;
+
+            hid_t file_id = H5Fcreate(rPath.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+            hsize_t dims[1] = {size};
+            hid_t dspace = H5Screate_simple(1, dims, nullptr);
+            hid_t dataset_id = H5Dcreate(file_id, "Conductivity", H5T_NATIVE_FLOAT, dspace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+            H5Dwrite(dataset_id, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, &data[0]);
+            H5Dclose(dataset_id);
+            H5Sclose(dspace);
+            H5Fclose(file_id);
+        }
+        PetscTools::Barrier();
+    }
+
+    /**
+     * Collective reads of each process's share of a synthetic multiplier file.
+     * Dense reads a contiguous block per process, sparse every nth element
+     */
+    void BenchmarkReader() {
+        OutputFileHandler handler("QutemuBenchmark", false);
+        const unsigned sizes[] = {100000, 1000000, 10000000};
+        const unsigned num_procs = PetscTools::GetNumProcs();
+        const unsigned rank = PetscTools::GetMyRank();
+        for (unsigned size : sizes) {
+            FileFinder file = handler.FindFile("conductivity.h5");
+            WriteConductivityFile(file.GetAbsolutePath(), size);
+
+            std::vector<unsigned> dense, sparse;
+            for (unsigned i = size * rank / num_procs; i < size * (rank + 1) / num_procs; i++)
+                dense.push_back(i);
+            for (unsigned i = rank; i < size; i += 3 * num_procs)
+                sparse.push_back(i);
+
+            Run("reader_dense", size, size, [&]() {
+                return Time([&]() { ConductivityReader::ReadConductivities(file, dense); });
+            });
+            Run("reader_sparse", size, size / 3, [&]() {
+                return Time([&]() { ConductivityReader::ReadConductivities(file, sparse); });
+            });
+        }
+
+        if (PetscTools::AmMaster())
+            handler.FindFile("conductivity.h5").Remove();
+    }
+
+    /** Tensor cache construction, and one tensor evaluation per element (as in assembly) on a cube slab */
+    void BenchmarkModifier() {
+        const unsigned sizes[] = {10, 20, 40};
+        TissueConductivityTable table;
+        const unsigned classes[] = {32, 72, 74, 80, 104};
+        for (unsigned size : sizes) {
+            TetrahedralMesh<3,3> mesh;
+            mesh.ConstructRegularSlabMesh(1.0, size, size, size);
+            for (unsigned e = 0; e < mesh.GetNumElements(); e++)
+                mesh.GetElement(e)->SetAttribute(classes[e % 5]);
+
+            const unsigned num_elements = mesh.GetNumElements();
+            AtrialConductivityModifier<3> modifier;
+            modifier.SetMesh(&mesh);
+            modifier.rGetConductivities().assign(num_elements, 0.5f);
+
+            Run("modifier_cache", num_elements, num_elements, [&]() {
+                return Time([&]() { modifier.BuildTensorCache(table); });
+            });
+
+            c_matrix<double,3,3> original = identity_matrix<double>(3);
+            volatile double sink = 0;
+            const unsigned passes = 20;
+            Run("modifier_tensor", num_elements, (double)num_elements * passes, [&]() {
+                return Time([&]() {
+                    for (unsigned pass = 0; pass < passes; pass++)
+                        for (unsigned e = 0; e < num_elements; e++)
+                            sink = sink + modifier.rCalculateModifiedConductivityTensor(e, original, 0)(0,0);
+                });
+            });
+        }
+    }
+
+public:
+    QutemuBenchmark(unsigned repeats, const std::string& rOnly) :
+            mRepeats(repeats),
+            mOnly(rOnly)
+    {}
+
+    void RunAll() {
+        if (Enabled("stimulus"))
+            BenchmarkStimulus();
+        if (Enabled("tracker"))
+            BenchmarkTracker();
+        if (Enabled("reader"))
+            BenchmarkReader();
+        if (Enabled("modifier"))
+            BenchmarkModifier();
+    }
+
+    void WriteJson(const std::string& rPath) {
+        if (!PetscTools::AmMaster())
+            return;
+
+        std::ofstream os(rPath.c_str());
+        os << "{\n";
+        os << "  \"build\": \"" << QutemuVersion::GetBuildTime() << "\",\n";
+        os << "  \"procs\": " << PetscTools::GetNumProcs() << ",\n";
+        os << "  \"repeats\": " << mRepeats << ",\n";
+        os << "  \"results\": [\n";
+        for (unsigned i = 0; i < mResults.size(); i++) {
+            const BenchmarkResult& r = mResults[i];
+            os << std::setprecision(6)
+               << "    {\"name\": \"" << r.mName << "\", \"size\": " << r.mSize << ", \"ops\": " << r.mOps
+               << ", \"seconds\": " << r.mSeconds << ", \"ns_per_op\": " << r.mSeconds / r.mOps * 1e9 << "}"
+               << (i + 1 < mResults.size() ? "," : "") << "\n";
+        }
+        os << "  ]\n}\n";
+        std::cout << "results: " << rPath << std::endl;
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    ExecutableSupport::InitializePetsc(&argc, &argv);
+    ExecutableSupport::ShowParallelLaunching();
+
+    int exit_code = ExecutableSupport::EXIT_OK;
+
+    try
+    {
+        CommandLineArguments* args = CommandLineArguments::Instance();
+        std::string out = args->OptionExists("-out") ? args->GetStringCorrespondingToOption("-out") : "benchmark.json";
+        unsigned repeats = args->OptionExists("-repeats") ? args->GetUnsignedCorrespondingToOption("-repeats") : 3;
+        std::string only = args->OptionExists("-only") ? args->GetStringCorrespondingToOption("-only") : "";
+
+        QutemuBenchmark benchmark(repeats, only);
+        benchmark.RunAll();
+        benchmark.WriteJson(out);
+    }
+    catch (const Exception& e)
+    {
+        ExecutableSupport::PrintError(e.GetMessage());
+        exit_code = ExecutableSupport::EXIT_ERROR;
+    }
+
+    ExecutableSupport::FinalizePetsc();
+    return exit_code;
+}
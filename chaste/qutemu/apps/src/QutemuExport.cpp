@@ -0,0 +1,526 @@
+/**
+ * @file
+ *
+ * Exports AtrialFibrosis HDF5 output for ParaView without copying it, replacing pyscripts/add_hdf5.py.
+ * Writes mesh.h5 with the geometry and topology in each node order used by the data, and an .xdmf per HDF5 file
+ * with one attribute per dataset row, referencing that row in place. Array names follow add_hdf5.py
+ * ("V @ 05ms", "/Activation_03"), so the ParaView macros work on either output.
+ *
+ * QutemuExport -meshfile <mesh> -dir <outdir> [-files <h5list>] [-vtu]
+ * -dir is the AtrialFibrosis -outdir (relative to CHASTE_TEST_OUTPUT), which the exports are written to.
+ * -files is a comma separated list, by default snapshots.h5, snapshots_dyn.h5 and results.h5 when present.
+ * -vtu additionally streams one .vtu per dataset row to <outdir>/vtu with a .pvd per HDF5 file. Rows are split
+ * between processes and only one row is held in memory at a time
+ */
+
+#include "ExecutableSupport.hpp"
+#include "CommandLineArguments.hpp"
+#include "OutputFileHandler.hpp"
+#include "PetscTools.hpp"
+#include "TrianglesMeshReader.hpp"
+
+#include "BinaryMeshCache.hpp"
+#include "BinaryMeshReader.hpp"
+#include "NodePartition.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <hdf5.h>
+#include <iomanip>
+#include <limits>
+#include <regex>
+#include <sstream>
+
+/** The mesh in .node file order, replicated on every process */
+struct ExportMesh
+{
+    unsigned mDimension;
+    unsigned mNumNodes;
+    unsigned mNumElements;
+    std::vector<double> mPoints;     ///< Three coordinates per node, 2D meshes have z = 0
+    std::vector<unsigned> mElements; ///< mDimension+1 nodes per element
+};
+
+/** A node or element dataset of an HDF5 file, exported as one array per row */
+struct ExportDataset
+{
+    std::string mName;
+    std::vector<hsize_t> mDims;
+    bool mCellData;
+    std::string mNumberType; ///< XDMF NumberType and Precision of the stored values
+    unsigned mPrecision;
+    std::function<std::string(unsigned)> mNamer;
+};
+
+template<unsigned DIM>
+static void ReadMesh(AbstractMeshReader<DIM,DIM>& rReader, ExportMesh& rMesh)
+{
+    rMesh.mDimension = DIM;
+    rMesh.mNumNodes = rReader.GetNumNodes();
+    rMesh.mNumElements = rReader.GetNumElements();
+    rMesh.mPoints.assign(3 * rMesh.mNumNodes, 0.0);
+    for (unsigned i = 0; i < rMesh.mNumNodes; i++) {
+        std::vector<double> node = rReader.GetNextNode();
+        std::copy(node.begin(), node.begin() + DIM, rMesh.mPoints.begin() + 3 * i);
+    }
+
+    rMesh.mElements.reserve(rMesh.mNumElements * (DIM + 1));
+    for (unsigned i = 0; i < rMesh.mNumElements; i++) {
+        ElementData data = rReader.GetNextElementData();
+        if (data.NodeIndices.size() != DIM + 1)
+            EXCEPTION("Only linear meshes can be exported");
+        rMesh.mElements.insert(rMesh.mElements.end(), data.NodeIndices.begin(), data.NodeIndices.end());
+    }
+}
+
+/** Fixed point formatting, as python's "%.nf" */
+static std::string FormatFixed(double value, unsigned decimals)
+{
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(decimals) << value;
+    return ss.str();
+}
+
+/** As python's str.zfill */
+static std::string ZeroFill(const std::string& rString, unsigned width)
+{
+    return rString.size() >= width ? rString : std::string(width - rString.size(), '0') + rString;
+}
+
+/** Array names for each row of a dataset, the same as get_namer in add_hdf5.py. interval is NaN if unknown */
+static std::function<std::string(unsigned)> GetNamer(std::string datasetName, unsigned count, double interval)
+{
+    if (datasetName == "/Data") {
+        datasetName = "V";
+        if (count > 1 && !std::isnan(interval)) {
+            // the fewest decimals (from 2) which still show the interval
+            unsigned decimals = 2;
+            while (decimals > 0 && FormatFixed(interval, decimals).back() == '0')
+                decimals--;
+
+            unsigned width = FormatFixed(interval * (count - 1), decimals).size();
+            return [=](unsigned i) { return "V @ " + ZeroFill(FormatFixed(i * interval, decimals), width) + "ms"; };
+        }
+    }
+
+    if (count == 1)
+        return [=](unsigned) { return datasetName; };
+
+    unsigned width = (unsigned)std::floor(std::log10(count)) + 1;
+    return [=](unsigned i) { return datasetName + "_" + ZeroFill(std::to_string(i), width); };
+}
+
+static herr_t CollectDatasetName(hid_t groupId, const char* pName, const H5L_info_t*, void* pNames)
+{
+    H5O_info_t info;
+    if (H5Oget_info_by_name(groupId, pName, &info, H5P_DEFAULT) >= 0 && info.type == H5O_TYPE_DATASET)
+        static_cast<std::vector<std::string>*>(pNames)->push_back(std::string("/") + pName);
+    return 0;
+}
+
+class QutemuExport
+{
+private:
+    std::string mDir; ///< Absolute, with a trailing slash
+    ExportMesh mMesh;
+    std::vector<unsigned> mPermutation; ///< Mesh index of each .node file node, empty if unpermuted
+    double mInterval;
+
+    /** Output interval from the simulation log, as add_hdf5.py reads it */
+    double ReadInterval() {
+        std::ifstream log_file(mDir + "log.txt");
+        std::stringstream ss;
+        ss << log_file.rdbuf();
+        std::smatch match;
+        std::string log = ss.str();
+        if (std::regex_search(log, match, std::regex("interval: (\\d+)ms")))
+            return std::stod(match[1]);
+
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+
+    /** Group in mesh.h5 for data in mesh (Chaste) order or .node file order */
+    std::string GetMeshGroup(bool originalOrder) {
+        return originalOrder || mPermutation.empty() ? "/Original" : "/Mesh";
+    }
+
+    /** Points and elements in mesh order, moving file node i to perm[i] */
+    void GetPermuted(std::vector<double>& rPoints, std::vector<unsigned>& rElements) {
+        rPoints.resize(mMesh.mPoints.size());
+        for (unsigned i = 0; i < mMesh.mNumNodes; i++)
+            std::copy(&mMesh.mPoints[3 * i], &mMesh.mPoints[3 * i] + 3, &rPoints[3 * mPermutation[i]]);
+
+        rElements = mMesh.mElements;
+        for (unsigned& r_index : rElements)
+            r_index = mPermutation[r_index];
+    }
+
+    static void WriteArray(hid_t fileId, const std::string& rName, hid_t type, unsigned rows, unsigned cols, const void* pData) {
+        hsize_t dims[2] = {rows, cols};
+        hid_t dspace = H5Screate_simple(2, dims, nullptr);
+        hid_t dataset_id = H5Dcreate(fileId, rName.c_str(), type, dspace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        H5Dwrite(dataset_id, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, pData);
+        H5Dclose(dataset_id);
+        H5Sclose(dspace);
+    }
+
+    void WriteMeshGroup(hid_t fileId, const std::string& rGroup, const std::vector<double>& rPoints, const std::vector<unsigned>& rElements) {
+        hid_t group_id = H5Gcreate(fileId, rGroup.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        H5Gclose(group_id);
+
+        // XDMF wants XY geometry for 2D
+        std::vector<double> geometry;
+        for (unsigned i = 0; i < mMesh.mNumNodes; i++)
+            geometry.insert(geometry.end(), &rPoints[3 * i], &rPoints[3 * i] + mMesh.mDimension);
+
+        WriteArray(fileId, rGroup + "/Geometry", H5T_NATIVE_DOUBLE, mMesh.mNumNodes, mMesh.mDimension, &geometry[0]);
+        WriteArray(fileId, rGroup + "/Topology", H5T_NATIVE_UINT, mMesh.mNumElements, mMesh.mDimension + 1, &rElements[0]);
+    }
+
+    void WriteMeshFile() {
+        if (!PetscTools::AmMaster())
+            return;
+
+        std::string path = mDir + "mesh.h5";
+        hid_t file_id = H5Fcreate(path.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+        if (file_id <= 0)
+            EXCEPTION("Could not create " << path << " , H5Fcreate error code = " << file_id);
+
+        WriteMeshGroup(file_id, "/Original", mMesh.mPoints, mMesh.mElements);
+        if (!mPermutation.empty()) {
+            std::vector<double> points;
+            std::vector<unsigned> elements;
+            GetPermuted(points, elements);
+            WriteMeshGroup(file_id, "/Mesh", points, elements);
+        }
+
+        H5Fclose(file_id);
+        std::cout << "mesh: " << path << std::endl;
+    }
+
+    /** Node and element datasets of an HDF5 file, and whether it is in .node file order */
+    std::vector<ExportDataset> ReadDatasets(hid_t fileId, bool& rOriginalOrder) {
+        rOriginalOrder = false;
+        if (H5Aexists(fileId, "OriginalOrder") > 0) {
+            double value = 0;
+            hid_t attr_id = H5Aopen(fileId, "OriginalOrder", H5P_DEFAULT);
+            H5Aread(attr_id, H5T_NATIVE_DOUBLE, &value);
+            H5Aclose(attr_id);
+            rOriginalOrder = value != 0.0;
+        }
+
+        std::vector<std::string> names;
+        H5Literate(fileId, H5_INDEX_NAME, H5_ITER_INC, nullptr, CollectDatasetName, &names);
+
+        std::vector<ExportDataset> datasets;
+        for (const std::string& r_name : names) {
+            hid_t dataset_id = H5Dopen(fileId, r_name.c_str(), H5P_DEFAULT);
+            hid_t dspace = H5Dget_space(dataset_id);
+            ExportDataset dataset;
+            dataset.mName = r_name;
+            dataset.mDims.resize(H5Sget_simple_extent_ndims(dspace));
+            H5Sget_simple_extent_dims(dspace, &dataset.mDims[0], nullptr);
+            H5Sclose(dspace);
+            hid_t type = H5Dget_type(dataset_id);
+            H5T_class_t type_class = H5Tget_class(type);
+            dataset.mPrecision = H5Tget_size(type);
+            if (type_class == H5T_INTEGER) {
+                bool is_signed = H5Tget_sign(type) == H5T_SGN_2;
+                dataset.mNumberType = dataset.mPrecision == 1 ? (is_signed ? "Char" : "UChar") : (is_signed ? "Int" : "UInt");
+            }
+            else if (type_class == H5T_FLOAT)
+                dataset.mNumberType = "Float";
+            H5Tclose(type);
+            H5Dclose(dataset_id);
+
+            if (dataset.mNumberType.empty()) {
+                if (PetscTools::AmMaster())
+                    std::cout << r_name << " is not numeric, skipped" << std::endl;
+                continue;
+            }
+
+            hsize_t row_size = 1;
+            for (unsigned d = 1; d < dataset.mDims.size(); d++)
+                row_size *= dataset.mDims[d];
+
+            if (dataset.mDims.size() >= 2 && row_size == mMesh.mNumNodes)
+                dataset.mCellData = false;
+            else if (dataset.mDims.size() >= 2 && row_size == mMesh.mNumElements)
+                dataset.mCellData = true;
+            else {
+                if (PetscTools::AmMaster())
+                    std::cout << r_name << " has wrong shape, skipped" << std::endl;
+                continue;
+            }
+
+            dataset.mNamer = GetNamer(r_name, dataset.mDims[0], mInterval);
+            datasets.push_back(dataset);
+        }
+
+        return datasets;
+    }
+
+    static std::string JoinDims(const std::vector<hsize_t>& rDims) {
+        std::stringstream ss;
+        for (unsigned d = 0; d < rDims.size(); d++)
+            ss << (d ? " " : "") << rDims[d];
+        return ss.str();
+    }
+
+    void WriteXdmf(const std::string& rStem, const std::string& rFileName, const std::vector<ExportDataset>& rDatasets, bool originalOrder) {
+        std::string group = GetMeshGroup(originalOrder);
+        std::ofstream os((mDir + rStem + ".xdmf").c_str());
+        os << "<?xml version=\"1.0\" ?>\n";
+        os << "<Xdmf Version=\"2.0\">\n";
+        os << " <Domain>\n";
+        os << "  <Grid Name=\"" << rStem << "\" GridType=\"Uniform\">\n";
+        os << "   <Topology TopologyType=\"" << (mMesh.mDimension == 2 ? "Triangle" : "Tetrahedron")
+           << "\" NumberOfElements=\"" << mMesh.mNumElements << "\">\n";
+        os << "    <DataItem Dimensions=\"" << mMesh.mNumElements << " " << mMesh.mDimension + 1
+           << "\" NumberType=\"UInt\" Precision=\"4\" Format=\"HDF\">mesh.h5:" << group << "/Topology</DataItem>\n";
+        os << "   </Topology>\n";
+        os << "   <Geometry GeometryType=\"" << (mMesh.mDimension == 2 ? "XY" : "XYZ") << "\">\n";
+        os << "    <DataItem Dimensions=\"" << mMesh.mNumNodes << " " << mMesh.mDimension
+           << "\" NumberType=\"Float\" Precision=\"8\" Format=\"HDF\">mesh.h5:" << group << "/Geometry</DataItem>\n";
+        os << "   </Geometry>\n";
+
+        for (const ExportDataset& r_dataset : rDatasets) {
+            // one row of the dataset, selected in place
+            std::vector<hsize_t> count = r_dataset.mDims;
+            count[0] = 1;
+            std::vector<hsize_t> ones(count.size(), 1);
+            for (unsigned i = 0; i < r_dataset.mDims[0]; i++) {
+                std::vector<hsize_t> start(count.size(), 0);
+                start[0] = i;
+                os << "   <Attribute Name=\"" << r_dataset.mNamer(i) << "\" AttributeType=\"Scalar\" Center=\""
+                   << (r_dataset.mCellData ? "Cell" : "Node") << "\">\n";
+                os << "    <DataItem ItemType=\"HyperSlab\" Dimensions=\"" << JoinDims(count) << "\">\n";
+                os << "     <DataItem Dimensions=\"3 " << count.size() << "\" Format=\"XML\">"
+                   << JoinDims(start) << " " << JoinDims(ones) << " " << JoinDims(count) << "</DataItem>\n";
+                os << "     <DataItem Dimensions=\"" << JoinDims(r_dataset.mDims)
+                   << "\" NumberType=\"" << r_dataset.mNumberType << "\" Precision=\"" << r_dataset.mPrecision
+                   << "\" Format=\"HDF\">" << rFileName << ":" << r_dataset.mName << "</DataItem>\n";
+                os << "    </DataItem>\n";
+                os << "   </Attribute>\n";
+            }
+        }
+
+        os << "  </Grid>\n";
+        os << " </Domain>\n";
+        os << "</Xdmf>\n";
+        std::cout << "xdmf: " << mDir << rStem << ".xdmf" << std::endl;
+    }
+
+    /** Appends a raw VTK binary block (64 bit size then data) and returns its offset */
+    static uint64_t AppendBlock(std::string& rAppended, const void* pData, uint64_t size) {
+        uint64_t offset = rAppended.size();
+        rAppended.append((const char*)&size, sizeof(size));
+        rAppended.append((const char*)pData, size);
+        return offset;
+    }
+
+    void WriteVtu(const std::string& rPath, const std::vector<double>& rPoints, const std::vector<int32_t>& rConnectivity,
+                  const std::string& rArrayName, bool cellData, const std::vector<float>& rRow) {
+        const unsigned nodes_per_element = mMesh.mDimension + 1;
+        std::vector<int32_t> offsets(mMesh.mNumElements);
+        for (unsigned e = 0; e < mMesh.mNumElements; e++)
+            offsets[e] = (e + 1) * nodes_per_element;
+        std::vector<uint8_t> types(mMesh.mNumElements, mMesh.mDimension == 2 ? 5 : 10); // VTK_TRIANGLE, VTK_TETRA
+
+        std::string appended;
+        uint64_t points_offset = AppendBlock(appended, &rPoints[0], rPoints.size() * sizeof(double));
+        uint64_t connectivity_offset = AppendBlock(appended, &rConnectivity[0], rConnectivity.size() * sizeof(int32_t));
+        uint64_t offsets_offset = AppendBlock(appended, &offsets[0], offsets.size() * sizeof(int32_t));
+        uint64_t types_offset = AppendBlock(appended, &types[0], types.size());
+        uint64_t data_offset = AppendBlock(appended, &rRow[0], rRow.size() * sizeof(float));
+
+        std::ofstream os(rPath.c_str(), std::ios::binary);
+        os << "<?xml version=\"1.0\"?>\n";
+        os << "<VTKFile type=\"UnstructuredGrid\" version=\"1.0\" byte_order=\"LittleEndian\" header_type=\"UInt64\">\n";
+        os << " <UnstructuredGrid>\n";
+        os << "  <Piece NumberOfPoints=\"" << mMesh.mNumNodes << "\" NumberOfCells=\"" << mMesh.mNumElements << "\">\n";
+        os << "   <" << (cellData ? "CellData" : "PointData") << " Scalars=\"" << rArrayName << "\">\n";
+        os << "    <DataArray type=\"Float32\" Name=\"" << rArrayName << "\" format=\"appended\" offset=\"" << data_offset << "\"/>\n";
+        os << "   </" << (cellData ? "CellData" : "PointData") << ">\n";
+        os << "   <Points>\n";
+        os << "    <DataArray type=\"Float64\" NumberOfComponents=\"3\" format=\"appended\" offset=\"" << points_offset << "\"/>\n";
+        os << "   </Points>\n";
+        os << "   <Cells>\n";
+        os << "    <DataArray type=\"Int32\" Name=\"connectivity\" format=\"appended\" offset=\"" << connectivity_offset << "\"/>\n";
+        os << "    <DataArray type=\"Int32\" Name=\"offsets\" format=\"appended\" offset=\"" << offsets_offset << "\"/>\n";
+        os << "    <DataArray type=\"UInt8\" Name=\"types\" format=\"appended\" offset=\"" << types_offset << "\"/>\n";
+        os << "   </Cells>\n";
+        os << "  </Piece>\n";
+        os << " </UnstructuredGrid>\n";
+        os << " <AppendedData encoding=\"raw\">\n_";
+        os.write(appended.data(), appended.size());
+        os << "\n </AppendedData>\n";
+        os << "</VTKFile>\n";
+    }
+
+    /** One .vtu per dataset row, rows split between processes, and a .pvd indexing them by row */
+    void WriteVtus(const std::string& rStem, hid_t fileId, const std::vector<ExportDataset>& rDatasets, bool originalOrder) {
+        OutputFileHandler handler(FileFinder(mDir + "vtu", RelativeTo::Absolute), false);
+        std::string vtu_dir = handler.GetOutputDirectoryFullPath();
+
+        std::vector<double> points = mMesh.mPoints;
+        std::vector<unsigned> elements = mMesh.mElements;
+        if (GetMeshGroup(originalOrder) == "/Mesh")
+            GetPermuted(points, elements);
+        std::vector<int32_t> connectivity(elements.begin(), elements.end());
+
+        const unsigned num_procs = PetscTools::GetNumProcs();
+        const unsigned rank = PetscTools::GetMyRank();
+        std::stringstream pvd;
+        for (unsigned d = 0; d < rDatasets.size(); d++) {
+            const ExportDataset& r_dataset = rDatasets[d];
+            hid_t dataset_id = H5Dopen(fileId, r_dataset.mName.c_str(), H5P_DEFAULT);
+            hid_t dspace = H5Dget_space(dataset_id);
+
+            std::vector<hsize_t> count = r_dataset.mDims;
+            count[0] = 1;
+            hsize_t row_size = r_dataset.mCellData ? mMesh.mNumElements : mMesh.mNumNodes;
+            hid_t memspace = H5Screate_simple(1, &row_size, nullptr);
+            std::vector<float> row(row_size);
+
+            std::string base = rStem + "_" + r_dataset.mName.substr(1);
+            unsigned width = std::to_string(std::max<hsize_t>(r_dataset.mDims[0], 1) - 1).size();
+            for (unsigned i = 0; i < r_dataset.mDims[0]; i++) {
+                std::string file_name = base + "_" + ZeroFill(std::to_string(i), width) + ".vtu";
+                pvd << "  <DataSet timestep=\"" << i << "\" part=\"" << d << "\" name=\"" << r_dataset.mNamer(i)
+                    << "\" file=\"vtu/" << file_name << "\"/>\n";
+                if (i % num_procs != rank)
+                    continue;
+
+                std::vector<hsize_t> start(count.size(), 0);
+                start[0] = i;
+                H5Sselect_hyperslab(dspace, H5S_SELECT_SET, &start[0], nullptr, &count[0], nullptr);
+                H5Dread(dataset_id, H5T_NATIVE_FLOAT, memspace, dspace, H5P_DEFAULT, &row[0]);
+                WriteVtu(vtu_dir + file_name, points, connectivity, r_dataset.mNamer(i), r_dataset.mCellData, row);
+            }
+
+            H5Sclose(memspace);
+            H5Sclose(dspace);
+            H5Dclose(dataset_id);
+        }
+
+        if (PetscTools::AmMaster()) {
+            std::ofstream os((mDir + rStem + ".pvd").c_str());
+            os << "<?xml version=\"1.0\"?>\n";
+            os << "<VTKFile type=\"Collection\" version=\"0.1\">\n";
+            os << " <Collection>\n" << pvd.str() << " </Collection>\n";
+            os << "</VTKFile>\n";
+            std::cout << "pvd: " << mDir << rStem << ".pvd" << std::endl;
+        }
+    }
+
+public:
+    QutemuExport(const FileFinder& rDir) :
+            mDir(rDir.GetAbsolutePath())
+    {
+        if (mDir.empty() || mDir.back() != '/')
+            mDir += "/";
+
+        mInterval = ReadInterval();
+
+        NodePartition partition;
+        if (partition.Load(FileFinder(mDir + "permutation.h5", RelativeTo::Absolute)))
+            mPermutation = partition.rGetPermutation();
+    }
+
+    void LoadMesh(const std::string& rMeshFile) {
+        BinaryMeshHeader header;
+        bool cache = rMeshFile.size() > 6 && rMeshFile.compare(rMeshFile.size() - 6, 6, ".qmesh") == 0;
+        if (cache) {
+            if (!BinaryMeshCache::ReadHeader(rMeshFile, header))
+                EXCEPTION(rMeshFile << " is not a mesh cache");
+
+            if (header.mDimension == 2) {
+                BinaryMeshReader<2> reader(rMeshFile);
+                ReadMesh<2>(reader, mMesh);
+            }
+            else {
+                BinaryMeshReader<3> reader(rMeshFile);
+                ReadMesh<3>(reader, mMesh);
+            }
+        }
+        else {
+            std::ifstream node_file(FileFinder(rMeshFile + ".node", RelativeTo::AbsoluteOrCwd).GetAbsolutePath().c_str());
+            unsigned num_nodes = 0, dimension = 0;
+            node_file >> num_nodes >> dimension;
+            if (dimension == 2) {
+                TrianglesMeshReader<2,2> reader(rMeshFile);
+                ReadMesh<2>(reader, mMesh);
+            }
+            else {
+                TrianglesMeshReader<3,3> reader(rMeshFile);
+                ReadMesh<3>(reader, mMesh);
+            }
+        }
+
+        if (!mPermutation.empty() && mPermutation.size() != mMesh.mNumNodes)
+            EXCEPTION("permutation.h5 has " << mPermutation.size() << " nodes, the mesh has " << mMesh.mNumNodes);
+        WriteMeshFile();
+    }
+
+    void Export(const std::string& rFileName, bool vtu) {
+        std::string path = mDir + rFileName;
+        hid_t file_id = H5Fopen(path.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+        if (file_id <= 0)
+            EXCEPTION("Could not open " << path << " , H5Fopen error code = " << file_id);
+
+        bool original_order;
+        std::vector<ExportDataset> datasets = ReadDatasets(file_id, original_order);
+        std::string stem = rFileName.substr(0, rFileName.find_last_of('.'));
+        if (PetscTools::AmMaster())
+            WriteXdmf(stem, rFileName, datasets, original_order);
+        if (vtu)
+            WriteVtus(stem, file_id, datasets, original_order);
+
+        H5Fclose(file_id);
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    ExecutableSupport::InitializePetsc(&argc, &argv);
+    ExecutableSupport::ShowParallelLaunching();
+
+    int exit_code = ExecutableSupport::EXIT_OK;
+
+    try
+    {
+        CommandLineArguments* args = CommandLineArguments::Instance();
+        if (!args->OptionExists("-meshfile") || !args->OptionExists("-dir"))
+            EXCEPTION("Usage: QutemuExport -meshfile <mesh> -dir <outdir> [-files <h5list>] [-vtu]");
+
+        FileFinder dir(args->GetStringCorrespondingToOption("-dir"), RelativeTo::ChasteTestOutput);
+        std::vector<std::string> files;
+        if (args->OptionExists("-files")) {
+            std::stringstream ss(args->GetStringCorrespondingToOption("-files"));
+            std::string file;
+            while (std::getline(ss, file, ','))
+                files.push_back(file);
+        }
+        else {
+            for (const char* p_file : {"snapshots.h5", "snapshots_dyn.h5", "results.h5"})
+                if (FileFinder(p_file, dir).IsFile())
+                    files.push_back(p_file);
+        }
+
+        QutemuExport exporter(dir);
+        exporter.LoadMesh(args->GetStringCorrespondingToOption("-meshfile"));
+        for (const std::string& r_file : files)
+            exporter.Export(r_file, args->OptionExists("-vtu"));
+    }
+    catch (const Exception& e)
+    {
+        ExecutableSupport::PrintError(e.GetMessage());
+        exit_code = ExecutableSupport::EXIT_ERROR;
+    }
+
+    ExecutableSupport::FinalizePetsc();
+    return exit_code;
+}
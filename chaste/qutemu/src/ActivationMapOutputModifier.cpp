@@ -1,49 +1,290 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <boost/foreach.hpp>
 #include "OutputFileHandler.hpp"
 #include "HeartConfig.hpp"
 
 #include "ActivationMapOutputModifier.hpp"
+#include "QutemuHdf5.hpp"
 #include "QutemuLog.hpp"
+#include "QutemuTrace.hpp"
 
 ActivationMapOutputModifier::~ActivationMapOutputModifier() {
     Close();
 }
 
+void ActivationMapOutputModifier::SetBatchSize(unsigned batchSize) {
+    if (batchSize < 1)
+        EXCEPTION("Snapshot batch size must be at least 1");
+    mBatchSize = batchSize;
+}
+
+void ActivationMapOutputModifier::SetTriggerLag(unsigned lag) {
+    mTriggerLag = lag;
+    mTracker.SetJournal(lag > 0 && mSnapshotTimes.empty() ? &mJournal : nullptr);
+}
+
+void ActivationMapOutputModifier::SetOriginalOrder(const std::vector<unsigned>& rPermutation) {
+    mOriginalOrder = true;
+    mPermutation = rPermutation;
+}
+
+void ActivationMapOutputModifier::SetOwnership(DistributedVectorFactory *pVectorFactory) {
+    mNumNodes = pVectorFactory->GetProblemSize();
+    mLo = pVectorFactory->GetLow();
+    mHi = pVectorFactory->GetHigh();
+    mNumberOwned = pVectorFactory->GetLocalOwnership();
+    mWriteLo = mLo;
+    mWriteCount = mNumberOwned;
+}
+
+void ActivationMapOutputModifier::SetupOriginalOrder() {
+    if (mPermutation.empty())
+        return;
+    if (mPermutation.size() != mNumNodes)
+        EXCEPTION("Node permutation has " << mPermutation.size() << " entries, the problem has " << mNumNodes << " nodes");
+
+    const unsigned num_procs = PetscTools::GetNumProcs();
+    const unsigned rank = PetscTools::GetMyRank();
+    auto share_lo = [this, num_procs](unsigned r) { return (unsigned)((uint64_t)mNumNodes * r / num_procs); };
+    mWriteLo = share_lo(rank);
+    mWriteCount = share_lo(rank + 1) - mWriteLo;
+
+    // local nodes in file order, which is also the order of the ranks writing them
+    std::vector<unsigned> send_columns;
+    mSendOrder.clear();
+    mSendCounts.assign(num_procs, 0);
+    unsigned dest = 0;
+    for (unsigned i = 0; i < mNumNodes; i++) {
+        if (mPermutation[i] < mLo || mPermutation[i] >= mHi)
+            continue;
+
+        while (i >= share_lo(dest + 1))
+            dest++;
+        mSendOrder.push_back(mPermutation[i] - mLo);
+        send_columns.push_back(i);
+        mSendCounts[dest]++;
+    }
+
+    mRecvCounts.resize(num_procs);
+    MPI_Alltoall(mSendCounts.data(), 1, MPI_INT, mRecvCounts.data(), 1, MPI_INT, PETSC_COMM_WORLD);
+    mSendOffsets.assign(num_procs, 0);
+    mRecvOffsets.assign(num_procs, 0);
+    for (unsigned p = 1; p < num_procs; p++) {
+        mSendOffsets[p] = mSendOffsets[p - 1] + mSendCounts[p - 1];
+        mRecvOffsets[p] = mRecvOffsets[p - 1] + mRecvCounts[p - 1];
+    }
+
+    mRecvColumns.resize(mWriteCount);
+    MPI_Alltoallv(send_columns.data(), mSendCounts.data(), mSendOffsets.data(), MPI_UNSIGNED,
+                  mRecvColumns.data(), mRecvCounts.data(), mRecvOffsets.data(), MPI_UNSIGNED, PETSC_COMM_WORLD);
+    for (unsigned& r_column : mRecvColumns)
+        r_column -= mWriteLo;
+}
+
+const float* ActivationMapOutputModifier::ReorderBuffer(Variable* var) {
+    if (mPermutation.empty())
+        return mNumberOwned ? &var->mBuffer[0] : nullptr;
+
+    // laid out [rank][row][node], so every buffered row goes in one exchange
+    const unsigned num_procs = PetscTools::GetNumProcs();
+    const unsigned rows = mNumBuffered;
+    mSendBuffer.resize(rows * mNumberOwned);
+    mRecvBuffer.resize(rows * mWriteCount);
+    mWriteBuffer.resize(rows * mWriteCount);
+
+    std::vector<int> send_counts(num_procs), send_offsets(num_procs), recv_counts(num_procs), recv_offsets(num_procs);
+    for (unsigned p = 0; p < num_procs; p++) {
+        send_counts[p] = mSendCounts[p] * rows;
+        send_offsets[p] = mSendOffsets[p] * rows;
+        recv_counts[p] = mRecvCounts[p] * rows;
+        recv_offsets[p] = mRecvOffsets[p] * rows;
+
+        float* p_send = mSendBuffer.data() + send_offsets[p];
+        const unsigned* p_order = mSendOrder.data() + mSendOffsets[p];
+        for (unsigned r = 0; r < rows; r++) {
+            const float* p_row = var->mBuffer.data() + r * mNumberOwned;
+            for (int k = 0; k < mSendCounts[p]; k++)
+                *p_send++ = p_row[p_order[k]];
+        }
+    }
+
+    MPI_Alltoallv(mSendBuffer.data(), send_counts.data(), send_offsets.data(), MPI_FLOAT,
+                  mRecvBuffer.data(), recv_counts.data(), recv_offsets.data(), MPI_FLOAT, PETSC_COMM_WORLD);
+
+    for (unsigned p = 0; p < num_procs; p++) {
+        const float* p_recv = mRecvBuffer.data() + recv_offsets[p];
+        const unsigned* p_columns = mRecvColumns.data() + mRecvOffsets[p];
+        for (unsigned r = 0; r < rows; r++) {
+            float* p_row = mWriteBuffer.data() + r * mWriteCount;
+            for (int k = 0; k < mRecvCounts[p]; k++)
+                p_row[p_columns[k]] = *p_recv++;
+        }
+    }
+
+    return mWriteCount ? &mWriteBuffer[0] : nullptr;
+}
+
 void ActivationMapOutputModifier::InitialiseAtStart(DistributedVectorFactory *pVectorFactory) {
     OutputFileHandler output_file_handler(HeartConfig::Instance()->GetOutputDirectory(), false);
-    std::string file_name = output_file_handler.FindFile(mFilename).GetAbsolutePath();
+    FileFinder file = output_file_handler.FindFile(mFilename);
+    std::string file_name = file.GetAbsolutePath();
+    bool resume = mInitialised && file.IsFile();
 
     // Set up a property list saying how we'll open the file
     hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
     H5Pset_fapl_mpio(fapl, PETSC_COMM_WORLD, MPI_INFO_NULL);
 
-    //create file
-    hid_t fcpl = H5Pcreate(H5P_FILE_CREATE);
-    mFileId = H5Fcreate(file_name.c_str(), H5F_ACC_TRUNC, fcpl, fapl);
-    H5Pclose(fcpl);
+    if (resume) {
+        //continue the snapshots of a previous Solve
+        mFileId = H5Fopen(file_name.c_str(), H5F_ACC_RDWR, fapl);
+    }
+    else {
+        //create file
+        hid_t fcpl = H5Pcreate(H5P_FILE_CREATE);
+        mFileId = H5Fcreate(file_name.c_str(), H5F_ACC_TRUNC, fcpl, fapl);
+        H5Pclose(fcpl);
+    }
 
     H5Pclose(fapl);
 
     if (mFileId < 0)
         EXCEPTION("Failed to Create H5F " << file_name << " error code = " << mFileId);
 
-    mNumNodes = pVectorFactory->GetProblemSize();
-    mLo = pVectorFactory->GetLow();
-    mHi = pVectorFactory->GetHigh();
-    mNumberOwned = pVectorFactory->GetLocalOwnership();
+    SetOwnership(pVectorFactory);
+    SetupOriginalOrder();
+    if (!mInitialised)
+        mTracker.Resize(mNumberOwned);
+    mInitialised = true;
+
+    for (Variable* var : mVariables) {
+        var->mBuffer.resize(mBatchSize * mNumberOwned);
+        if (resume)
+            var->mVarId = H5Dopen(mFileId, var->mName.c_str(), H5P_DEFAULT);
+        else
+            CreateDataset(var);
+
+        hsize_t dims[2] = {mNumRows, mNumNodes};
+        H5Dset_extent(var->mVarId, dims);
+    }
 
-    mActivationState.assign(mNumberOwned, false);
-    mCurrentPeak.assign(mNumberOwned, mThresholdVoltage);
-    for (Variable* var : mVariables)
-        CreateDataset(var);
+    if (!resume)
+        QutemuHdf5::WriteAttribute(mFileId, "OriginalOrder", mOriginalOrder ? 1.0 : 0.0);
 }
 
-void ActivationMapOutputModifier::CreateDataset(Variable* var) {
-    var->mArr.assign(mNumberOwned, std::numeric_limits<float>::quiet_NaN());
+double ActivationMapOutputModifier::GetLastActiveTime(double time) const {
+    double last = -std::numeric_limits<double>::infinity();
+    for (unsigned i = 0; i < mTracker.GetSize(); i++) {
+        if (mTracker.mActive[i])
+            return time;
+        // repolarisation of the last activation, NaN until the first
+        if (!std::isnan(mTracker.mApd[i]))
+            last = std::max(last, (double)mTracker.mActivation[i] + mTracker.mApd[i]);
+    }
+    return last;
+}
+
+void ActivationMapOutputModifier::SaveState(const FileFinder& rFile) {
+    // mAnyActivated is only checked locally, store whether any rank activated
+    unsigned any_activated = mAnyActivated;
+    MPI_Allreduce(MPI_IN_PLACE, &any_activated, 1, MPI_UNSIGNED, MPI_LOR, PETSC_COMM_WORLD);
+
+    hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
+    H5Pset_fapl_mpio(fapl, PETSC_COMM_WORLD, MPI_INFO_NULL);
+    hid_t file_id = H5Fcreate(rFile.GetAbsolutePath().c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl);
+    H5Pclose(fapl);
+    if (file_id < 0)
+        EXCEPTION("Failed to Create H5F " << rFile.GetAbsolutePath() << " error code = " << file_id);
+
+    std::vector<float> active(mTracker.mActive.begin(), mTracker.mActive.end());
+    std::pair<const char*, float*> arrays[] = {
+            {"Active", active.empty() ? nullptr : &active[0]},
+            {"CurrentPeak", mTracker.mCurrentPeak.empty() ? nullptr : &mTracker.mCurrentPeak[0]},
+            {"Activation", mTracker.mActivation.empty() ? nullptr : &mTracker.mActivation[0]},
+            {"Peak", mTracker.mPeak.empty() ? nullptr : &mTracker.mPeak[0]},
+            {"APD", mTracker.mApd.empty() ? nullptr : &mTracker.mApd[0]}};
+
+    hsize_t dims[1] = {mNumNodes};
+    hsize_t start = mLo, count = mNumberOwned;
+    hid_t filespace = H5Screate_simple(1, dims, nullptr);
+    for (auto& r_array : arrays) {
+        hid_t dataset_id = H5Dcreate(file_id, r_array.first, H5T_NATIVE_FLOAT, filespace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        QutemuHdf5::WriteHyperslab(dataset_id, H5T_NATIVE_FLOAT, &start, &count, r_array.second);
+        H5Dclose(dataset_id);
+    }
+    H5Sclose(filespace);
+
+    QutemuHdf5::WriteAttribute(file_id, "ActivationIndex", mActivationIndex);
+    QutemuHdf5::WriteAttribute(file_id, "CurStartTime", mCurStartTime);
+    QutemuHdf5::WriteAttribute(file_id, "LastProcessedTime", mLastProcessedTime);
+    QutemuHdf5::WriteAttribute(file_id, "AnyActivated", any_activated);
+    QutemuHdf5::WriteAttribute(file_id, "NumRows", mNumRows);
 
+    H5Fclose(file_id);
+}
+
+void ActivationMapOutputModifier::LoadState(const FileFinder& rFile, DistributedVectorFactory *pVectorFactory) {
+    std::string file_name = rFile.GetAbsolutePath();
+    if (!rFile.IsFile())
+        EXCEPTION("Could not open " << file_name << " , as it does not exist.");
+
+    hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
+    H5Pset_fapl_mpio(fapl, PETSC_COMM_WORLD, MPI_INFO_NULL);
+    hid_t file_id = H5Fopen(file_name.c_str(), H5F_ACC_RDONLY, fapl);
+    H5Pclose(fapl);
+    if (file_id <= 0)
+        EXCEPTION("Could not open " << file_name << " , H5Fopen error code = " << file_id);
+
+    SetOwnership(pVectorFactory);
+    mTracker.Resize(mNumberOwned);
+
+    std::vector<float> active(mNumberOwned);
+    std::pair<const char*, float*> arrays[] = {
+            {"Active", active.empty() ? nullptr : &active[0]},
+            {"CurrentPeak", mTracker.mCurrentPeak.empty() ? nullptr : &mTracker.mCurrentPeak[0]},
+            {"Activation", mTracker.mActivation.empty() ? nullptr : &mTracker.mActivation[0]},
+            {"Peak", mTracker.mPeak.empty() ? nullptr : &mTracker.mPeak[0]},
+            {"APD", mTracker.mApd.empty() ? nullptr : &mTracker.mApd[0]}};
+
+    hsize_t start = mLo, count = mNumberOwned;
+    for (auto& r_array : arrays) {
+        hid_t dataset_id = H5Dopen(file_id, r_array.first, H5P_DEFAULT);
+        if (dataset_id <= 0) {
+            H5Fclose(file_id);
+            EXCEPTION("Opened " << file_name << " but could not find the dataset '" << r_array.first << "'");
+        }
+
+        hid_t dspace = H5Dget_space(dataset_id);
+        hsize_t num_nodes = H5Sget_simple_extent_npoints(dspace);
+        H5Sclose(dspace);
+        if (num_nodes != mNumNodes) {
+            H5Dclose(dataset_id);
+            H5Fclose(file_id);
+            EXCEPTION("Activation state " << file_name << " has " << num_nodes << " nodes, the mesh has " << mNumNodes);
+        }
+
+        QutemuHdf5::ReadHyperslab(dataset_id, H5T_NATIVE_FLOAT, &start, &count, r_array.second);
+        H5Dclose(dataset_id);
+    }
+
+    mActivationIndex = (unsigned)QutemuHdf5::ReadDoubleAttribute(file_id, "ActivationIndex");
+    mCurStartTime = QutemuHdf5::ReadDoubleAttribute(file_id, "CurStartTime");
+    mLastProcessedTime = QutemuHdf5::ReadDoubleAttribute(file_id, "LastProcessedTime");
+    mAnyActivated = QutemuHdf5::ReadDoubleAttribute(file_id, "AnyActivated") != 0.0;
+    mNumRows = (unsigned)QutemuHdf5::ReadDoubleAttribute(file_id, "NumRows");
+    H5Fclose(file_id);
+
+    for (unsigned i = 0; i < mNumberOwned; i++)
+        mTracker.mActive[i] = active[i] != 0.0f;
+    mTracker.RestoreBands();
+    mInitialised = true;
+}
+
+void ActivationMapOutputModifier::CreateDataset(Variable* var) {
     hsize_t data_dims[2] = {1, mNumNodes};
     hsize_t max_dims[2] = {H5S_UNLIMITED, mNumNodes};
-    hsize_t chunking[2] = {1, mNumNodes};//one snapshot per chunk, (~1MB for 256k nodes)
+    hsize_t chunking[2] = {mBatchSize, mNumNodes};//one batch per chunk, (~1MB per snapshot for 256k nodes)
 
     hid_t dcpl = H5Pcreate (H5P_DATASET_CREATE);
     H5Pset_chunk(dcpl, 2, chunking);
@@ -76,74 +317,137 @@ bool ActivationMapOutputModifier::IsSnapshotTime(float time, double* pSolution,
         return false;
     }
 
-    unsigned new_snapshot = false;
-    for (unsigned local_index=0; local_index < mNumberOwned; local_index++)
-    {
-        double v = pSolution[local_index*problemDim];
-        if (!mActivationState[local_index] && v > mThresholdVoltage && //activation
-            mActivationTime[local_index] >= mCurStartTime)//reactivation (NaN comparison returns false)
-        {
-            new_snapshot = true;
-            std::cout << "Snapshot trigger." <<
-                      " node: " << mLo + local_index <<
-                      " on " << PetscTools::GetMyRank() <<
-                      ", period: " << time - mActivationTime[local_index] << std::endl;
-            break;
-        }
-    }
-
-    MPI_Allreduce(MPI_IN_PLACE, &new_snapshot, 1, MPI_UNSIGNED, MPI_LOR, PETSC_COMM_WORLD);
-    return new_snapshot;
+    unsigned num_ranks = FindLocalTrigger(time, pSolution, problemDim);
+    MPI_Allreduce(MPI_IN_PLACE, &num_ranks, 1, MPI_UNSIGNED, MPI_SUM, PETSC_COMM_WORLD);
+    ReportTrigger(time, num_ranks);
+    return num_ranks > 0;
 }
 
-void ActivationMapOutputModifier::SaveSnapshot() {
-    for (Variable* var : mVariables)
-        SaveDataset(var);
+unsigned ActivationMapOutputModifier::FindLocalTrigger(double time, double* pSolution, unsigned problemDim) {
+    unsigned local_index = mTracker.FindReactivation(pSolution, problemDim, mCurStartTime);
+    if (local_index == mNumberOwned)
+        return 0;
+
+    if (mVerbose)
+        std::cout << "Snapshot trigger." <<
+                  " node: " << mLo + local_index <<
+                  " on " << PetscTools::GetMyRank() <<
+                  ", period: " << time - mTracker.mActivation[local_index] << std::endl;
+    return 1;
+}
 
-    LOG("snapshot: " << mCurStartTime << "-" << mLastProcessedTime << " (" << mFilename << ")");
+void ActivationMapOutputModifier::ReportTrigger(double time, unsigned numRanks) {
+    if (numRanks > 0)
+        COUT("Snapshot trigger at " << time << "ms on " << numRanks << " ranks (" << mFilename << ")");
 }
 
-void ActivationMapOutputModifier::SaveDataset(Variable* var) {
-    hsize_t dims[2] = {mActivationIndex+1, mNumNodes};
-    H5Dset_extent(var->mVarId, dims );
+void ActivationMapOutputModifier::ProcessPipelined(double time, double* pSolution, unsigned problemDim) {
+    // reductions are posted with the local result and waited on mTriggerLag steps later
+    PendingTrigger trigger = {time, 0, MPI_REQUEST_NULL, (unsigned)mJournal.size(), false};
+    mPendingTriggers.push_back(trigger);
+    PendingTrigger& r_trigger = mPendingTriggers.back();
+    r_trigger.mNumRanks = FindLocalTrigger(time, pSolution, problemDim);
+    MPI_Iallreduce(MPI_IN_PLACE, &r_trigger.mNumRanks, 1, MPI_UNSIGNED, MPI_SUM, PETSC_COMM_WORLD, &r_trigger.mRequest);
+
+    if (mTracker.Update(time, pSolution, problemDim))
+        mAnyActivated = true;
 
-    hid_t memspace, hyperslab_space;
-    if (mNumberOwned != 0)
-    {
-        hsize_t v_size[1] = {mNumberOwned};
-        memspace = H5Screate_simple(1, v_size, nullptr);
+    while (mPendingTriggers.size() > mTriggerLag)
+        ResolveTrigger();
+}
+
+void ActivationMapOutputModifier::ResolveTrigger() {
+    PendingTrigger& r_trigger = mPendingTriggers.front();
+    MPI_Wait(&r_trigger.mRequest, MPI_STATUS_IGNORE);
 
-        hsize_t start[2] = {mActivationIndex, mLo};
-        hsize_t count[2] = {1, mNumberOwned};
+    if (!r_trigger.mIgnore && r_trigger.mNumRanks > 0) {
+        ReportTrigger(r_trigger.mTime, r_trigger.mNumRanks);
+        SaveSnapshot(r_trigger.mTime, r_trigger.mJournalStart);
+        mActivationIndex++;
+        mCurStartTime = r_trigger.mTime;
 
-        hyperslab_space = H5Dget_space(var->mVarId);
-        H5Sselect_hyperslab(hyperslab_space, H5S_SELECT_SET, start, nullptr, count, nullptr);
+        // later steps were tested against the old window, as if they were in the new snapshot
+        for (PendingTrigger& r_later : mPendingTriggers)
+            r_later.mIgnore = true;
     }
-    else
-    {
-        memspace = H5Screate(H5S_NULL);
-        hyperslab_space = H5Screate(H5S_NULL);
+    mPendingTriggers.pop_front();
+
+    // only the changes since the oldest pending step are needed
+    unsigned keep_from = mPendingTriggers.empty() ? mJournal.size() : mPendingTriggers.front().mJournalStart;
+    mJournal.erase(mJournal.begin(), mJournal.begin() + keep_from);
+    for (PendingTrigger& r_later : mPendingTriggers)
+        r_later.mJournalStart -= keep_from;
+}
+
+void ActivationMapOutputModifier::SaveSnapshot(double endTime, unsigned journalStart) {
+    if (mNumBuffered == 0)
+        mBufferStartIndex = mActivationIndex;
+
+    unsigned row = mNumBuffered * mNumberOwned;
+    for (Variable* var : mVariables)
+        std::copy(var->mrArr.begin(), var->mrArr.end(), var->mBuffer.begin() + row);
+
+    // undo the changes made since endTime, newest first
+    for (unsigned j = mJournal.size(); j > journalStart; j--) {
+        const ActivationJournalEntry& r_entry = mJournal[j - 1];
+        mActivationTime.mBuffer[row + r_entry.mIndex] = r_entry.mActivation;
+        mPeakVoltage.mBuffer[row + r_entry.mIndex] = r_entry.mPeak;
+        mActionPotentialDuration.mBuffer[row + r_entry.mIndex] = r_entry.mApd;
     }
+    mNumBuffered++;
+
+    LOG("snapshot: " << mCurStartTime << "-" << endTime << " (" << mFilename << ")");
 
-    // Create property list for collective dataset write
-    hid_t property_list_id = H5Pcreate(H5P_DATASET_XFER);
-    H5Pset_dxpl_mpio(property_list_id, H5FD_MPIO_COLLECTIVE);
+    if (mNumBuffered == mBatchSize)
+        FlushSnapshots();
+}
+
+void ActivationMapOutputModifier::FlushSnapshots() {
+    if (mNumBuffered == 0)
+        return;
 
-    // Write!
-    H5Dwrite(var->mVarId, H5T_NATIVE_FLOAT, memspace, hyperslab_space, property_list_id, &(*var)[0]);
+    TRACE_SCOPE("FlushSnapshots");
+    const double start = MPI_Wtime();
+
+    // one extent change for the whole batch
+    unsigned num_rows = std::max(mNumRows, mBufferStartIndex + mNumBuffered);
+    for (Variable* var : mVariables) {
+        if (num_rows != mNumRows) {
+            hsize_t dims[2] = {num_rows, mNumNodes};
+            H5Dset_extent(var->mVarId, dims);
+        }
+        WriteDataset(var);
+    }
 
-    // Tidy up
-    H5Sclose(memspace);
-    H5Sclose(hyperslab_space);
-    H5Pclose(property_list_id);
+    mNumRows = num_rows;
+    mNumBuffered = 0;
+    mWriteTime += MPI_Wtime() - start;
+}
+
+void ActivationMapOutputModifier::WriteDataset(Variable* var) {
+    const float* p_data = ReorderBuffer(var);
+    hsize_t start[2] = {mBufferStartIndex, mWriteLo};
+    hsize_t count[2] = {mNumBuffered, mWriteCount};
+    QutemuHdf5::WriteHyperslab(var->mVarId, H5T_NATIVE_FLOAT, start, count, p_data);
 }
 
 void ActivationMapOutputModifier::FinaliseAtEnd() {
-    SaveSnapshot();
+    while (!mPendingTriggers.empty())
+        ResolveTrigger();
+
+    SaveSnapshot(mLastProcessedTime, mJournal.size());
+    FlushSnapshots();
     Close();
 }
 
 void ActivationMapOutputModifier::ProcessSolutionAtTimeStep(double time, Vec solution, unsigned problemDim) {
+    TRACE_SCOPE("ActivationMap");
+    const double start = MPI_Wtime();
+    ProcessStep(time, solution, problemDim);
+    mProcessTime += MPI_Wtime() - start;
+}
+
+void ActivationMapOutputModifier::ProcessStep(double time, Vec solution, unsigned problemDim) {
     if (time <= mLastProcessedTime)
         return;
     mLastProcessedTime = time;
@@ -151,37 +455,21 @@ void ActivationMapOutputModifier::ProcessSolutionAtTimeStep(double time, Vec sol
     double* p_solution;
     VecGetArray(solution, &p_solution);
 
+    if (mTriggerLag > 0 && mSnapshotTimes.empty()) {
+        ProcessPipelined(time, p_solution, problemDim);
+        VecRestoreArray(solution, &p_solution);
+        return;
+    }
+
     if (IsSnapshotTime(time, p_solution, problemDim)) {
-        SaveSnapshot();
+        SaveSnapshot(mLastProcessedTime, mJournal.size());
         mActivationIndex++;
         mCurStartTime = time;
     }
 
-    for (unsigned local_index=0; local_index < mNumberOwned; local_index++)
-    {
-        double v = p_solution[local_index*problemDim];
-        float& activation_time = mActivationTime[local_index];
-        float& peak = mCurrentPeak[local_index];
+    if (mTracker.Update(time, p_solution, problemDim))
+        mAnyActivated = true;
 
-        if (!mActivationState[local_index] && v > mThresholdVoltage) {//activation
-            mActivationState[local_index] = true;
-            activation_time = (float)time;
-            peak = (float)v; //reset peak voltage
-            mAnyActivated = true;
-        }
-        if (mActivationState[local_index]) {
-            //update peak
-            if (v > peak)
-                peak = (float)v;
-
-            // APD90, deactivation
-            if (v < peak - (peak - mRestingVoltage) * 0.9) {
-                mActivationState[local_index] = false;
-                mPeakVoltage[local_index] = peak;
-                mActionPotentialDuration[local_index] = (float)(time - activation_time);
-            }
-        }
-    }
     VecRestoreArray(solution, &p_solution);
 }
 
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <deque>
+
 #include "AbstractOutputModifier.hpp"
+#include "FileFinder.hpp"
+#include "ActivationTracker.hpp"
 
 class ActivationMapOutputModifier : public AbstractOutputModifier
 {
@@ -9,19 +13,14 @@ private:
     {
     public:
         std::string mName;
-        std::vector<float> mArr;
+        const std::vector<float>& mrArr; ///< Local per-node vector, owned by the tracker
+        std::vector<float> mBuffer; ///< Snapshots waiting to be written, one mrArr copy per row
         hid_t mVarId;
 
-        Variable(std::string name) : mName(name)
+        Variable(std::string name, const std::vector<float>& rArr) : mName(name), mrArr(rArr)
         {}
-
-        float& operator[](int i) {
-            return mArr[i];
-        }
     };
 
-    double mThresholdVoltage; ///< The user-defined threshold at which activation is to be measured
-    double mRestingVoltage; ///< The user-defined resting potiential for APD90 calculation
     std::vector<double> mSnapshotTimes;
 
     unsigned mNumNodes;    ///< Global problem size
@@ -29,27 +28,59 @@ private:
     unsigned mHi;          ///< Local ownership of PETSc node vector
     unsigned mNumberOwned; ///< mNumberOwned=#mHi-#mLo
 
-    hid_t mFileId;
+    hid_t mFileId = 0;
+    bool mInitialised = false; ///< State carries over to the next InitialiseAtStart (another Solve segment, or a resume)
+
+    unsigned mBatchSize = 8; ///< Maximum number of buffered snapshots, also the number of snapshots per chunk
+    unsigned mNumBuffered = 0; ///< Number of snapshots in the buffers
+    unsigned mBufferStartIndex = 0; ///< Snapshot index of the first buffered row
+    unsigned mNumRows = 1; ///< Current extent of the datasets
 
     bool mAnyActivated = false;
     unsigned mActivationIndex = 0; ///< The index of this snapshot, increases every time a cell is reactivated
     double mCurStartTime = 0; ///< The time of the activation that triggered this snapshot. Used for detecting reactivations
     double mLastProcessedTime = 0;
-    std::vector<bool> mActivationState; ///< Local per-node vector. True if cell was active last timestep
-    std::vector<float> mCurrentPeak; ///< Local per-node vector. Peak value for current activation
-    Variable mActivationTime; ///< Local per-node vector. Time of most recent activation
-    Variable mPeakVoltage; ///< Local per-node vector. Peak voltage of last activation (reset on threshold cross)
-    Variable mActionPotentialDuration; ///< Local per-node vector. APD90 of last repolarisation
+    ActivationTracker mTracker; ///< Local per-node activation state
+
+    Variable mActivationTime; ///< Time of most recent activation
+    Variable mPeakVoltage; ///< Peak voltage of last activation (reset on threshold cross)
+    Variable mActionPotentialDuration; ///< APD90 of last repolarisation
 
     std::vector<Variable*> mVariables;
+
+    /** A snapshot trigger reduction still in flight */
+    struct PendingTrigger
+    {
+        double mTime;           ///< Step the trigger was tested at
+        unsigned mNumRanks;     ///< Reduced in place, number of ranks which saw a reactivation
+        MPI_Request mRequest;
+        unsigned mJournalStart; ///< Journal size before this step's tracker update
+        bool mIgnore;           ///< Tested against a window which has since been replaced by an earlier trigger
+    };
+
+    unsigned mTriggerLag = 0; ///< Steps a trigger reduction may lag behind, 0 for a blocking reduction every step
+    bool mVerbose = false;    ///< Print the trigger node from every rank
+    std::deque<PendingTrigger> mPendingTriggers; ///< Oldest first, deque so mNumRanks stays in place for MPI
+    std::vector<ActivationJournalEntry> mJournal; ///< Tracker output changes since the oldest pending trigger
+
+    bool mOriginalOrder = false;        ///< Dataset columns are .node file indices rather than mesh indices
+    std::vector<unsigned> mPermutation; ///< Mesh index of each .node file index, empty if they are the same
+    unsigned mWriteLo = 0;              ///< First dataset column written by this rank
+    unsigned mWriteCount = 0;           ///< Number of dataset columns written by this rank
+    std::vector<unsigned> mSendOrder;   ///< Local node offsets, sorted by file index
+    std::vector<int> mSendCounts, mSendOffsets, mRecvCounts, mRecvOffsets; ///< Nodes exchanged with each rank per row
+    std::vector<unsigned> mRecvColumns; ///< Column (from mWriteLo) of each received node
+    std::vector<float> mSendBuffer, mRecvBuffer, mWriteBuffer;
+
+    double mProcessTime = 0; ///< Wall time in ProcessSolutionAtTimeStep (s), including mWriteTime
+    double mWriteTime = 0;   ///< Wall time flushing snapshots (s)
 public:
     ActivationMapOutputModifier(const std::string &rFilename, double thresholdVoltage, double restingVoltage) :
             AbstractOutputModifier(rFilename),
-            mThresholdVoltage(thresholdVoltage),
-            mRestingVoltage(restingVoltage),
-            mActivationTime("Activation"),
-            mPeakVoltage("Peak"),
-            mActionPotentialDuration("APD"),
+            mTracker(thresholdVoltage, restingVoltage),
+            mActivationTime("Activation", mTracker.mActivation),
+            mPeakVoltage("Peak", mTracker.mPeak),
+            mActionPotentialDuration("APD", mTracker.mApd),
             mVariables{&mActivationTime, &mPeakVoltage, &mActionPotentialDuration}
     {};
 
@@ -61,16 +92,77 @@ public:
 
     ~ActivationMapOutputModifier() override;
 
+    /**
+     * Snapshots are copied to a buffer and written batchSize at a time, with one extent change and one
+     * collective write per dataset. Must be called before InitialiseAtStart
+     */
+    void SetBatchSize(unsigned batchSize);
+
+    /**
+     * Uses non-blocking trigger reductions which are waited on lag steps later, removing the global sync
+     * every step. Snapshots are reconstructed as of the triggering step, so the output matches lag 0
+     * unless a node reactivates within lag steps of a trigger. Has no effect with fixed snapshot times
+     */
+    void SetTriggerLag(unsigned lag);
+
+    /**
+     * Writes snapshot columns in .node file order rather than mesh order, perm[file index] = mesh index.
+     * Each rank writes an even, contiguous share of the file indices, and the buffered snapshots are exchanged
+     * with one all-to-all per dataset flush, using send and receive orders worked out in InitialiseAtStart.
+     * Must be called before InitialiseAtStart
+     */
+    void SetOriginalOrder(const std::vector<unsigned>& rPermutation);
+
+    /** Print the triggering node from each rank, not only the aggregated trigger on the master */
+    void SetVerbose(bool verbose) { mVerbose = verbose; }
+
+    /**
+     * Writes the tracker state and snapshot position to a HDF5 file, indexed by global node.
+     * Call between Solve calls, with the file closed by FinaliseAtEnd. Collective
+     */
+    void SaveState(const FileFinder& rFile);
+
+    /** Wall time spent processing solutions, and the part of it spent writing snapshots (s), for TelemetryOutputModifier */
+    double GetProcessTime() const { return mProcessTime; }
+    double GetWriteTime() const { return mWriteTime; }
+
+    /**
+     * Latest time any local node was active (above its APD90 level): time if one still is, -inf if none has
+     * activated. For -stop_quiet
+     */
+    double GetLastActiveTime(double time) const;
+
+    /** Activations of each local node since the tracker was set up (not restored by LoadState), for -stop_reentry */
+    const std::vector<unsigned>& rGetActivationCounts() const { return mTracker.mCount; }
+
+    /** Name of the SaveState file for this modifier, within a checkpoint directory */
+    std::string GetStateFileName() const { return mFilename + ".state.h5"; }
+
+    /**
+     * Restores the state written by SaveState, for resuming a loaded simulation. The next InitialiseAtStart
+     * continues the existing snapshot file in the output directory if there is one. Collective
+     */
+    void LoadState(const FileFinder& rFile, DistributedVectorFactory *pVectorFactory);
+
     void InitialiseAtStart(DistributedVectorFactory *pVectorFactory) override;
     void FinaliseAtEnd() override;
     void ProcessSolutionAtTimeStep(double time, Vec solution, unsigned problemDim) override;
     void ProcessPdeSolutionAtTimeStep(double time, Vec solution, unsigned problemDim) override;
 
 private:
+    void ProcessStep(double time, Vec solution, unsigned problemDim);
     void Close();
     bool IsSnapshotTime(float time, double* pSolution, unsigned problemDim);
-    void SaveSnapshot();
+    unsigned FindLocalTrigger(double time, double* pSolution, unsigned problemDim);
+    void ReportTrigger(double time, unsigned numRanks);
+    void ProcessPipelined(double time, double* pSolution, unsigned problemDim);
+    void ResolveTrigger();
+    void SaveSnapshot(double endTime, unsigned journalStart);
+    void FlushSnapshots();
 
+    void SetOwnership(DistributedVectorFactory *pVectorFactory);
+    void SetupOriginalOrder();
+    const float* ReorderBuffer(Variable* var);
     void CreateDataset(Variable* var);
-    void SaveDataset(Variable* var);
+    void WriteDataset(Variable* var);
 };
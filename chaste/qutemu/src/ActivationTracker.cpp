@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "ActivationTracker.hpp"
+
+static const unsigned BLOCK_SIZE = 64; ///< Nodes per band check, blocks with an out of band node are rescanned
+
+void ActivationTracker::Resize(unsigned numNodes) {
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    mActive.assign(numNodes, 0u);
+    mCurrentPeak.assign(numNodes, (float)mThresholdVoltage);
+    mActivation.assign(numNodes, nan);
+    mPeak.assign(numNodes, nan);
+    mApd.assign(numNodes, nan);
+    mCount.assign(numNodes, 0u);
+    mLower.resize(numNodes);
+    mUpper.resize(numNodes);
+    for (unsigned i = 0; i < numNodes; i++)
+        SetBand(i, -std::numeric_limits<double>::infinity(), mThresholdVoltage);
+}
+
+void ActivationTracker::RestoreBands() {
+    for (unsigned i = 0; i < mActive.size(); i++) {
+        if (mActive[i])
+            SetBand(i, mCurrentPeak[i] - (mCurrentPeak[i] - mRestingVoltage) * 0.9, mCurrentPeak[i]);
+        else
+            SetBand(i, -std::numeric_limits<double>::infinity(), mThresholdVoltage);
+    }
+}
+
+void ActivationTracker::SetBand(unsigned i, double lower, double upper) {
+    // round inwards, so that (float)v reaching a bound includes every double v beyond it
+    float lower_f = (float)lower;
+    float upper_f = (float)upper;
+    mLower[i] = lower_f < lower ? std::nextafter(lower_f, std::numeric_limits<float>::infinity()) : lower_f;
+    mUpper[i] = upper_f > upper ? std::nextafter(upper_f, -std::numeric_limits<float>::infinity()) : upper_f;
+}
+
+bool ActivationTracker::Update(double time, const double* pVoltage, unsigned stride) {
+    // a compile time stride lets the common monodomain case vectorise with contiguous loads
+    if (stride == 1)
+        return UpdateStrided<1>(time, pVoltage, 1);
+
+    return UpdateStrided<0>(time, pVoltage, stride);
+}
+
+template<unsigned STRIDE>
+bool ActivationTracker::UpdateStrided(double time, const double* pVoltage, unsigned stride) {
+    const unsigned n = mActive.size();
+    const unsigned step = STRIDE ? STRIDE : stride;
+    const float* p_lower = n ? &mLower[0] : nullptr;
+    const float* p_upper = n ? &mUpper[0] : nullptr;
+
+    bool any_activated = false;
+    for (unsigned base = 0; base < n; base += BLOCK_SIZE) {
+        const unsigned end = std::min(base + BLOCK_SIZE, n);
+
+        unsigned out_of_band = 0;
+        for (unsigned i = base; i < end; i++) {
+            const float v = (float)pVoltage[i*step];
+            out_of_band |= (unsigned)(v >= p_upper[i]) | (unsigned)(v <= p_lower[i]);
+        }
+
+        if (out_of_band) {
+            for (unsigned i = base; i < end; i++) {
+                const float v = (float)pVoltage[i*step];
+                if (v >= p_upper[i] || v <= p_lower[i])
+                    any_activated |= UpdateNode(i, time, pVoltage[i*step]);
+            }
+        }
+    }
+
+    return any_activated;
+}
+
+bool ActivationTracker::UpdateNode(unsigned i, double time, double v) {
+    bool activated = false;
+    float& peak = mCurrentPeak[i];
+
+    if (!mActive[i] && v > mThresholdVoltage) {//activation
+        if (mpJournal)
+            mpJournal->push_back({i, mActivation[i], mPeak[i], mApd[i]});
+        mActive[i] = 1u;
+        mActivation[i] = (float)time;
+        mCount[i]++;
+        peak = (float)v; //reset peak voltage
+        activated = true;
+    }
+    if (mActive[i]) {
+        //update peak
+        if (v > peak)
+            peak = (float)v;
+
+        // APD90, deactivation
+        double apd90_level = peak - (peak - mRestingVoltage) * 0.9;
+        if (v < apd90_level) {
+            if (mpJournal && !activated)
+                mpJournal->push_back({i, mActivation[i], mPeak[i], mApd[i]});
+            mActive[i] = 0u;
+            mPeak[i] = peak;
+            mApd[i] = (float)(time - mActivation[i]);
+        }
+        else {
+            SetBand(i, apd90_level, peak);
+            return activated;
+        }
+    }
+
+    SetBand(i, -std::numeric_limits<double>::infinity(), mThresholdVoltage);
+    return activated;
+}
+
+unsigned ActivationTracker::FindReactivation(const double* pVoltage, unsigned stride, double windowStart) const {
+    const unsigned n = mActive.size();
+    for (unsigned i = 0; i < n; i++) {
+        // activation, and a reactivation within the window (NaN comparison returns false)
+        if (!mActive[i] && pVoltage[i*stride] > mThresholdVoltage && mActivation[i] >= windowStart)
+            return i;
+    }
+
+    return n;
+}
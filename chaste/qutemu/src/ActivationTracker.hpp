@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+
+/** Output values of a node before an update changed them */
+struct ActivationJournalEntry
+{
+    unsigned mIndex;
+    float mActivation;
+    float mPeak;
+    float mApd;
+};
+
+/**
+ * Per-node activation state for ActivationMapOutputModifier, stored as a structure of arrays.
+ *
+ * Each node keeps a voltage band (mLower, mUpper) outside of which its state may change (threshold crossing,
+ * new peak or APD90 repolarisation). Each step makes one branch-free, vectorised pass comparing voltages
+ * against the bands in single precision, and only the nodes which leave their band are updated.
+ */
+class ActivationTracker
+{
+private:
+    double mThresholdVoltage; ///< Activation is measured when voltage rises above this
+    double mRestingVoltage;   ///< Resting potential for APD90 calculation
+
+    std::vector<float> mLower; ///< APD90 level while active, -inf otherwise. Rounded up
+    std::vector<float> mUpper; ///< Current peak while active, threshold otherwise. Rounded down
+
+    std::vector<ActivationJournalEntry>* mpJournal = nullptr; ///< Optional record of output changes, see SetJournal
+
+    void SetBand(unsigned i, double lower, double upper);
+
+    template<unsigned STRIDE>
+    bool UpdateStrided(double time, const double* pVoltage, unsigned stride);
+    bool UpdateNode(unsigned i, double time, double v);
+
+public:
+    std::vector<unsigned> mActive;   ///< 1 if cell was active last timestep, 0 otherwise
+    std::vector<float> mCurrentPeak; ///< Peak value for current activation
+    std::vector<float> mActivation;  ///< Time of most recent activation
+    std::vector<float> mPeak;        ///< Peak voltage of last activation (reset on threshold cross)
+    std::vector<float> mApd;         ///< APD90 of last repolarisation
+    std::vector<unsigned> mCount;    ///< Activations since Resize, not part of the saved state
+
+    ActivationTracker(double thresholdVoltage, double restingVoltage) :
+            mThresholdVoltage(thresholdVoltage),
+            mRestingVoltage(restingVoltage)
+    {}
+
+    /** Resets all nodes to inactive, with NaN outputs */
+    void Resize(unsigned numNodes);
+
+    /** Recomputes the voltage bands after the public state arrays have been restored, eg from a checkpoint */
+    void RestoreBands();
+
+    unsigned GetSize() const { return mActive.size(); }
+
+    /**
+     * When set, the previous outputs (mActivation, mPeak, mApd) of every node changed by Update are appended,
+     * so the state at an earlier step can be reconstructed. NULL to disable
+     */
+    void SetJournal(std::vector<ActivationJournalEntry>* pJournal) { mpJournal = pJournal; }
+
+    /**
+     * Advances the trackers to time, given voltages pVoltage[i*stride].
+     * @return true if any node activated
+     */
+    bool Update(double time, const double* pVoltage, unsigned stride);
+
+    /**
+     * Finds the first node which activates at this step and already activated at or after windowStart.
+     * @return the local index, or GetSize() if there is none
+     */
+    unsigned FindReactivation(const double* pVoltage, unsigned stride, double windowStart) const;
+};
@@ -0,0 +1,153 @@
+#include <set>
+#include <vector>
+
+#include "AtrialCellModels.hpp"
+#include "Exception.hpp"
+#include "QutemuTrace.hpp"
+
+int ParseCellModel(const std::string& rName) {
+    if (rName == "maleckar")
+        return MALECKAR;
+    if (rName == "maleckar_caf")
+        return MALECKAR_CAF;
+    if (rName == "maleckar_anna")
+        return MALECKAR_ANNA;
+    if (rName == "courtemanche_sr")
+        return COURTEMANCHE_SR;
+    if (rName == "courtemanche_caf")
+        return COURTEMANCHE_CAF;
+
+    EXCEPTION("Unknown Cell Model: " << rName);
+}
+
+CellSolver ParseCellSolver(const std::string& rName) {
+    if (rName == "cvode")
+        return CVODE;
+    if (rName == "rush_larsen")
+        return RUSH_LARSEN;
+    if (rName == "grl1")
+        return GRL1;
+#ifdef QUTEMU_BACKWARD_EULER
+    if (rName == "backward_euler")
+        return BACKWARD_EULER;
+#else
+    if (rName == "backward_euler")
+        EXCEPTION("The backward_euler solver needs qutemu built with -DQUTEMU_BACKWARD_EULER=ON");
+#endif
+    if (rName == "batched_rl")
+        return BATCHED_RUSH_LARSEN;
+
+    EXCEPTION("Unknown Cell Solver: " << rName);
+}
+
+std::string GetCellSolverName(CellSolver solver) {
+    switch (solver) {
+        case CVODE:
+            return "cvode";
+        case RUSH_LARSEN:
+            return "rush_larsen";
+        case GRL1:
+            return "grl1";
+#ifdef QUTEMU_BACKWARD_EULER
+        case BACKWARD_EULER:
+            return "backward_euler";
+#endif
+        case BATCHED_RUSH_LARSEN:
+            return "batched_rl";
+    }
+    EXCEPTION("Unknown Cell Solver " << (int)solver);
+}
+
+/** Creates the cells unwrapped, for CreateAtrialCell */
+struct PlainCellFactory
+{
+    boost::shared_ptr<AbstractIvpOdeSolver> mpSolver;
+
+    template<class CELL>
+    AbstractCardiacCellInterface* CreateCell(boost::shared_ptr<AbstractStimulusFunction> pStimulus) {
+        return new CELL(mpSolver, pStimulus);
+    }
+};
+
+CourtemancheBatch::Parameters GetBatchParameters(int cellModel) {
+    switch (cellModel) {
+        case COURTEMANCHE_SR:
+            return CourtemancheBatch::Parameters::SinusRhythm();
+        case COURTEMANCHE_CAF:
+            return CourtemancheBatch::Parameters::ChronicAf();
+    }
+    EXCEPTION("The batched_rl solver is only available for courtemanche_sr and courtemanche_caf");
+}
+
+AbstractCardiacCellInterface* CreateAtrialCell(int cellModel, CellSolver solver, bool rightAtrium,
+                                               boost::shared_ptr<AbstractIvpOdeSolver> pSolver,
+                                               boost::shared_ptr<AbstractStimulusFunction> pStimulus) {
+    PlainCellFactory factory = {pSolver};
+    return CreateAtrialCell(cellModel, solver, rightAtrium, factory, pStimulus);
+}
+
+/** Lookup tables of a backend, through a throwaway cell */
+template<class CELL>
+static AbstractLookupTableCollection* GetLookupTables() {
+    boost::shared_ptr<AbstractIvpOdeSolver> no_solver;
+    boost::shared_ptr<AbstractStimulusFunction> no_stim;
+    return CELL(no_solver, no_stim).GetLookupTableCollection();
+}
+
+template<class BACKENDS>
+static AbstractLookupTableCollection* GetLookupTables(CellSolver solver) {
+    switch (solver) {
+        case RUSH_LARSEN:
+            return GetLookupTables<typename BACKENDS::RushLarsen>();
+        case GRL1:
+            return GetLookupTables<typename BACKENDS::Grl1>();
+#ifdef QUTEMU_BACKWARD_EULER
+        case BACKWARD_EULER:
+            return GetLookupTables<typename BACKENDS::BackwardEuler>();
+#endif
+        default:
+            return GetLookupTables<typename BACKENDS::Cvode>();
+    }
+}
+
+void OverrideVoltageLookupRange(int cellModel, CellSolver solver) {
+    TRACE_SCOPE("OverrideVoltageLookupRange");
+    if (solver == BATCHED_RUSH_LARSEN)
+        return;
+
+    static std::set<std::pair<std::pair<int, int>, double> > generated; // by model, solver and table minimum
+    const double min_voltage = -150.0001;
+
+    // left and right atrial variants of MALECKAR_ANNA, keyed apart from the other models
+    std::vector<std::pair<int, AbstractLookupTableCollection*> > tables;
+    switch (cellModel) {
+        case MALECKAR:
+            tables.push_back({MALECKAR, GetLookupTables<MaleckarBackends>(solver)});
+            break;
+        case MALECKAR_CAF:
+            tables.push_back({MALECKAR_CAF, GetLookupTables<MaleckarCafBackends>(solver)});
+            break;
+        case MALECKAR_ANNA:
+            tables.push_back({MALECKAR_ANNA, GetLookupTables<MaleckarLaBackends>(solver)});
+            tables.push_back({-MALECKAR_ANNA, GetLookupTables<MaleckarRaBackends>(solver)});
+            break;
+        case COURTEMANCHE_SR:
+            tables.push_back({COURTEMANCHE_SR, GetLookupTables<CourtemancheSrBackends>(solver)});
+            break;
+        case COURTEMANCHE_CAF:
+            tables.push_back({COURTEMANCHE_CAF, GetLookupTables<CourtemancheCafBackends>(solver)});
+            break;
+    }
+
+    for (auto& r_entry : tables) {
+        if (!generated.insert(std::make_pair(std::make_pair(r_entry.first, (int)solver), min_voltage)).second)
+            continue;
+
+        AbstractLookupTableCollection *p_tables = r_entry.second;
+        double min, step, max;
+        p_tables->GetTableProperties("membrane__V", min, step, max);
+        min = min_voltage;
+        p_tables->SetTableProperties("membrane__V", min, step, max);
+        p_tables->RegenerateTables();
+    }
+}
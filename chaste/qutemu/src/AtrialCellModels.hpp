@@ -0,0 +1,158 @@
+#pragma once
+
+#include <string>
+
+#include "CourtemancheBatch.hpp"
+#include "Exception.hpp"
+
+#include "Maleckar2008_baseCvodeOpt.hpp"
+#include "Maleckar2008_cAFCvodeOpt.hpp"
+#include "Maleckar2008_LA_1h2HzCvodeOpt.hpp"
+#include "Maleckar2008_RA_1h2HzCvodeOpt.hpp"
+#include "courtemanche_ramirez_nattel_1998_SRCvodeOpt.hpp"
+#include "courtemanche_ramirez_nattel_1998_cAFCvodeOpt.hpp"
+
+#include "Maleckar2008_baseRushLarsenOpt.hpp"
+#include "Maleckar2008_cAFRushLarsenOpt.hpp"
+#include "Maleckar2008_LA_1h2HzRushLarsenOpt.hpp"
+#include "Maleckar2008_RA_1h2HzRushLarsenOpt.hpp"
+#include "courtemanche_ramirez_nattel_1998_SRRushLarsenOpt.hpp"
+#include "courtemanche_ramirez_nattel_1998_cAFRushLarsenOpt.hpp"
+
+#include "Maleckar2008_baseGRL1Opt.hpp"
+#include "Maleckar2008_cAFGRL1Opt.hpp"
+#include "Maleckar2008_LA_1h2HzGRL1Opt.hpp"
+#include "Maleckar2008_RA_1h2HzGRL1Opt.hpp"
+#include "courtemanche_ramirez_nattel_1998_SRGRL1Opt.hpp"
+#include "courtemanche_ramirez_nattel_1998_cAFGRL1Opt.hpp"
+
+#ifdef QUTEMU_BACKWARD_EULER
+#include "Maleckar2008_baseBackwardEulerOpt.hpp"
+#include "Maleckar2008_cAFBackwardEulerOpt.hpp"
+#include "Maleckar2008_LA_1h2HzBackwardEulerOpt.hpp"
+#include "Maleckar2008_RA_1h2HzBackwardEulerOpt.hpp"
+#include "courtemanche_ramirez_nattel_1998_SRBackwardEulerOpt.hpp"
+#include "courtemanche_ramirez_nattel_1998_cAFBackwardEulerOpt.hpp"
+#endif
+
+enum CellModel
+{
+    MALECKAR,
+    MALECKAR_CAF,
+    MALECKAR_ANNA,
+    COURTEMANCHE_SR,
+    COURTEMANCHE_CAF
+};
+
+/** Integration scheme of the cells, the atrial models are generated with a backend for each (see CMakeLists.txt) */
+enum CellSolver
+{
+    CVODE,         ///< Adaptive, with the ODE timestep as the maximum step
+    RUSH_LARSEN,   ///< Fixed step, exponential update of the gates and forward Euler for the rest
+    GRL1,          ///< Fixed step, generalised Rush-Larsen, exponential update of every variable linearised about the step start
+#ifdef QUTEMU_BACKWARD_EULER
+    BACKWARD_EULER, ///< Fixed step, implicit, Newton iteration on the nonlinear variables. Needs -DQUTEMU_BACKWARD_EULER=ON
+#endif
+    BATCHED_RUSH_LARSEN ///< Fixed step Rush-Larsen over groups of cells at once, Courtemanche only, see CourtemancheBatch
+};
+
+/** The generated classes of one cell model, by CellSolver */
+#ifdef QUTEMU_BACKWARD_EULER
+template<class CVODE_CELL, class RUSH_LARSEN_CELL, class GRL1_CELL, class BACKWARD_EULER_CELL>
+struct CellBackends
+{
+    typedef CVODE_CELL Cvode;
+    typedef RUSH_LARSEN_CELL RushLarsen;
+    typedef GRL1_CELL Grl1;
+    typedef BACKWARD_EULER_CELL BackwardEuler;
+};
+
+#define ATRIAL_CELL_BACKENDS(MODEL) CellBackends<Cell##MODEL##FromCellMLCvodeOpt, Cell##MODEL##FromCellMLRushLarsenOpt, \
+        Cell##MODEL##FromCellMLGRL1Opt, Cell##MODEL##FromCellMLBackwardEulerOpt>
+#else
+template<class CVODE_CELL, class RUSH_LARSEN_CELL, class GRL1_CELL>
+struct CellBackends
+{
+    typedef CVODE_CELL Cvode;
+    typedef RUSH_LARSEN_CELL RushLarsen;
+    typedef GRL1_CELL Grl1;
+};
+
+#define ATRIAL_CELL_BACKENDS(MODEL) CellBackends<Cell##MODEL##FromCellMLCvodeOpt, Cell##MODEL##FromCellMLRushLarsenOpt, \
+        Cell##MODEL##FromCellMLGRL1Opt>
+#endif
+
+typedef ATRIAL_CELL_BACKENDS(Maleckar2008_base) MaleckarBackends;
+typedef ATRIAL_CELL_BACKENDS(Maleckar2008_cAF) MaleckarCafBackends;
+typedef ATRIAL_CELL_BACKENDS(Maleckar2008_LA_1h2Hz) MaleckarLaBackends;
+typedef ATRIAL_CELL_BACKENDS(Maleckar2008_RA_1h2Hz) MaleckarRaBackends;
+typedef ATRIAL_CELL_BACKENDS(courtemanche_ramirez_nattel_1998_SR) CourtemancheSrBackends;
+typedef ATRIAL_CELL_BACKENDS(courtemanche_ramirez_nattel_1998_cAF) CourtemancheCafBackends;
+
+/** CellModel of a -cell name */
+int ParseCellModel(const std::string& rName);
+
+/** CellSolver of a -solver name */
+CellSolver ParseCellSolver(const std::string& rName);
+
+std::string GetCellSolverName(CellSolver solver);
+
+/** Parameters of a CourtemancheBatch of cellModel, for BATCHED_RUSH_LARSEN */
+CourtemancheBatch::Parameters GetBatchParameters(int cellModel);
+
+/** rFactory.CreateCell<CELL>(pStimulus) of the solver backend of BACKENDS */
+template<class BACKENDS, class FACTORY>
+AbstractCardiacCellInterface* CreateBackend(CellSolver solver, FACTORY& rFactory, boost::shared_ptr<AbstractStimulusFunction> pStimulus) {
+    switch (solver) {
+        case RUSH_LARSEN:
+            return rFactory.template CreateCell<typename BACKENDS::RushLarsen>(pStimulus);
+        case GRL1:
+            return rFactory.template CreateCell<typename BACKENDS::Grl1>(pStimulus);
+#ifdef QUTEMU_BACKWARD_EULER
+        case BACKWARD_EULER:
+            return rFactory.template CreateCell<typename BACKENDS::BackwardEuler>(pStimulus);
+#endif
+        default:
+            return rFactory.template CreateCell<typename BACKENDS::Cvode>(pStimulus);
+    }
+}
+
+/**
+ * A cell of cellModel with the solver backend, the left atrial variant of MALECKAR_ANNA unless rightAtrium, created
+ * by rFactory.CreateCell<CELL>(pStimulus) so factories can wrap it. Not for BATCHED_RUSH_LARSEN, which needs a batch
+ * shared by the cells
+ */
+template<class FACTORY>
+AbstractCardiacCellInterface* CreateAtrialCell(int cellModel, CellSolver solver, bool rightAtrium, FACTORY& rFactory,
+                                               boost::shared_ptr<AbstractStimulusFunction> pStimulus) {
+    if (solver == BATCHED_RUSH_LARSEN)
+        EXCEPTION("Batched cells are created by AtrialCellFactory");
+
+    switch (cellModel) {
+        case MALECKAR:
+            return CreateBackend<MaleckarBackends>(solver, rFactory, pStimulus);
+        case MALECKAR_CAF:
+            return CreateBackend<MaleckarCafBackends>(solver, rFactory, pStimulus);
+        case MALECKAR_ANNA:
+            if (rightAtrium)
+                return CreateBackend<MaleckarRaBackends>(solver, rFactory, pStimulus);
+            return CreateBackend<MaleckarLaBackends>(solver, rFactory, pStimulus);
+        case COURTEMANCHE_SR:
+            return CreateBackend<CourtemancheSrBackends>(solver, rFactory, pStimulus);
+        case COURTEMANCHE_CAF:
+            return CreateBackend<CourtemancheCafBackends>(solver, rFactory, pStimulus);
+    }
+    EXCEPTION("Unknown Cell Model " << cellModel);
+}
+
+/** CreateAtrialCell of the unwrapped cell, for the benchmarks and throwaway cells */
+AbstractCardiacCellInterface* CreateAtrialCell(int cellModel, CellSolver solver, bool rightAtrium,
+                                               boost::shared_ptr<AbstractIvpOdeSolver> pSolver,
+                                               boost::shared_ptr<AbstractStimulusFunction> pStimulus);
+
+/**
+ * Extends the voltage lookup range of the backend of each model cellModel uses. Only those tables are regenerated,
+ * and the tables are static, so ensemble members only regenerate a backend's tables the first time it is used.
+ * BATCHED_RUSH_LARSEN has no tables
+ */
+void OverrideVoltageLookupRange(int cellModel, CellSolver solver);
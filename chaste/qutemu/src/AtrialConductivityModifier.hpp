@@ -0,0 +1,156 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "AbstractConductivityModifier.hpp"
+#include "AbstractTetrahedralMesh.hpp"
+#include "ConductivityReader.hpp"
+#include "QutemuTrace.hpp"
+#include "TissueConductivityTable.hpp"
+
+/**
+ * Conductivities from the tissue class of each element (first element attribute), scaled by optional
+ * per-element multipliers. Tensors are cached per local element by BuildTensorCache
+ */
+template<unsigned DIM>
+class AtrialConductivityModifier : public AbstractConductivityModifier<DIM,DIM>
+{
+private:
+	
+    c_matrix<double,DIM,DIM> mTensor;
+    AbstractTetrahedralMesh<DIM,DIM>* pMesh;
+    std::vector<unsigned> mElementIndices; ///< Global indices of the local (owned and halo) elements, ascending
+    std::vector<float> conductivities;     ///< Multipliers of the local elements, in mElementIndices order. Empty if unused
+    unsigned mCursor;                      ///< Last local index looked up, elements are usually visited in order
+
+    /** Cached tensor diagonal. mLongitudinal is NaN for the original tensor scaled by mTransverse */
+    struct ElementDiagonal
+    {
+        double mLongitudinal;
+        double mTransverse;
+    };
+    std::vector<ElementDiagonal> mDiagonals; ///< In mElementIndices order
+    
+public:
+    AtrialConductivityModifier() :
+            AbstractConductivityModifier<DIM,DIM>(),
+            mTensor(zero_matrix<double>(DIM,DIM)),
+            pMesh(NULL),
+            mCursor(0)
+    {
+    }
+
+    void SetMesh(AbstractTetrahedralMesh<DIM,DIM>* mesh) {
+        pMesh = mesh;
+        mElementIndices.clear();
+        for (typename AbstractTetrahedralMesh<DIM,DIM>::ElementIterator iter = mesh->GetElementIteratorBegin();
+             iter != mesh->GetElementIteratorEnd(); ++iter)
+            mElementIndices.push_back(iter->GetIndex());
+
+        std::sort(mElementIndices.begin(), mElementIndices.end());
+        conductivities.clear();
+        mCursor = 0;
+    }
+
+    /** Reads the multipliers of the local elements only. Collective */
+    void LoadConductivities(const FileFinder& rFile) {
+        conductivities = ConductivityReader::ReadConductivities(rFile, mElementIndices);
+    }
+
+    const std::vector<unsigned>& rGetElementIndices() const {
+        return mElementIndices;
+    }
+
+    /** Local multipliers, assign mElementIndices.size() entries to enable */
+    std::vector<float>& rGetConductivities() {
+        return conductivities;
+    }
+
+    unsigned GetLocalIndex(unsigned elementIndex) {
+        if (mCursor + 1 < mElementIndices.size() && mElementIndices[mCursor + 1] == elementIndex)
+            return ++mCursor;
+        if (mCursor < mElementIndices.size() && mElementIndices[mCursor] == elementIndex)
+            return mCursor;
+
+        std::vector<unsigned>::const_iterator it = std::lower_bound(mElementIndices.begin(), mElementIndices.end(), elementIndex);
+        if (it == mElementIndices.end() || *it != elementIndex)
+            EXCEPTION("Element " << elementIndex << " is not local to this process");
+
+        mCursor = it - mElementIndices.begin();
+        return mCursor;
+    }
+
+    /**
+     * Caches the diagonal tensor of every local element, so assembly does no mesh access or class lookup.
+     * Call after the multipliers are final. Elements without a tissue class keep the original tensor
+     */
+    void BuildTensorCache(const TissueConductivityTable& rTable) {
+        TRACE_SCOPE("BuildTensorCache");
+        mDiagonals.resize(mElementIndices.size());
+        for (unsigned i = 0; i < mElementIndices.size(); i++) {
+            Element<DIM, DIM> *ele = pMesh->GetElement(mElementIndices[i]);
+            float multiplier = conductivities.empty() ? 1.0f : conductivities[i];
+            if (ele->GetNumElementAttributes() == 0) {
+                mDiagonals[i].mLongitudinal = std::numeric_limits<double>::quiet_NaN();
+                mDiagonals[i].mTransverse = multiplier;
+                continue;
+            }
+
+            unsigned tissue_class = (unsigned)ele->rGetElementAttributes()[0];
+            if (!rTable.IsDefined(tissue_class))
+                EXCEPTION("Unknown tissue class " << tissue_class << " at " << mElementIndices[i]);
+
+            mDiagonals[i].mLongitudinal = rTable.GetLongitudinal(tissue_class) * multiplier;
+            mDiagonals[i].mTransverse = rTable.GetTransverse(tissue_class) * multiplier;
+        }
+    }
+    
+    /**
+     * Owned nodes whose elements all have zero conductivity (a multiplier of 0, or a tissue class with zero
+     * conductivity), ascending. They are electrically isolated, see -passive_isolated. Call after BuildTensorCache.
+     * Every element of an owned node is local
+     */
+    std::vector<unsigned> GetIsolatedNodes() {
+        DistributedVectorFactory* p_factory = pMesh->GetDistributedVectorFactory();
+        const unsigned low = p_factory->GetLow();
+        std::vector<bool> connected(p_factory->GetLocalOwnership(), false);
+        for (unsigned i = 0; i < mElementIndices.size(); i++) {
+            const ElementDiagonal& diag = mDiagonals[i];
+            if (diag.mTransverse == 0 && (std::isnan(diag.mLongitudinal) || diag.mLongitudinal == 0))
+                continue;
+
+            Element<DIM, DIM> *ele = pMesh->GetElement(mElementIndices[i]);
+            for (unsigned n = 0; n < ele->GetNumNodes(); n++) {
+                unsigned node = ele->GetNodeGlobalIndex(n);
+                if (p_factory->IsGlobalIndexLocal(node))
+                    connected[node - low] = true;
+            }
+        }
+
+        std::vector<unsigned> isolated;
+        for (unsigned i = 0; i < connected.size(); i++)
+            if (!connected[i])
+                isolated.push_back(low + i);
+
+        return isolated;
+    }
+
+    c_matrix<double,DIM,DIM>& rCalculateModifiedConductivityTensor(unsigned elementIndex, const c_matrix<double,DIM,DIM>& rOriginalConductivity, unsigned domainIndex)
+    {
+        const ElementDiagonal& diag = mDiagonals[GetLocalIndex(elementIndex)];
+        if (std::isnan(diag.mLongitudinal)) {
+            mTensor.assign(rOriginalConductivity * diag.mTransverse);
+            return mTensor;
+        }
+
+        mTensor.clear();
+        mTensor(0,0) = diag.mLongitudinal;
+        for (unsigned i = 1; i < DIM; i++)
+            mTensor(i, i) = diag.mTransverse;
+
+        return mTensor;
+    }
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <boost/shared_ptr.hpp>
+
+#include "AbstractCardiacCellInterface.hpp"
+#include "CourtemancheBatch.hpp"
+#include "Exception.hpp"
+
+/**
+ * The tissue's view of one lane of a CourtemancheBatch. The tissue sets the voltage and solves each of its cells in
+ * turn, the batch integrates a whole group when its last lane is solved (see there).
+ *
+ * There are no parameters or derived quantities to expose, and the cells are not archived
+ */
+class BatchedCell : public AbstractCardiacCellInterface
+{
+private:
+    boost::shared_ptr<CourtemancheBatch> mpBatch;
+    unsigned mLane;
+
+public:
+    BatchedCell(boost::shared_ptr<AbstractIvpOdeSolver> pSolver, boost::shared_ptr<AbstractStimulusFunction> pStimulus,
+                boost::shared_ptr<CourtemancheBatch> pBatch, unsigned globalIndex) :
+            AbstractCardiacCellInterface(pSolver, CourtemancheBatch::VOLTAGE, pStimulus),
+            mpBatch(pBatch),
+            mLane(pBatch->AddCell(globalIndex))
+    {}
+
+    void SetVoltage(double voltage) {
+        mpBatch->SetVoltage(mLane, voltage);
+    }
+
+    double GetVoltage() {
+        return mpBatch->GetVoltage(mLane);
+    }
+
+    /** The batch steps with the ODE timestep it was created with */
+    void SetTimestep(double dt) {}
+
+    /** Only used with operator splitting, which needs the cell to update its voltage */
+    void SolveAndUpdateState(double tStart, double tEnd) {
+        EXCEPTION("Batched cells hold the voltage over a step and can not be used with operator splitting");
+    }
+
+    OdeSolution Compute(double tStart, double tEnd, double tSamp=0.0) {
+        EXCEPTION("Batched cells can only be solved in tissue");
+    }
+
+    /** How the tissue solves its cells, the batch already holds the voltage over the step */
+    void ComputeExceptVoltage(double tStart, double tEnd) {
+        mpBatch->Solve(mLane, tStart, tEnd);
+    }
+
+    /** Only of the current state of the lane */
+    double GetIIonic(const std::vector<double>* pStateVariables=NULL) {
+        if (pStateVariables)
+            EXCEPTION("Batched cells can not evaluate the ionic current of another state");
+        return mpBatch->GetIIonic(mLane);
+    }
+
+    unsigned GetNumberOfStateVariables() const {
+        return CourtemancheBatch::NUM_STATE_VARIABLES;
+    }
+
+    unsigned GetNumberOfParameters() const {
+        return 0;
+    }
+
+    std::vector<double> GetStdVecStateVariables() {
+        return mpBatch->GetStateVariables(mLane);
+    }
+
+    const std::vector<std::string>& rGetStateVariableNames() const {
+        return CourtemancheBatch::rGetStateVariableNames();
+    }
+
+    void SetStateVariables(const std::vector<double>& rVariables) {
+        mpBatch->SetStateVariables(mLane, rVariables);
+    }
+
+    void SetStateVariable(unsigned index, double newValue) {
+        if (index >= CourtemancheBatch::NUM_STATE_VARIABLES)
+            EXCEPTION("No state variable " << index);
+        mpBatch->SetStateVariable(mLane, index, newValue);
+    }
+
+    void SetStateVariable(const std::string& rName, double newValue) {
+        const std::vector<std::string>& r_names = CourtemancheBatch::rGetStateVariableNames();
+        SetStateVariable(std::find(r_names.begin(), r_names.end(), rName) - r_names.begin(), newValue);
+    }
+
+    double GetAnyVariable(const std::string& rName, double time=0.0) {
+        const std::vector<std::string>& r_names = CourtemancheBatch::rGetStateVariableNames();
+        unsigned index = std::find(r_names.begin(), r_names.end(), rName) - r_names.begin();
+        if (index >= CourtemancheBatch::NUM_STATE_VARIABLES)
+            EXCEPTION("No variable " << rName << " in batched cells");
+        return mpBatch->GetStateVariables(mLane)[index];
+    }
+
+    double GetParameter(const std::string& rParameterName) {
+        EXCEPTION("Batched cells have no parameters");
+    }
+
+    double GetParameter(unsigned parameterIndex) {
+        EXCEPTION("Batched cells have no parameters");
+    }
+
+    void SetParameter(const std::string& rParameterName, double value) {
+        EXCEPTION("Batched cells have no parameters");
+    }
+};
@@ -0,0 +1,220 @@
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <vector>
+
+#include "BinaryMeshCache.hpp"
+#include "BinaryMeshReader.hpp"
+#include "TrianglesMeshReader.hpp"
+#include "Exception.hpp"
+#include "FileFinder.hpp"
+#include "PetscTools.hpp"
+
+static const char MAGIC[8] = "QMESH01";
+
+std::string BinaryMeshCache::GetCacheName(const std::string& rMeshFile, const std::string& rCacheDir) {
+    if (rCacheDir.empty())
+        return rMeshFile + ".qmesh";
+
+    std::string base = rMeshFile.substr(rMeshFile.find_last_of('/') + 1);
+    return rCacheDir + "/" + base + ".qmesh";
+}
+
+uint64_t BinaryMeshCache::GetSourceStamp(const std::string& rMeshFile) {
+    const char* extensions[] = {".node", ".ele", ".face", ".ortho"};
+    uint64_t stamp = 1469598103934665603ULL;
+    bool found = false;
+    for (const char* ext : extensions) {
+        struct stat st;
+        std::string path = FileFinder(rMeshFile + ext, RelativeTo::AbsoluteOrCwd).GetAbsolutePath();
+        if (stat(path.c_str(), &st) != 0)
+            continue;
+
+        found = true;
+        uint64_t values[3] = {(uint64_t)st.st_size, (uint64_t)st.st_mtime, (uint64_t)strlen(ext)};
+        stamp = (stamp ^ Checksum((const char*)values, sizeof(values))) * 1099511628211ULL;
+    }
+
+    return found ? stamp : 0;
+}
+
+uint64_t BinaryMeshCache::Checksum(const char* pData, size_t size) {
+    // FNV-1a over 8 byte words, with the tail bytes folded in
+    uint64_t hash = 1469598103934665603ULL;
+    size_t words = size / 8;
+    for (size_t i = 0; i < words; i++) {
+        uint64_t w;
+        memcpy(&w, pData + 8*i, 8);
+        hash = (hash ^ w) * 1099511628211ULL;
+    }
+    for (size_t i = words * 8; i < size; i++)
+        hash = (hash ^ (unsigned char)pData[i]) * 1099511628211ULL;
+
+    return hash;
+}
+
+bool BinaryMeshCache::ReadHeader(const std::string& rCacheName, BinaryMeshHeader& rHeader) {
+    std::ifstream file(FileFinder(rCacheName, RelativeTo::AbsoluteOrCwd).GetAbsolutePath().c_str(), std::ios::binary);
+    if (!file.read((char*)&rHeader, sizeof(rHeader)))
+        return false;
+
+    return memcmp(rHeader.mMagic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+bool BinaryMeshCache::Verify(const std::string& rCacheName, uint64_t sourceStamp) {
+    BinaryMeshHeader header;
+    if (!ReadHeader(rCacheName, header))
+        return false;
+
+    // a cache without its text mesh is used as is
+    if (sourceStamp != 0 && header.mSourceStamp != sourceStamp)
+        return false;
+
+    std::ifstream file(FileFinder(rCacheName, RelativeTo::AbsoluteOrCwd).GetAbsolutePath().c_str(), std::ios::binary);
+    std::vector<char> payload(header.mPayloadSize);
+    file.seekg(sizeof(header));
+    if (header.mPayloadSize + sizeof(header) != header.TotalSize() || !file.read(payload.data(), payload.size()))
+        return false;
+
+    return Checksum(payload.data(), payload.size()) == header.mChecksum;
+}
+
+template<unsigned DIM>
+void BinaryMeshCache::Write(const std::string& rMeshFile, const std::string& rCacheName) {
+    TrianglesMeshReader<DIM,DIM> reader(rMeshFile);
+
+    BinaryMeshHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.mMagic, MAGIC, sizeof(MAGIC));
+    header.mDimension = DIM;
+    header.mNumNodes = reader.GetNumNodes();
+    header.mNumElements = reader.GetNumElements();
+    header.mNumFaces = reader.GetNumFaces();
+    header.mNumElementAttributes = reader.GetNumElementAttributes() > 0 ? 1 : 0;
+    header.mSourceStamp = GetSourceStamp(rMeshFile);
+
+    std::vector<double> coords, node_attributes, element_attributes;
+    std::vector<uint32_t> elements, faces;
+    coords.reserve(header.mNumNodes * DIM);
+    for (unsigned i = 0; i < header.mNumNodes; i++) {
+        std::vector<double> node = reader.GetNextNode();
+        std::vector<double> attributes = reader.GetNodeAttributes();
+        if (i == 0)
+            header.mNumNodeAttributes = attributes.size();
+        if (attributes.size() != header.mNumNodeAttributes)
+            EXCEPTION("Node " << i << " of " << rMeshFile << " has " << attributes.size() << " attributes, expected " << header.mNumNodeAttributes);
+
+        coords.insert(coords.end(), node.begin(), node.begin() + DIM);
+        node_attributes.insert(node_attributes.end(), attributes.begin(), attributes.end());
+    }
+
+    for (unsigned i = 0; i < header.mNumElements; i++) {
+        ElementData data = reader.GetNextElementData();
+        elements.insert(elements.end(), data.NodeIndices.begin(), data.NodeIndices.end());
+        if (header.mNumElementAttributes)
+            element_attributes.push_back(data.AttributeValue);
+    }
+
+    for (unsigned i = 0; i < header.mNumFaces; i++) {
+        ElementData data = reader.GetNextFaceData();
+        faces.insert(faces.end(), data.NodeIndices.begin(), data.NodeIndices.end());
+    }
+
+    if (elements.size() != header.mNumElements * (DIM + 1) || faces.size() != header.mNumFaces * DIM)
+        EXCEPTION("Only linear meshes can be cached, " << rMeshFile << " is not");
+
+    std::vector<char> payload;
+    auto append = [&payload](const void* p, size_t bytes) {
+        payload.insert(payload.end(), (const char*)p, (const char*)p + bytes);
+    };
+    append(coords.data(), coords.size() * sizeof(double));
+    append(node_attributes.data(), node_attributes.size() * sizeof(double));
+    append(element_attributes.data(), element_attributes.size() * sizeof(double));
+    append(elements.data(), elements.size() * sizeof(uint32_t));
+    append(faces.data(), faces.size() * sizeof(uint32_t));
+    header.mPayloadSize = payload.size();
+    header.mChecksum = Checksum(payload.data(), payload.size());
+
+    // write to a temporary and rename, so an interrupted write never looks like a cache
+    std::string path = FileFinder(rCacheName, RelativeTo::AbsoluteOrCwd).GetAbsolutePath();
+    std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream os(tmp_path.c_str(), std::ios::binary | std::ios::trunc);
+        os.write((const char*)&header, sizeof(header));
+        os.write(payload.data(), payload.size());
+        if (!os)
+            EXCEPTION("Failed to write mesh cache " << tmp_path);
+    }
+
+    // fibres as a Chaste binary fibre file, each line of the text file is DIM*DIM doubles
+    FileFinder ortho(rMeshFile + ".ortho", RelativeTo::AbsoluteOrCwd);
+    if (ortho.IsFile()) {
+        std::ifstream is(ortho.GetAbsolutePath().c_str());
+        std::vector<double> fibres;
+        std::string line;
+        unsigned num_lines = 0;
+        bool header_read = false;
+        while (std::getline(is, line)) {
+            line = line.substr(0, line.find('#'));
+            if (line.find_first_not_of(" \t\r") == std::string::npos)
+                continue;
+
+            std::stringstream ss(line);
+            if (!header_read) {
+                ss >> num_lines;
+                header_read = true;
+                continue;
+            }
+
+            double value;
+            while (ss >> value)
+                fibres.push_back(value);
+        }
+
+        if (fibres.size() != (size_t)num_lines * DIM * DIM || num_lines != header.mNumElements)
+            EXCEPTION("Fibre file " << ortho.GetAbsolutePath() << " does not have " << DIM*DIM << " values for each of the " << header.mNumElements << " elements");
+
+        std::ofstream os((path + ".ortho").c_str(), std::ios::binary | std::ios::trunc);
+        os << num_lines << "\tBIN\n";
+        os.write((const char*)fibres.data(), fibres.size() * sizeof(double));
+        if (!os)
+            EXCEPTION("Failed to write fibre cache " << path << ".ortho");
+    }
+
+    if (rename(tmp_path.c_str(), path.c_str()) != 0)
+        EXCEPTION("Failed to move mesh cache " << tmp_path << " to " << path);
+}
+
+bool BinaryMeshCache::Update(const std::string& rMeshFile, const std::string& rCacheName) {
+    unsigned rebuilt = 0;
+    std::string error;
+    if (PetscTools::AmMaster()) {
+        try {
+            uint64_t stamp = GetSourceStamp(rMeshFile);
+            if (!Verify(rCacheName, stamp)) {
+                if (stamp == 0)
+                    EXCEPTION("No mesh cache or text mesh found for " << rMeshFile);
+
+                std::ifstream node_file(FileFinder(rMeshFile + ".node", RelativeTo::AbsoluteOrCwd).GetAbsolutePath().c_str());
+                unsigned num_nodes = 0, dimension = 0;
+                node_file >> num_nodes >> dimension;
+                if (dimension == 2)
+                    Write<2>(rMeshFile, rCacheName);
+                else
+                    Write<3>(rMeshFile, rCacheName);
+                rebuilt = 1;
+            }
+        }
+        catch (const Exception& e) {
+            error = e.GetMessage();
+            rebuilt = 2;
+        }
+    }
+
+    MPI_Bcast(&rebuilt, 1, MPI_UNSIGNED, 0, PETSC_COMM_WORLD);
+    if (rebuilt == 2)
+        EXCEPTION("Failed to build mesh cache " << rCacheName << (error.empty() ? "" : ": " + error));
+
+    return rebuilt == 1;
+}
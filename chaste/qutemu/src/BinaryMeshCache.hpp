@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/**
+ * Fixed size header of a binary mesh cache (.qmesh), followed by the arrays
+ *  coordinates         double[numNodes][dim]
+ *  node attributes     double[numNodes][numNodeAttributes]
+ *  element attributes  double[numElements][numElementAttributes]
+ *  elements            uint32[numElements][dim+1]
+ *  faces               uint32[numFaces][dim]
+ */
+struct BinaryMeshHeader
+{
+    char mMagic[8];                 ///< "QMESH01\0"
+    uint32_t mDimension;
+    uint32_t mNumNodes;
+    uint32_t mNumElements;
+    uint32_t mNumFaces;
+    uint32_t mNumNodeAttributes;
+    uint32_t mNumElementAttributes; ///< 0 or 1 (tissue class)
+    uint64_t mSourceStamp;          ///< Hash of the sizes and modification times of the text mesh files
+    uint64_t mChecksum;             ///< FNV-1a of everything after the header
+    uint64_t mPayloadSize;
+    uint8_t mPadding[64];
+
+    size_t CoordinatesOffset() const { return sizeof(BinaryMeshHeader); }
+    size_t NodeAttributesOffset() const { return CoordinatesOffset() + sizeof(double) * mNumNodes * mDimension; }
+    size_t ElementAttributesOffset() const { return NodeAttributesOffset() + sizeof(double) * mNumNodes * mNumNodeAttributes; }
+    size_t ElementsOffset() const { return ElementAttributesOffset() + sizeof(double) * mNumElements * mNumElementAttributes; }
+    size_t FacesOffset() const { return ElementsOffset() + sizeof(uint32_t) * mNumElements * (mDimension + 1); }
+    size_t TotalSize() const { return FacesOffset() + sizeof(uint32_t) * mNumFaces * mDimension; }
+};
+
+/**
+ * Converts a tetgen/triangle text mesh (.node, .ele, .face and optional .ortho) into a binary cache
+ * which BinaryMeshReader memory maps. Fibres are written as a Chaste binary .ortho next to the cache,
+ * so the cache name can be given to HeartConfig::SetMeshFileName for fibre loading.
+ */
+class BinaryMeshCache
+{
+public:
+    /** The cache mesh name for meshfile (without extension), in cacheDir or next to the mesh if empty */
+    static std::string GetCacheName(const std::string& rMeshFile, const std::string& rCacheDir);
+
+    /** Stamp of the text mesh files, 0 if they don't exist */
+    static uint64_t GetSourceStamp(const std::string& rMeshFile);
+
+    /** Reads the header of a cache, returns false if it is missing or not a cache */
+    static bool ReadHeader(const std::string& rCacheName, BinaryMeshHeader& rHeader);
+
+    /**
+     * Checks the cache exists, matches the text files (if they are present) and the checksum of its contents,
+     * and (re)builds it from the text mesh otherwise. Collective, only the master reads and writes files.
+     * @return true if the cache was rebuilt
+     */
+    static bool Update(const std::string& rMeshFile, const std::string& rCacheName);
+
+    static uint64_t Checksum(const char* pData, size_t size);
+
+private:
+    template<unsigned DIM>
+    static void Write(const std::string& rMeshFile, const std::string& rCacheName);
+    static bool Verify(const std::string& rCacheName, uint64_t sourceStamp);
+};
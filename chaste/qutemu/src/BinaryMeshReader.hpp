@@ -0,0 +1,172 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "AbstractMeshReader.hpp"
+#include "BinaryMeshCache.hpp"
+#include "Exception.hpp"
+#include "FileFinder.hpp"
+
+/**
+ * Reads a mesh cache written by BinaryMeshCache through a memory map. Random access, so each process of a
+ * DistributedTetrahedralMesh only touches the pages of its own nodes and elements.
+ * With a node permutation the nodes are presented in permuted order, see SetNodePermutation
+ */
+template<unsigned DIM>
+class BinaryMeshReader : public AbstractMeshReader<DIM,DIM>
+{
+private:
+    std::string mCacheName;
+    int mFd;
+    const char* mpData;
+    size_t mSize;
+    BinaryMeshHeader mHeader;
+
+    const double* mpCoordinates;
+    const double* mpNodeAttributes;
+    const double* mpElementAttributes;
+    const uint32_t* mpElements;
+    const uint32_t* mpFaces;
+
+    unsigned mNodeCursor;
+    unsigned mElementCursor;
+    unsigned mFaceCursor;
+    unsigned mLastNode; ///< For GetNodeAttributes, file index
+
+    std::vector<unsigned> mPermutation;        ///< Permuted index of each file node, empty for none
+    std::vector<unsigned> mInversePermutation; ///< File index of each permuted node
+
+    std::vector<unsigned> PermuteIndices(const uint32_t* pIndices, unsigned count)
+    {
+        std::vector<unsigned> indices(pIndices, pIndices + count);
+        if (!mPermutation.empty())
+            for (unsigned& r_index : indices)
+                r_index = mPermutation[r_index];
+
+        return indices;
+    }
+
+public:
+    BinaryMeshReader(const std::string& rCacheName) :
+            mCacheName(rCacheName),
+            mNodeCursor(0),
+            mElementCursor(0),
+            mFaceCursor(0),
+            mLastNode(0)
+    {
+        std::string path = FileFinder(rCacheName, RelativeTo::AbsoluteOrCwd).GetAbsolutePath();
+        mFd = open(path.c_str(), O_RDONLY);
+        if (mFd < 0)
+            EXCEPTION("Could not open mesh cache " << path);
+
+        struct stat st;
+        fstat(mFd, &st);
+        mSize = st.st_size;
+        void* p_map = mSize >= sizeof(BinaryMeshHeader) ? mmap(nullptr, mSize, PROT_READ, MAP_SHARED, mFd, 0) : MAP_FAILED;
+        if (p_map == MAP_FAILED) {
+            close(mFd);
+            EXCEPTION("Could not map mesh cache " << path);
+        }
+
+        mpData = (const char*)p_map;
+        mHeader = *(const BinaryMeshHeader*)mpData;
+        if (mHeader.mDimension != DIM || mHeader.TotalSize() != mSize) {
+            munmap(p_map, mSize);
+            close(mFd);
+            EXCEPTION("Mesh cache " << path << " is not a " << DIM << "D cache or is truncated");
+        }
+
+        mpCoordinates = (const double*)(mpData + mHeader.CoordinatesOffset());
+        mpNodeAttributes = (const double*)(mpData + mHeader.NodeAttributesOffset());
+        mpElementAttributes = (const double*)(mpData + mHeader.ElementAttributesOffset());
+        mpElements = (const uint32_t*)(mpData + mHeader.ElementsOffset());
+        mpFaces = (const uint32_t*)(mpData + mHeader.FacesOffset());
+    }
+
+    ~BinaryMeshReader()
+    {
+        munmap((void*)mpData, mSize);
+        close(mFd);
+    }
+
+    unsigned GetNumElements() const { return mHeader.mNumElements; }
+    unsigned GetNumNodes() const { return mHeader.mNumNodes; }
+    unsigned GetNumFaces() const { return mHeader.mNumFaces; }
+    unsigned GetNumElementAttributes() const { return mHeader.mNumElementAttributes; }
+
+    /** The DIM + 1 node indices of each element in file order, not permuted */
+    const uint32_t* GetFileElements() const { return mpElements; }
+
+    std::string GetMeshFileBaseName() { return mCacheName; }
+    bool IsFileFormatBinary() { return true; }
+
+    /**
+     * Presents node perm[i] of the file as node i, and renumbers elements and faces to match. Reading a mesh
+     * that way with a DUMB partition reproduces a partition which had that permutation
+     */
+    void SetNodePermutation(const std::vector<unsigned>& rPermutation)
+    {
+        if (!rPermutation.empty() && rPermutation.size() != mHeader.mNumNodes)
+            EXCEPTION("Node permutation has " << rPermutation.size() << " entries, mesh cache has " << mHeader.mNumNodes << " nodes");
+
+        mPermutation = rPermutation;
+        mInversePermutation.assign(mPermutation.size(), 0);
+        for (unsigned i = 0; i < mPermutation.size(); i++)
+            mInversePermutation[mPermutation[i]] = i;
+    }
+
+    std::vector<double> GetNodeAttributes()
+    {
+        const double* p = mpNodeAttributes + (size_t)mLastNode * mHeader.mNumNodeAttributes;
+        return std::vector<double>(p, p + mHeader.mNumNodeAttributes);
+    }
+
+    std::vector<double> GetNode(unsigned index)
+    {
+        if (index >= mHeader.mNumNodes)
+            EXCEPTION("Node does not exist - not enough nodes.");
+
+        mLastNode = mPermutation.empty() ? index : mInversePermutation[index];
+        const double* p = mpCoordinates + (size_t)mLastNode * DIM;
+        return std::vector<double>(p, p + DIM);
+    }
+
+    ElementData GetElementData(unsigned index)
+    {
+        if (index >= mHeader.mNumElements)
+            EXCEPTION("Element does not exist - not enough elements.");
+
+        ElementData data;
+        data.NodeIndices = PermuteIndices(mpElements + (size_t)index * (DIM + 1), DIM + 1);
+        data.AttributeValue = mHeader.mNumElementAttributes ? mpElementAttributes[index] : 0;
+        data.ContainingElement = 0;
+        return data;
+    }
+
+    ElementData GetFaceData(unsigned index)
+    {
+        if (index >= mHeader.mNumFaces)
+            EXCEPTION("Face does not exist - not enough faces.");
+
+        ElementData data;
+        data.NodeIndices = PermuteIndices(mpFaces + (size_t)index * DIM, DIM);
+        data.AttributeValue = 0;
+        data.ContainingElement = 0;
+        return data;
+    }
+
+    std::vector<double> GetNextNode() { return GetNode(mNodeCursor++); }
+    ElementData GetNextElementData() { return GetElementData(mElementCursor++); }
+    ElementData GetNextFaceData() { return GetFaceData(mFaceCursor++); }
+
+    void Reset()
+    {
+        mNodeCursor = 0;
+        mElementCursor = 0;
+        mFaceCursor = 0;
+    }
+};
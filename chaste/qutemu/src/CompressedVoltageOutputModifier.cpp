@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "CompressedVoltageOutputModifier.hpp"
+#include "HeartConfig.hpp"
+#include "OutputFileHandler.hpp"
+#include "QutemuHdf5.hpp"
+#include "QutemuTrace.hpp"
+
+static const int16_t INT16_NAN = -32768;
+
+CompressedVoltageOutputModifier::CompressedVoltageOutputModifier(const std::string& rFilename, Encoding encoding,
+                                                                 double minVoltage, double maxVoltage) :
+        AbstractOutputModifier(rFilename),
+        mEncoding(encoding),
+        mOffset((minVoltage + maxVoltage) / 2),
+        mScale((maxVoltage - minVoltage) / 65534)
+{
+    if (maxVoltage <= minVoltage)
+        EXCEPTION("Invalid compressed voltage range " << minVoltage << " to " << maxVoltage << "mV");
+#if !H5_VERSION_GE(1, 10, 2)
+    if (PetscTools::IsParallel())
+        EXCEPTION("Compressed voltage output in parallel needs HDF5 1.10.2 or later, for filtered collective writes");
+#endif
+    if (!H5Zfilter_avail(H5Z_FILTER_DEFLATE) || !H5Zfilter_avail(H5Z_FILTER_SHUFFLE))
+        EXCEPTION("HDF5 was built without the deflate or shuffle filter");
+}
+
+CompressedVoltageOutputModifier::~CompressedVoltageOutputModifier() {
+    Close();
+}
+
+CompressedVoltageOutputModifier::Encoding CompressedVoltageOutputModifier::ParseEncoding(const std::string& rName) {
+    if (rName == "int16")
+        return INT16;
+    if (rName == "float16")
+        return FLOAT16;
+
+    EXCEPTION("Unknown voltage encoding '" << rName << "', expected int16 or float16");
+}
+
+void CompressedVoltageOutputModifier::SetNodes(const std::vector<unsigned>& rNodes) {
+    mNodes = rNodes;
+    std::sort(mNodes.begin(), mNodes.end());
+    mNodes.erase(std::unique(mNodes.begin(), mNodes.end()), mNodes.end());
+}
+
+uint16_t CompressedVoltageOutputModifier::FloatToHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const uint16_t sign = (bits >> 16) & 0x8000;
+    const uint32_t abs = bits & 0x7fffffff;
+
+    if (abs >= 0x7f800000) // inf, and NaN with a quiet payload
+        return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0);
+    if (abs >= 0x477ff000) // rounds past the largest half
+        return sign | 0x7c00;
+    if (abs < 0x38800000) { // subnormal half, or zero
+        if (abs < 0x33000000)
+            return sign;
+        const uint32_t mantissa = (abs & 0x7fffff) | 0x800000;
+        const unsigned shift = 126 - (abs >> 23);
+        uint32_t half = mantissa >> shift;
+        const uint32_t rest = mantissa & ((1u << shift) - 1);
+        const uint32_t midpoint = 1u << (shift - 1);
+        if (rest > midpoint || (rest == midpoint && (half & 1)))
+            half++;
+        return sign | half;
+    }
+
+    // rebias the exponent, round the 13 dropped mantissa bits to nearest even, carrying into the exponent
+    uint32_t half = ((abs >> 13) - (112 << 10));
+    const uint32_t rest = abs & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half++;
+    return sign | half;
+}
+
+uint16_t CompressedVoltageOutputModifier::Encode(double voltage) const {
+    if (mEncoding == FLOAT16)
+        return FloatToHalf((float)voltage);
+
+    if (std::isnan(voltage))
+        return (uint16_t)INT16_NAN;
+    double q = std::round((voltage - mOffset) / mScale);
+    return (uint16_t)(int16_t)std::max(-32767.0, std::min(32767.0, q));
+}
+
+void CompressedVoltageOutputModifier::InitialiseAtStart(DistributedVectorFactory *pVectorFactory) {
+    const unsigned lo = pVectorFactory->GetLow();
+    const unsigned hi = pVectorFactory->GetHigh();
+    mLocalNodes.clear();
+    if (mNodes.empty()) {
+        mNumColumns = pVectorFactory->GetProblemSize();
+        mColumnLo = lo;
+        for (unsigned i = lo; i < hi; i++)
+            mLocalNodes.push_back(i - lo);
+    }
+    else {
+        if (mNodes.back() >= pVectorFactory->GetProblemSize())
+            EXCEPTION("Output node " << mNodes.back() << " is not in the mesh of " << pVectorFactory->GetProblemSize() << " nodes");
+        mNumColumns = mNodes.size();
+        mColumnLo = std::lower_bound(mNodes.begin(), mNodes.end(), lo) - mNodes.begin();
+        for (unsigned c = mColumnLo; c < mNumColumns && mNodes[c] < hi; c++)
+            mLocalNodes.push_back(mNodes[c] - lo);
+    }
+    mBuffer.reserve(CHUNK_ROWS * mLocalNodes.size());
+
+    OutputFileHandler output_file_handler(HeartConfig::Instance()->GetOutputDirectory(), false);
+    FileFinder file = output_file_handler.FindFile(mFilename);
+    std::string file_name = file.GetAbsolutePath();
+    bool resume = (mInitialised || mAppend) && file.IsFile();
+
+    hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
+    H5Pset_fapl_mpio(fapl, PETSC_COMM_WORLD, MPI_INFO_NULL);
+    if (resume)
+        mFileId = H5Fopen(file_name.c_str(), H5F_ACC_RDWR, fapl);
+    else
+        mFileId = H5Fcreate(file_name.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl);
+    H5Pclose(fapl);
+
+    if (mFileId < 0)
+        EXCEPTION("Failed to Create H5F " << file_name << " error code = " << mFileId);
+
+    if (resume) {
+        hid_t dataset_id = H5Dopen(mFileId, "Data_Unlimited", H5P_DEFAULT);
+        hid_t space = H5Dget_space(dataset_id);
+        hsize_t rows = H5Sget_simple_extent_npoints(space);
+        H5Sclose(space);
+        if (!mInitialised && rows > 0) {
+            // a resumed run carries on after the last step written
+            std::vector<double> times(rows);
+            H5Dread(dataset_id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, &times[0]);
+            mLastTime = times.back();
+        }
+        H5Dclose(dataset_id);
+        mNumRows = rows;
+        mInitialised = true;
+        return;
+    }
+
+    // about 1MB of values per chunk
+    hsize_t chunk_columns = std::max(1u, std::min(mNumColumns, (1u << 19) / CHUNK_ROWS));
+    hsize_t dims[2] = {0, mNumColumns};
+    hsize_t max_dims[2] = {H5S_UNLIMITED, mNumColumns};
+    hsize_t chunking[2] = {CHUNK_ROWS, chunk_columns};
+    hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(dcpl, 2, chunking);
+    H5Pset_shuffle(dcpl);
+    H5Pset_deflate(dcpl, 1);
+    hid_t filespace = H5Screate_simple(2, dims, max_dims);
+    hid_t dataset_id = H5Dcreate(mFileId, "Data", mEncoding == INT16 ? H5T_STD_I16LE : H5T_STD_U16LE, filespace,
+                                 H5P_DEFAULT, dcpl, H5P_DEFAULT);
+    H5Sclose(filespace);
+    H5Pclose(dcpl);
+
+    QutemuHdf5::WriteAttribute(dataset_id, "Encoding", mEncoding == INT16 ? "int16" : "float16");
+    if (mEncoding == INT16) {
+        QutemuHdf5::WriteAttribute(dataset_id, "Offset", mOffset);
+        QutemuHdf5::WriteAttribute(dataset_id, "Scale", mScale);
+    }
+    unsigned complete = mNodes.empty() ? 1 : 0;
+    QutemuHdf5::WriteAttribute(dataset_id, "IsDataComplete", H5T_NATIVE_UINT, &complete);
+    H5Dclose(dataset_id);
+
+    hsize_t time_dims[1] = {0};
+    hsize_t time_max_dims[1] = {H5S_UNLIMITED};
+    hsize_t time_chunking[1] = {1024};
+    dcpl = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(dcpl, 1, time_chunking);
+    filespace = H5Screate_simple(1, time_dims, time_max_dims);
+    dataset_id = H5Dcreate(mFileId, "Data_Unlimited", H5T_NATIVE_DOUBLE, filespace, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+    H5Dclose(dataset_id);
+    H5Sclose(filespace);
+    H5Pclose(dcpl);
+
+    if (!mNodes.empty()) {
+        hsize_t node_dims[1] = {mNumColumns};
+        filespace = H5Screate_simple(1, node_dims, nullptr);
+        dataset_id = H5Dcreate(mFileId, "NodeMap", H5T_NATIVE_UINT, filespace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        hsize_t start[1] = {0};
+        hsize_t count[1] = {PetscTools::AmMaster() ? mNumColumns : 0u};
+        QutemuHdf5::WriteHyperslab(dataset_id, H5T_NATIVE_UINT, start, count, mNodes.data());
+        H5Dclose(dataset_id);
+        H5Sclose(filespace);
+    }
+
+    mNumRows = 0;
+    mInitialised = true;
+}
+
+void CompressedVoltageOutputModifier::Flush() {
+    if (mTimes.empty())
+        return;
+
+    TRACE_SCOPE("CompressedVoltage");
+    const unsigned num_rows = mNumRows + mTimes.size();
+
+    hid_t dataset_id = H5Dopen(mFileId, "Data", H5P_DEFAULT);
+    hsize_t dims[2] = {num_rows, mNumColumns};
+    H5Dset_extent(dataset_id, dims);
+    hsize_t start[2] = {mNumRows, mColumnLo};
+    hsize_t count[2] = {mTimes.size(), mLocalNodes.size()};
+    QutemuHdf5::WriteHyperslab(dataset_id, mEncoding == INT16 ? H5T_NATIVE_SHORT : H5T_NATIVE_USHORT, start, count, mBuffer.data());
+    H5Dclose(dataset_id);
+
+    dataset_id = H5Dopen(mFileId, "Data_Unlimited", H5P_DEFAULT);
+    hsize_t time_dims[1] = {num_rows};
+    H5Dset_extent(dataset_id, time_dims);
+    hsize_t time_start[1] = {mNumRows};
+    hsize_t time_count[1] = {PetscTools::AmMaster() ? mTimes.size() : 0u};
+    QutemuHdf5::WriteHyperslab(dataset_id, H5T_NATIVE_DOUBLE, time_start, time_count, mTimes.data());
+    H5Dclose(dataset_id);
+
+    mNumRows = num_rows;
+    mTimes.clear();
+    mBuffer.clear();
+}
+
+void CompressedVoltageOutputModifier::Close() {
+    if (!mFileId)
+        return;
+
+    H5Fclose(mFileId);
+    mFileId = 0;
+}
+
+void CompressedVoltageOutputModifier::FinaliseAtEnd() {
+    Flush();
+    Close();
+}
+
+void CompressedVoltageOutputModifier::ProcessSolutionAtTimeStep(double time, Vec solution, unsigned problemDim) {
+    // later Solve segments start with the last step of the previous one
+    if ((mNumRows > 0 || !mTimes.empty()) && time <= mLastTime + 1e-9)
+        return;
+    mLastTime = time;
+
+    double* p_solution;
+    VecGetArray(solution, &p_solution);
+    for (unsigned offset : mLocalNodes)
+        mBuffer.push_back(Encode(p_solution[offset * problemDim]));
+    VecRestoreArray(solution, &p_solution);
+
+    mTimes.push_back(time);
+    if (mTimes.size() == CHUNK_ROWS)
+        Flush();
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "AbstractOutputModifier.hpp"
+
+/**
+ * Writes the voltage at every output step to a shuffled and deflated HDF5 file, 16 bits per value, in place of
+ * results.h5:
+ *  /Data [time][column]       int16 quantised, V = Offset + Scale * q (mV) with -32768 for NaN, or the bits of
+ *                             an IEEE half (uint16), as given by the Encoding attribute ("int16" or "float16")
+ *  /Data_Unlimited [time]     output times (ms)
+ *  /NodeMap [column]          mesh index of each column, only when IsDataComplete is 0
+ * Columns are in mesh order, as results.h5. Chunks hold CHUNK_ROWS output steps of about 1MB of values, so reading
+ * one step or the trace of one node decompresses a few hundred chunks at most. Rows are buffered a chunk at a
+ * time and written with one collective write, which for a filtered dataset needs HDF5 1.10.2
+ */
+class CompressedVoltageOutputModifier : public AbstractOutputModifier
+{
+public:
+    enum Encoding
+    {
+        INT16, FLOAT16
+    };
+
+    static const unsigned CHUNK_ROWS = 64;
+
+private:
+    Encoding mEncoding;
+    double mOffset;
+    double mScale;
+
+    std::vector<unsigned> mNodes;       ///< Mesh indices of the columns, empty for every node
+    unsigned mNumColumns = 0;
+    unsigned mColumnLo = 0;             ///< First column of this process
+    std::vector<unsigned> mLocalNodes;  ///< Offsets from the low index of this process of its columns
+
+    std::vector<uint16_t> mBuffer;      ///< Encoded rows waiting to be written
+    std::vector<double> mTimes;
+    unsigned mNumRows = 0;              ///< Rows in the file
+    double mLastTime = 0;
+    bool mInitialised = false;
+    bool mAppend = false;
+    hid_t mFileId = 0;
+
+    uint16_t Encode(double voltage) const;
+    void Flush();
+    void Close();
+
+public:
+    /** @param minVoltage, maxVoltage range of int16 values (mV), values outside it are clamped */
+    CompressedVoltageOutputModifier(const std::string& rFilename, Encoding encoding, double minVoltage, double maxVoltage);
+
+    ~CompressedVoltageOutputModifier() override;
+
+    static Encoding ParseEncoding(const std::string& rName);
+
+    /** Only write these nodes (mesh indices), as -nodes does for results.h5. Call before InitialiseAtStart */
+    void SetNodes(const std::vector<unsigned>& rNodes);
+
+    /** Continue an existing file after its last row, for runs resumed with -loaddir */
+    void SetAppend(bool append) { mAppend = append; }
+
+    /** IEEE half precision bits, rounded to nearest even */
+    static uint16_t FloatToHalf(float value);
+
+    void InitialiseAtStart(DistributedVectorFactory *pVectorFactory) override;
+    void FinaliseAtEnd() override;
+    void ProcessSolutionAtTimeStep(double time, Vec solution, unsigned problemDim) override;
+};
@@ -1,30 +1,116 @@
 #include <H5Fpublic.h>
+#include <algorithm>
 #include <string>
 
 #include "ConductivityReader.hpp"
 #include "Exception.hpp"
+#include "PetscTools.hpp"
+#include "QutemuTrace.hpp"
 
-std::vector<float> ConductivityReader::ReadConductivities(const FileFinder &h5_file) {
+std::vector<float> ConductivityReader::ReadConductivities(const FileFinder &h5_file, const std::vector<unsigned>& rIndices) {
+    TRACE_SCOPE("ReadConductivities");
+    return ReadDataset(h5_file, "Conductivity", &rIndices);
+}
+
+std::vector<float> ConductivityReader::ReadDataset(const FileFinder &h5_file, const std::string& rDatasetName,
+                                                   const std::vector<unsigned>* pIndices) {
     std::string file_name = h5_file.GetAbsolutePath();
     if (!h5_file.Exists())
         EXCEPTION("Could not open " << file_name << " , as it does not exist.");
 
-    hid_t mFileId = H5Fopen(file_name.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
+    H5Pset_fapl_mpio(fapl, PETSC_COMM_WORLD, MPI_INFO_NULL);
+    hid_t mFileId = H5Fopen(file_name.c_str(), H5F_ACC_RDONLY, fapl);
+    H5Pclose(fapl);
     if (mFileId <= 0)
         EXCEPTION("Could not open " << file_name << " , H5Fopen error code = " << mFileId);
 
-    hid_t datasetId = H5Dopen(mFileId, "Conductivity", H5P_DEFAULT);
+    hid_t datasetId = H5Dopen(mFileId, rDatasetName.c_str(), H5P_DEFAULT);
     if (datasetId <= 0)
     {
         H5Fclose(mFileId);
-        EXCEPTION("Opened " << file_name << " but could not find the dataset 'Conductivity', H5Dopen error code = " << datasetId);
+        EXCEPTION("Opened " << file_name << " but could not find the dataset '" << rDatasetName << "', H5Dopen error code = " << datasetId);
     }
 
     hid_t dspace = H5Dget_space(datasetId);
-    std::vector<float> data(H5Sget_simple_extent_npoints(dspace));
-    H5Sclose(dspace);
+    int rank = H5Sget_simple_extent_ndims(dspace);
+    std::vector<hsize_t> dims(rank);
+    H5Sget_simple_extent_dims(dspace, &dims[0], nullptr);
+    hsize_t num_points = H5Sget_simple_extent_npoints(dspace);
+
+    // a vector of any rank, such as the 1xN datasets of fibrosis.m, is contiguous along its one non-unit dimension
+    int axis = rank - 1;
+    unsigned non_unit = 0;
+    for (int d = 0; d < rank; d++) {
+        if (dims[d] > 1) {
+            axis = d;
+            non_unit++;
+        }
+    }
+
+    // every rank must agree the indices are valid before the collective read
+    unsigned bad_index = pIndices && !pIndices->empty() && *std::max_element(pIndices->begin(), pIndices->end()) >= num_points;
+    MPI_Allreduce(MPI_IN_PLACE, &bad_index, 1, MPI_UNSIGNED, MPI_LOR, PETSC_COMM_WORLD);
+    if (bad_index)
+    {
+        H5Sclose(dspace);
+        H5Dclose(datasetId);
+        H5Fclose(mFileId);
+        EXCEPTION("Dataset '" << rDatasetName << "' in " << file_name << " has " << num_points << " entries, fewer than the mesh requires");
+    }
+
+    std::vector<float> data(pIndices ? pIndices->size() : num_points);
+    std::vector<float> span;
+    hid_t memspace;
+    if (!pIndices)
+    {
+        memspace = H5S_ALL;
+    }
+    else if (pIndices->empty())
+    {
+        H5Sselect_none(dspace);
+        memspace = H5Screate(H5S_NULL);
+    }
+    else if (rank > 0 && non_unit <= 1 && pIndices->back() - pIndices->front() < 2 * pIndices->size())
+    {
+        // dense (sorted) indices, read the spanning hyperslab and pick out the entries afterwards
+        std::vector<hsize_t> offset(rank, 0);
+        std::vector<hsize_t> count(rank, 1);
+        offset[axis] = pIndices->front();
+        count[axis] = pIndices->back() - pIndices->front() + 1;
+        H5Sselect_hyperslab(dspace, H5S_SELECT_SET, &offset[0], nullptr, &count[0], nullptr);
+        memspace = H5Screate_simple(1, &count[axis], nullptr);
+        span.resize(count[axis]);
+    }
+    else
+    {
+        // sparse indices, point selection of flat C order indices
+        std::vector<hsize_t> coords(pIndices->size() * rank);
+        for (unsigned i = 0; i < pIndices->size(); i++) {
+            hsize_t index = (*pIndices)[i];
+            for (int d = rank - 1; d >= 0; d--) {
+                coords[i*rank + d] = index % dims[d];
+                index /= dims[d];
+            }
+        }
+        H5Sselect_elements(dspace, H5S_SELECT_SET, pIndices->size(), &coords[0]);
 
-    H5Dread(datasetId, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, &data[0]);
+        hsize_t v_size[1] = {pIndices->size()};
+        memspace = H5Screate_simple(1, v_size, nullptr);
+    }
+
+    hid_t property_list_id = H5Pcreate(H5P_DATASET_XFER);
+    H5Pset_dxpl_mpio(property_list_id, H5FD_MPIO_COLLECTIVE);
+
+    std::vector<float>& r_buffer = span.empty() ? data : span;
+    H5Dread(datasetId, H5T_NATIVE_FLOAT, memspace, pIndices ? dspace : H5S_ALL, property_list_id, r_buffer.empty() ? nullptr : &r_buffer[0]);
+    for (unsigned i = 0; i < data.size() && !span.empty(); i++)
+        data[i] = span[(*pIndices)[i] - pIndices->front()];
+
+    H5Pclose(property_list_id);
+    if (memspace != H5S_ALL)
+        H5Sclose(memspace);
+    H5Sclose(dspace);
     H5Dclose(datasetId);
     H5Fclose(mFileId);
     return data;
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <string>
 #include <vector>
 #include <hdf5.h>
 
@@ -7,9 +8,17 @@
 
 class ConductivityReader
 {
-private:
-    hid_t mFileId;
-
 public:
-    static std::vector<float> ReadConductivities(const FileFinder& rFileFinder);
+    /**
+     * Reads the "/Conductivity" multipliers of the given global element indices, given in ascending order.
+     * Each rank only reads its own entries through MPI-IO. Collective
+     */
+    static std::vector<float> ReadConductivities(const FileFinder& rFileFinder, const std::vector<unsigned>& rIndices);
+
+    /**
+     * Reads a float dataset, treating it as a flat array in C order.
+     * Reads the entries at pIndices (sorted ascending), or the whole dataset when pIndices is NULL. Collective
+     */
+    static std::vector<float> ReadDataset(const FileFinder& rFileFinder, const std::string& rDatasetName,
+                                          const std::vector<unsigned>* pIndices);
 };
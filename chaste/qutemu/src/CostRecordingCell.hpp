@@ -0,0 +1,36 @@
+#pragma once
+
+#include <chrono>
+#include <utility>
+
+/** Wall time a cell has spent in SolveAndUpdateState, found through dynamic_cast on the tissue's cells */
+class RecordedCost
+{
+protected:
+    double mCost = 0; ///< Seconds
+
+public:
+    virtual ~RecordedCost() {}
+
+    double GetCost() const { return mCost; }
+};
+
+/**
+ * Times the integration of CELL, for weighting the mesh partition by the cost of each node (see NodeCost). The
+ * constructor arguments are passed on to CELL, so it can wrap QuiescentCell as well as the generated cells
+ */
+template<class CELL>
+class CostRecordingCell : public CELL, public RecordedCost
+{
+public:
+    template<typename... ARGS>
+    CostRecordingCell(ARGS&&... args) :
+            CELL(std::forward<ARGS>(args)...)
+    {}
+
+    void SolveAndUpdateState(double tStart, double tEnd) override {
+        auto start = std::chrono::steady_clock::now();
+        CELL::SolveAndUpdateState(tStart, tEnd);
+        mCost += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+};
@@ -0,0 +1,271 @@
+#include <algorithm>
+#include <cmath>
+
+#include "CourtemancheBatch.hpp"
+#include "Exception.hpp"
+
+// fixed parameters of the model, as in the CellML
+static const double RTF = 8.3143 * 310.0 / 96.4867; ///< RT/F (mV)
+static const double FARADAY = 96.4867;
+static const double CM = 100.0;                     ///< pF
+static const double V_I = 20100.0 * 0.68;           ///< um^3
+static const double V_REL = 0.0048 * 20100.0;
+static const double V_UP = 0.0552 * 20100.0;
+static const double NA_O = 140.0;
+static const double CA_O = 1.8;
+static const double K_O = 5.4;
+static const double K_Q10 = 3.0;
+
+CourtemancheBatch::Parameters CourtemancheBatch::Parameters::SinusRhythm() {
+    return {6.610918250517, 0.033465738902, 0.142305386854, 1.102298728889, 0.042610220619, 0.159830414187,
+            0.139503516592, 0.581557326302, 1124.119199439883, 28.819041182287, 1.445043187588};
+}
+
+CourtemancheBatch::Parameters CourtemancheBatch::Parameters::ChronicAf() {
+    return {7.347244422929, 0.043210532845, 0.021986562950, 0.656893917825, 0.045515799460, 0.147252995015,
+            0.089255669260, 0.511185655714, 1583.359046652913, 23.551150937565, 0.875214180909};
+}
+
+const std::vector<std::string>& CourtemancheBatch::rGetStateVariableNames() {
+    static const std::vector<std::string> names = {
+            "membrane_voltage", "m", "h", "j", "oa", "oi", "ua", "ui", "xr", "xs", "d", "f", "f_Ca", "u", "v", "w",
+            "Na_i", "Ca_i", "K_i", "Ca_rel", "Ca_up"};
+    return names;
+}
+
+const std::vector<double>& CourtemancheBatch::rGetInitialConditions() {
+    static const std::vector<double> initial = {
+            -74.0, 2.908e-3, 9.649e-1, 9.775e-1, 3.043e-2, 9.992e-1, 4.966e-3, 9.986e-1, 3.296e-5, 1.869e-2, 1.367e-4,
+            9.996e-1, 7.755e-1, 2.35e-112, 1.0, 0.9992, 11.17, 1.013e-4, 139.0, 1.488, 1.488};
+    return initial;
+}
+
+/** Currents of one cell (pA), from the state at the start of a step */
+struct CourtemancheCurrents
+{
+    double mNa, mK1, mTo, mKur, mKr, mKs, mCaL, mNaK, mBNa, mBCa, mNaCa, mCaP, mRel;
+
+    double Total() const {
+        return mNa + mK1 + mTo + mKur + mKr + mKs + mBNa + mBCa + mNaK + mCaP + mNaCa + mCaL;
+    }
+};
+
+static inline void ComputeCurrents(const CourtemancheBatch::Parameters& p, double V, double m, double h, double j,
+                                   double oa, double oi, double ua, double ui, double xr, double xs, double d, double f,
+                                   double f_Ca, double u, double v, double w, double Na_i, double Ca_i, double K_i,
+                                   double Ca_rel, CourtemancheCurrents& c) {
+    const double E_Na = RTF * log(NA_O / Na_i);
+    const double E_K = RTF * log(K_O / K_i);
+    const double E_Ca = 0.5 * RTF * log(CA_O / Ca_i);
+
+    c.mNa = CM * p.mGNa * m * m * m * h * j * (V - E_Na);
+    c.mK1 = CM * p.mGK1 * (V - E_K) / (1.0 + exp(0.07 * (V + 80.0)));
+    c.mTo = CM * p.mGto * oa * oa * oa * oi * (V - E_K);
+    const double g_Kur = p.mGKurScale * 0.005 + 0.05 / (1.0 + exp((V - 15.0) / -13.0));
+    c.mKur = CM * g_Kur * ua * ua * ua * ui * (V - E_K);
+    c.mKr = CM * p.mGKr * xr * (V - E_K) / (1.0 + exp((V + 15.0) / 22.4));
+    c.mKs = CM * p.mGKs * xs * xs * (V - E_K);
+    c.mCaL = CM * p.mGCaL * d * f * f_Ca * (V - 65.0);
+
+    const double sigma = (exp(NA_O / 67.3) - 1.0) / 7.0;
+    const double f_NaK = 1.0 / (1.0 + 0.1245 * exp(-0.1 * V / RTF) + 0.0365 * sigma * exp(-V / RTF));
+    c.mNaK = CM * p.mINaKMax * f_NaK / (1.0 + pow(10.0 / Na_i, 1.5)) * K_O / (K_O + 1.5);
+    c.mBNa = CM * 0.0006744375 * (V - E_Na);
+    c.mBCa = CM * 0.001131 * (V - E_Ca);
+    c.mNaCa = CM * p.mINaCaMax * (exp(0.35 * V / RTF) * Na_i * Na_i * Na_i * CA_O - exp(-0.65 * V / RTF) * NA_O * NA_O * NA_O * Ca_i)
+            / ((87.5 * 87.5 * 87.5 + NA_O * NA_O * NA_O) * (1.38 + CA_O) * (1.0 + 0.1 * exp(-0.65 * V / RTF)));
+    c.mCaP = CM * 0.275 * Ca_i / (0.0005 + Ca_i);
+    c.mRel = p.mKRel * u * u * v * w * (Ca_rel - Ca_i);
+}
+
+/** Rush-Larsen update of a gate towards inf with time constant tau */
+static inline double Gate(double x, double inf, double tau, double dt) {
+    return inf + (x - inf) * exp(-dt / tau);
+}
+
+CourtemancheBatch::CourtemancheBatch(const Parameters& rParameters, double timeStep, double capacitance) :
+        mParameters(rParameters),
+        mTimeStep(timeStep),
+        mCapacitance(capacitance)
+{}
+
+unsigned CourtemancheBatch::AddCell(unsigned globalIndex) {
+    const std::vector<double>& r_initial = rGetInitialConditions();
+    for (unsigned s = 0; s < NUM_STATE_VARIABLES; s++)
+        mState[s].push_back(r_initial[s]);
+
+    mIonicCurrent.push_back(0.0);
+    mGlobalIndices.push_back(globalIndex);
+    unsigned lane = mGlobalIndices.size() - 1;
+    if (lane % GROUP_SIZE == 0)
+        mNumSolved.push_back(0);
+
+    UpdateIonicCurrent(lane, lane + 1);
+    return lane;
+}
+
+std::vector<double> CourtemancheBatch::GetStateVariables(unsigned lane) const {
+    std::vector<double> state(NUM_STATE_VARIABLES);
+    for (unsigned s = 0; s < NUM_STATE_VARIABLES; s++)
+        state[s] = mState[s][lane];
+    return state;
+}
+
+void CourtemancheBatch::SetStateVariables(unsigned lane, const std::vector<double>& rState) {
+    if (rState.size() != NUM_STATE_VARIABLES)
+        EXCEPTION("Courtemanche cells have " << NUM_STATE_VARIABLES << " state variables, given " << rState.size());
+
+    for (unsigned s = 0; s < NUM_STATE_VARIABLES; s++)
+        mState[s][lane] = rState[s];
+    UpdateIonicCurrent(lane, lane + 1);
+}
+
+void CourtemancheBatch::Solve(unsigned lane, double tStart, double tEnd) {
+    const unsigned group = lane / GROUP_SIZE;
+    const unsigned begin = group * GROUP_SIZE;
+    const unsigned end = std::min(begin + GROUP_SIZE, GetNumCells());
+    if (++mNumSolved[group] < end - begin)
+        return;
+
+    if (lane != end - 1)
+        EXCEPTION("Batched cells must be solved in lane order, lane " << lane << " completed group " << group);
+
+    mNumSolved[group] = 0;
+    Integrate(begin, end, tStart, tEnd);
+    if (mIonicCurrentCallback)
+        for (unsigned i = begin; i < end; i++)
+            mIonicCurrentCallback(mGlobalIndices[i], mIonicCurrent[i]);
+}
+
+void CourtemancheBatch::Integrate(unsigned begin, unsigned end, double tStart, double tEnd) {
+    unsigned steps = std::max(1, (int)std::ceil((tEnd - tStart) / mTimeStep - 1e-6));
+    double dt = (tEnd - tStart) / steps;
+    for (unsigned s = 0; s < steps; s++)
+        Step(begin, end, dt);
+
+    UpdateIonicCurrent(begin, end);
+}
+
+void CourtemancheBatch::Step(unsigned begin, unsigned end, double dt) {
+    const Parameters p = mParameters;
+    const double* __restrict__ p_v = &mState[VOLTAGE][0];
+    double* __restrict__ p_m = &mState[M_GATE][0];
+    double* __restrict__ p_h = &mState[H_GATE][0];
+    double* __restrict__ p_j = &mState[J_GATE][0];
+    double* __restrict__ p_oa = &mState[OA_GATE][0];
+    double* __restrict__ p_oi = &mState[OI_GATE][0];
+    double* __restrict__ p_ua = &mState[UA_GATE][0];
+    double* __restrict__ p_ui = &mState[UI_GATE][0];
+    double* __restrict__ p_xr = &mState[XR_GATE][0];
+    double* __restrict__ p_xs = &mState[XS_GATE][0];
+    double* __restrict__ p_d = &mState[D_GATE][0];
+    double* __restrict__ p_f = &mState[F_GATE][0];
+    double* __restrict__ p_fca = &mState[FCA_GATE][0];
+    double* __restrict__ p_u = &mState[U_GATE][0];
+    double* __restrict__ p_vg = &mState[V_GATE][0];
+    double* __restrict__ p_w = &mState[W_GATE][0];
+    double* __restrict__ p_nai = &mState[NA_I][0];
+    double* __restrict__ p_cai = &mState[CA_I][0];
+    double* __restrict__ p_ki = &mState[K_I][0];
+    double* __restrict__ p_carel = &mState[CA_REL][0];
+    double* __restrict__ p_caup = &mState[CA_UP][0];
+
+    for (unsigned i = begin; i < end; i++) {
+        const double V = p_v[i];
+        const double Ca_i = p_cai[i];
+        const double Ca_rel = p_carel[i];
+        const double Ca_up = p_caup[i];
+
+        CourtemancheCurrents c;
+        ComputeCurrents(p, V, p_m[i], p_h[i], p_j[i], p_oa[i], p_oi[i], p_ua[i], p_ui[i], p_xr[i], p_xs[i], p_d[i],
+                        p_f[i], p_fca[i], p_u[i], p_vg[i], p_w[i], p_nai[i], Ca_i, p_ki[i], Ca_rel, c);
+
+        // fast sodium
+        const double alpha_m = fabs(V + 47.13) < 1e-10 ? 3.2 : 0.32 * (V + 47.13) / (1.0 - exp(-0.1 * (V + 47.13)));
+        const double beta_m = 0.08 * exp(-V / 11.0);
+        const bool hyperpolarised = V < -40.0;
+        const double alpha_h = hyperpolarised ? 0.135 * exp((V + 80.0) / -6.8) : 0.0;
+        const double beta_h = hyperpolarised ? 3.56 * exp(0.079 * V) + 3.1e5 * exp(0.35 * V)
+                                             : 1.0 / (0.13 * (1.0 + exp((V + 10.66) / -11.1)));
+        const double alpha_j = hyperpolarised ? (-1.2714e5 * exp(0.2444 * V) - 3.474e-5 * exp(-0.04391 * V)) * (V + 37.78)
+                                                / (1.0 + exp(0.311 * (V + 79.23))) : 0.0;
+        const double beta_j = hyperpolarised ? 0.1212 * exp(-0.01052 * V) / (1.0 + exp(-0.1378 * (V + 40.14)))
+                                             : 0.3 * exp(-2.535e-7 * V) / (1.0 + exp(-0.1 * (V + 32.0)));
+        p_m[i] = Gate(p_m[i], alpha_m / (alpha_m + beta_m), 1.0 / (alpha_m + beta_m), dt);
+        p_h[i] = Gate(p_h[i], alpha_h / (alpha_h + beta_h), 1.0 / (alpha_h + beta_h), dt);
+        p_j[i] = Gate(p_j[i], alpha_j / (alpha_j + beta_j), 1.0 / (alpha_j + beta_j), dt);
+
+        // transient outward and ultrarapid potassium, oa and ua share their rates
+        const double alpha_oa = 0.65 / (exp((V + 10.0) / -8.5) + exp((V + 10.0 - 40.0) / -59.0));
+        const double beta_oa = 0.65 / (2.5 + exp((V + 10.0 + 72.0) / 17.0));
+        const double tau_oa = 1.0 / (alpha_oa + beta_oa) / K_Q10;
+        p_oa[i] = Gate(p_oa[i], 1.0 / (1.0 + exp((V + 10.0 + 10.47) / -17.54)), tau_oa, dt);
+        p_ua[i] = Gate(p_ua[i], 1.0 / (1.0 + exp((V + 10.0 + 20.3) / -9.6)), tau_oa, dt);
+
+        const double alpha_oi = 1.0 / (18.53 + exp((V + 10.0 + 103.7) / 10.95));
+        const double beta_oi = 1.0 / (35.56 + exp((V + 10.0 - 8.74) / -7.44));
+        p_oi[i] = Gate(p_oi[i], 1.0 / (1.0 + exp((V + 10.0 + 33.1) / 5.3)), 1.0 / (alpha_oi + beta_oi) / K_Q10, dt);
+
+        const double alpha_ui = 1.0 / (21.0 + exp((V + 10.0 - 195.0) / -28.0));
+        const double beta_ui = 1.0 / exp((V + 10.0 - 168.0) / -16.0);
+        p_ui[i] = Gate(p_ui[i], 1.0 / (1.0 + exp((V + 10.0 - 109.45) / 27.48)), 1.0 / (alpha_ui + beta_ui) / K_Q10, dt);
+
+        // delayed rectifiers
+        const double alpha_xr = fabs(V + 14.1) < 1e-10 ? 0.0015 : 0.0003 * (V + 14.1) / (1.0 - exp((V + 14.1) / -5.0));
+        const double beta_xr = fabs(V - 3.3328) < 1e-10 ? 3.7836118e-4 : 7.3898e-5 * (V - 3.3328) / (exp((V - 3.3328) / 5.1237) - 1.0);
+        p_xr[i] = Gate(p_xr[i], 1.0 / (1.0 + exp((V + 14.1) / -6.5)), 1.0 / (alpha_xr + beta_xr), dt);
+
+        const double alpha_xs = fabs(V - 19.9) < 1e-10 ? 0.00068 : 4e-5 * (V - 19.9) / (1.0 - exp((V - 19.9) / -17.0));
+        const double beta_xs = fabs(V - 19.9) < 1e-10 ? 0.000315 : 3.5e-5 * (V - 19.9) / (exp((V - 19.9) / 9.0) - 1.0);
+        p_xs[i] = Gate(p_xs[i], 1.0 / sqrt(1.0 + exp((V - 19.9) / -12.7)), 0.5 / (alpha_xs + beta_xs), dt);
+
+        // L-type calcium
+        const double e_d = exp((V + 10.0) / -6.24);
+        const double tau_d = fabs(V + 10.0) < 1e-10 ? 4.579 / (1.0 + e_d) : (1.0 - e_d) / (0.035 * (V + 10.0) * (1.0 + e_d));
+        p_d[i] = Gate(p_d[i], 1.0 / (1.0 + exp((V + 10.0) / -8.0)), tau_d, dt);
+
+        const double e_f = exp(-(V + 28.0) / 6.9);
+        const double tau_f = 9.0 / (0.0197 * exp(-0.0337 * 0.0337 * (V + 10.0) * (V + 10.0)) + 0.02);
+        p_f[i] = Gate(p_f[i], e_f / (1.0 + e_f), tau_f, dt);
+        p_fca[i] = Gate(p_fca[i], 1.0 / (1.0 + Ca_i / 0.00035), 2.0, dt);
+
+        // SR release, gated by the flux Fn
+        const double Fn = 1e3 * (1e-15 * V_REL * c.mRel - 1e-15 / (2.0 * FARADAY) * (0.5 * c.mCaL - 0.2 * c.mNaCa));
+        const double u_inf = 1.0 / (1.0 + exp(-(Fn - 3.4175e-13) / 13.67e-16));
+        p_u[i] = Gate(p_u[i], u_inf, 8.0, dt);
+        p_vg[i] = Gate(p_vg[i], 1.0 - 1.0 / (1.0 + exp(-(Fn - 6.835e-14) / 13.67e-16)), 1.91 + 2.09 * u_inf, dt);
+
+        const double e_w = exp(-(V - 7.9) / 5.0);
+        const double tau_w = fabs(V - 7.9) < 1e-10 ? 6.0 * 0.2 / 1.3 : 6.0 * (1.0 - e_w) / ((1.0 + 0.3 * e_w) * (V - 7.9));
+        p_w[i] = Gate(p_w[i], 1.0 - 1.0 / (1.0 + exp(-(V - 40.0) / 17.0)), tau_w, dt);
+
+        // concentrations, forward Euler
+        const double i_tr = (Ca_up - Ca_rel) / 180.0;
+        const double i_up = p.mIUpScale * 0.005 / (1.0 + 0.00092 / Ca_i);
+        const double i_up_leak = 0.005 * Ca_up / 15.0;
+        const double B1 = (2.0 * c.mNaCa - (c.mCaP + c.mCaL + c.mBCa)) / (2.0 * V_I * FARADAY)
+                          + (V_UP * (i_up_leak - i_up) + c.mRel * V_REL) / V_I;
+        const double B2 = 1.0 + 0.07 * 0.0005 / ((Ca_i + 0.0005) * (Ca_i + 0.0005))
+                          + 0.05 * 0.00238 / ((Ca_i + 0.00238) * (Ca_i + 0.00238));
+
+        p_nai[i] += dt * (-3.0 * c.mNaK - (3.0 * c.mNaCa + c.mBNa + c.mNa)) / (V_I * FARADAY);
+        p_ki[i] += dt * (2.0 * c.mNaK - (c.mK1 + c.mTo + c.mKur + c.mKr + c.mKs)) / (V_I * FARADAY);
+        p_cai[i] += dt * B1 / B2;
+        p_caup[i] += dt * (i_up - (i_up_leak + i_tr * V_REL / V_UP));
+        p_carel[i] += dt * (i_tr - c.mRel) / (1.0 + 10.0 * 0.8 / ((Ca_rel + 0.8) * (Ca_rel + 0.8)));
+    }
+}
+
+void CourtemancheBatch::UpdateIonicCurrent(unsigned begin, unsigned end) {
+    for (unsigned i = begin; i < end; i++) {
+        CourtemancheCurrents c;
+        ComputeCurrents(mParameters, mState[VOLTAGE][i], mState[M_GATE][i], mState[H_GATE][i], mState[J_GATE][i],
+                        mState[OA_GATE][i], mState[OI_GATE][i], mState[UA_GATE][i], mState[UI_GATE][i], mState[XR_GATE][i],
+                        mState[XS_GATE][i], mState[D_GATE][i], mState[F_GATE][i], mState[FCA_GATE][i], mState[U_GATE][i],
+                        mState[V_GATE][i], mState[W_GATE][i], mState[NA_I][i], mState[CA_I][i], mState[K_I][i],
+                        mState[CA_REL][i], c);
+
+        // pA/pF, scaled to uA/cm^2 by the membrane capacitance
+        mIonicCurrent[i] = c.Total() / CM * mCapacitance;
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * The cells of one Courtemanche, Ramirez and Nattel (1998) model on a process, as a structure of arrays with one lane
+ * per cell. Lanes are integrated together in groups of GROUP_SIZE with a fixed step Rush-Larsen kernel (exponential
+ * gate updates, forward Euler concentrations), written as straight loops over the lanes so they vectorise.
+ *
+ * The equations and parameter sets are those of courtemanche_ramirez_nattel_1998_SR.cellml and _cAF.cellml. The
+ * voltage is held over a step as in a tissue simulation, the tissue updates it from the ionic current.
+ *
+ * Each lane is solved when the tissue solves its cell, in lane order. A group is integrated when its last lane is
+ * solved, once the tissue has set the voltage of every lane in it, and the new ionic currents of the group are
+ * passed to the ionic current callback, replacing the values the tissue cached for the earlier lanes
+ */
+class CourtemancheBatch
+{
+public:
+    enum StateVariable
+    {
+        VOLTAGE, M_GATE, H_GATE, J_GATE, OA_GATE, OI_GATE, UA_GATE, UI_GATE, XR_GATE, XS_GATE, D_GATE, F_GATE, FCA_GATE,
+        U_GATE, V_GATE, W_GATE, NA_I, CA_I, K_I, CA_REL, CA_UP, NUM_STATE_VARIABLES
+    };
+
+    /** The parameters which differ between the sinus rhythm and chronic AF fits */
+    struct Parameters
+    {
+        double mGNa;
+        double mGK1;
+        double mGto;
+        double mGKurScale;
+        double mGKr;
+        double mGKs;
+        double mGCaL;
+        double mINaKMax;
+        double mINaCaMax;
+        double mKRel;
+        double mIUpScale;
+
+        static Parameters SinusRhythm();
+        static Parameters ChronicAf();
+    };
+
+    static const unsigned GROUP_SIZE = 64;
+
+    /**
+     * @param timeStep the fixed ODE step (ms), shortened to divide each solve interval evenly
+     * @param capacitance membrane capacitance (uF/cm^2) the ionic current is scaled by, as for the generated cells
+     */
+    CourtemancheBatch(const Parameters& rParameters, double timeStep, double capacitance);
+
+    /** Adds a cell in its initial state. @return its lane */
+    unsigned AddCell(unsigned globalIndex);
+
+    unsigned GetNumCells() const { return mGlobalIndices.size(); }
+
+    /** Receives (global index, ionic current) for every lane of a group after it is integrated */
+    void SetIonicCurrentCallback(std::function<void(unsigned, double)> callback) { mIonicCurrentCallback = callback; }
+
+    void SetVoltage(unsigned lane, double voltage) { mState[VOLTAGE][lane] = voltage; }
+    double GetVoltage(unsigned lane) const { return mState[VOLTAGE][lane]; }
+
+    /** Ionic current (uA/cm^2) of the state after the last integration of the lane */
+    double GetIIonic(unsigned lane) const { return mIonicCurrent[lane]; }
+
+    std::vector<double> GetStateVariables(unsigned lane) const;
+    void SetStateVariables(unsigned lane, const std::vector<double>& rState);
+    void SetStateVariable(unsigned lane, unsigned index, double value) { mState[index][lane] = value; }
+
+    static const std::vector<std::string>& rGetStateVariableNames();
+    static const std::vector<double>& rGetInitialConditions();
+
+    /** Solves one lane to tEnd, integrating its group once every lane of it has been solved */
+    void Solve(unsigned lane, double tStart, double tEnd);
+
+    /** Integrates lanes [begin, end) from tStart to tEnd and updates their ionic currents */
+    void Integrate(unsigned begin, unsigned end, double tStart, double tEnd);
+
+private:
+    Parameters mParameters;
+    double mTimeStep;
+    double mCapacitance;
+
+    std::vector<double> mState[NUM_STATE_VARIABLES];
+    std::vector<double> mIonicCurrent;
+    std::vector<unsigned> mGlobalIndices;
+    std::vector<unsigned> mNumSolved; ///< Lanes of each group solved since the group was last integrated
+
+    std::function<void(unsigned, double)> mIonicCurrentCallback;
+
+    void Step(unsigned begin, unsigned end, double dt);
+    void UpdateIonicCurrent(unsigned begin, unsigned end);
+};
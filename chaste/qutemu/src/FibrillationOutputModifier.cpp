@@ -0,0 +1,512 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "FibrillationOutputModifier.hpp"
+#include "HeartConfig.hpp"
+#include "OutputFileHandler.hpp"
+#include "QutemuHdf5.hpp"
+#include "QutemuTrace.hpp"
+
+static const unsigned SINGULARITY_FIELDS = 5; ///< time, x, y, z, winding
+
+FibrillationOutputModifier::FibrillationOutputModifier(const std::string& rFilename, double thresholdVoltage,
+                                                       double window, double sampleInterval) :
+        AbstractOutputModifier(rFilename),
+        mThresholdVoltage(thresholdVoltage),
+        mWindow(window),
+        mSampleInterval(sampleInterval)
+{
+    if (window <= 0 || sampleInterval <= 0)
+        EXCEPTION("Fibrillation window and sample interval must be positive");
+    if (sampleInterval * 4 > window)
+        EXCEPTION("Fibrillation window " << window << "ms is too short for a sample interval of " << sampleInterval << "ms");
+}
+
+FibrillationOutputModifier::~FibrillationOutputModifier() {
+    Close();
+}
+
+void FibrillationOutputModifier::SetFrequencyBand(double min, double max) {
+    if (min <= 0 || max <= min)
+        EXCEPTION("Invalid dominant frequency band " << min << "-" << max << "Hz");
+    if (max > 500 / mSampleInterval)
+        EXCEPTION("Dominant frequency band reaches " << max << "Hz, above the " << 500 / mSampleInterval
+                  << "Hz a sample interval of " << mSampleInterval << "ms can resolve");
+    mFrequencyMin = min;
+    mFrequencyMax = max;
+}
+
+template<unsigned DIM>
+void FibrillationOutputModifier::SetMesh(AbstractTetrahedralMesh<DIM,DIM>& rMesh) {
+    DistributedVectorFactory* p_factory = rMesh.GetDistributedVectorFactory();
+    mDim = DIM;
+    mNumNodes = p_factory->GetProblemSize();
+    mLo = p_factory->GetLow();
+    mNumberOwned = p_factory->GetLocalOwnership();
+
+    std::vector<unsigned> halo;
+    BuildElements(rMesh, halo);
+    SetupExchange(halo);
+    mNumHalo = halo.size();
+
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    mActivation.assign(mNumberOwned + mNumHalo, nan);
+    mPhase.assign(mNumberOwned + mNumHalo, nan);
+    mPreviousVoltage.assign(mNumberOwned, nan);
+    mCycleLength.assign(mNumberOwned, nan);
+    mCycleSum.assign(mNumberOwned, 0.0f);
+    mCycleCount.assign(mNumberOwned, 0u);
+    mVelocitySum.assign(mNumberOwned, 0.0f);
+    mVelocityCount.assign(mNumberOwned, 0u);
+
+    // bins at the resolution of the window, the Hann window spreads a peak over two
+    const double resolution = 1000 / mWindow;
+    mFrequencies.clear();
+    for (double f = std::ceil(mFrequencyMin / resolution - 1e-9) * resolution; f <= mFrequencyMax + 1e-9; f += resolution)
+        mFrequencies.push_back(f);
+    if (mFrequencies.empty())
+        EXCEPTION("Dominant frequency band " << mFrequencyMin << "-" << mFrequencyMax << "Hz is narrower than the "
+                  << resolution << "Hz resolution of a " << mWindow << "ms window");
+    mSpectrum.assign((size_t)mNumberOwned * 2 * mFrequencies.size(), 0.0f);
+}
+
+template<unsigned DIM>
+void FibrillationOutputModifier::BuildElements(AbstractTetrahedralMesh<DIM,DIM>& rMesh, std::vector<unsigned>& rHalo) {
+    const unsigned hi = mLo + mNumberOwned;
+    mElementNodes.clear();
+    mInverseJacobian.clear();
+    mCentroids.clear();
+    mCountedElements.clear();
+    rHalo.clear();
+
+    c_matrix<double,DIM,DIM> jacobian, inverse_jacobian;
+    double determinant;
+    for (typename AbstractTetrahedralMesh<DIM,DIM>::ElementIterator iter = rMesh.GetElementIteratorBegin();
+         iter != rMesh.GetElementIteratorEnd(); ++iter) {
+        unsigned lowest = std::numeric_limits<unsigned>::max();
+        bool any_owned = false;
+        for (unsigned n = 0; n <= DIM; n++) {
+            unsigned node = iter->GetNodeGlobalIndex(n);
+            lowest = std::min(lowest, node);
+            any_owned |= node >= mLo && node < hi;
+        }
+        if (!any_owned)
+            continue;
+
+        unsigned element = mElementNodes.size() / (DIM + 1);
+        if (lowest >= mLo && lowest < hi)
+            mCountedElements.push_back(element);
+
+        for (unsigned n = 0; n <= DIM; n++) {
+            unsigned node = iter->GetNodeGlobalIndex(n);
+            mElementNodes.push_back(node);
+            if (node < mLo || node >= hi)
+                rHalo.push_back(node);
+        }
+
+        iter->CalculateInverseJacobian(jacobian, determinant, inverse_jacobian);
+        for (unsigned i = 0; i < DIM; i++)
+            for (unsigned j = 0; j < DIM; j++)
+                mInverseJacobian.push_back(inverse_jacobian(i, j));
+
+        c_vector<double,DIM> centroid = iter->CalculateCentroid();
+        for (unsigned i = 0; i < 3; i++)
+            mCentroids.push_back(i < DIM ? centroid[i] : 0.0f);
+    }
+
+    std::sort(rHalo.begin(), rHalo.end());
+    rHalo.erase(std::unique(rHalo.begin(), rHalo.end()), rHalo.end());
+
+    // global indices to slots
+    for (unsigned& r_node : mElementNodes) {
+        if (r_node >= mLo && r_node < hi)
+            r_node -= mLo;
+        else
+            r_node = mNumberOwned + (std::lower_bound(rHalo.begin(), rHalo.end(), r_node) - rHalo.begin());
+    }
+
+    mElementWave.assign(mElementNodes.size() / (DIM + 1), -std::numeric_limits<float>::infinity());
+}
+
+void FibrillationOutputModifier::SetupExchange(const std::vector<unsigned>& rHalo) {
+    const unsigned num_procs = PetscTools::GetNumProcs();
+    std::vector<unsigned> los(num_procs);
+    MPI_Allgather(&mLo, 1, MPI_UNSIGNED, &los[0], 1, MPI_UNSIGNED, PETSC_COMM_WORLD);
+
+    // ranks owning no nodes share the next rank's lo, upper_bound skips past them
+    std::vector<int> recv_counts(num_procs, 0);
+    for (unsigned node : rHalo)
+        recv_counts[std::upper_bound(los.begin(), los.end(), node) - los.begin() - 1]++;
+
+    std::vector<int> send_counts(num_procs);
+    MPI_Alltoall(recv_counts.data(), 1, MPI_INT, send_counts.data(), 1, MPI_INT, PETSC_COMM_WORLD);
+
+    std::vector<int> recv_offsets(num_procs, 0), send_offsets(num_procs, 0);
+    for (unsigned p = 1; p < num_procs; p++) {
+        recv_offsets[p] = recv_offsets[p - 1] + recv_counts[p - 1];
+        send_offsets[p] = send_offsets[p - 1] + send_counts[p - 1];
+    }
+    mSendNodes.resize(send_offsets[num_procs - 1] + send_counts[num_procs - 1]);
+    MPI_Alltoallv(rHalo.data(), recv_counts.data(), recv_offsets.data(), MPI_UNSIGNED,
+                  mSendNodes.data(), send_counts.data(), send_offsets.data(), MPI_UNSIGNED, PETSC_COMM_WORLD);
+    for (unsigned& r_node : mSendNodes)
+        r_node -= mLo;
+
+    mRecvRanks.clear();
+    mRecvOffsets.clear();
+    mSendRanks.clear();
+    mSendOffsets.clear();
+    for (unsigned p = 0; p < num_procs; p++) {
+        if (recv_counts[p] > 0) {
+            mRecvRanks.push_back(p);
+            mRecvOffsets.push_back(recv_offsets[p]);
+        }
+        if (send_counts[p] > 0) {
+            mSendRanks.push_back(p);
+            mSendOffsets.push_back(send_offsets[p]);
+        }
+    }
+    mRecvOffsets.push_back(rHalo.size());
+    mSendOffsets.push_back(mSendNodes.size());
+    mRecvBuffer.resize(2 * rHalo.size());
+    mSendBuffer.resize(2 * mSendNodes.size());
+}
+
+void FibrillationOutputModifier::ExchangeHalo() {
+    for (unsigned i = 0; i < mSendNodes.size(); i++) {
+        mSendBuffer[2 * i] = mActivation[mSendNodes[i]];
+        mSendBuffer[2 * i + 1] = mPhase[mSendNodes[i]];
+    }
+
+    std::vector<MPI_Request> requests(mRecvRanks.size() + mSendRanks.size());
+    for (unsigned k = 0; k < mRecvRanks.size(); k++)
+        MPI_Irecv(&mRecvBuffer[2 * mRecvOffsets[k]], 2 * (mRecvOffsets[k + 1] - mRecvOffsets[k]), MPI_FLOAT,
+                  mRecvRanks[k], 0, PETSC_COMM_WORLD, &requests[k]);
+    for (unsigned k = 0; k < mSendRanks.size(); k++)
+        MPI_Isend(&mSendBuffer[2 * mSendOffsets[k]], 2 * (mSendOffsets[k + 1] - mSendOffsets[k]), MPI_FLOAT,
+                  mSendRanks[k], 0, PETSC_COMM_WORLD, &requests[mRecvRanks.size() + k]);
+    MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+
+    for (unsigned i = 0; i < mNumHalo; i++) {
+        mActivation[mNumberOwned + i] = mRecvBuffer[2 * i];
+        mPhase[mNumberOwned + i] = mRecvBuffer[2 * i + 1];
+    }
+}
+
+void FibrillationOutputModifier::DetectActivations(double time, const double* pSolution, unsigned problemDim) {
+    const float threshold = mThresholdVoltage;
+    for (unsigned i = 0; i < mNumberOwned; i++) {
+        const float v = pSolution[i * problemDim];
+        const float previous = mPreviousVoltage[i];
+        mPreviousVoltage[i] = v;
+        if (!(previous < threshold && v >= threshold))
+            continue;
+
+        double crossing = mPreviousTime + (threshold - previous) / (v - previous) * (time - mPreviousTime);
+        if (!std::isnan(mActivation[i])) {
+            mCycleLength[i] = crossing - mActivation[i];
+            mCycleSum[i] += mCycleLength[i];
+            mCycleCount[i]++;
+        }
+        mActivation[i] = crossing;
+    }
+}
+
+void FibrillationOutputModifier::Sample(double time, const double* pSolution, unsigned problemDim) {
+    const unsigned num_bins = mFrequencies.size();
+    const double offset = time - mWindowStart;
+    const double weight = 0.5 * (1 - std::cos(2 * M_PI * std::min(offset / mWindow, 1.0)));
+    std::vector<float> coefficients(2 * num_bins);
+    for (unsigned k = 0; k < num_bins; k++) {
+        coefficients[2 * k] = weight * std::cos(2 * M_PI * mFrequencies[k] * offset / 1000);
+        coefficients[2 * k + 1] = weight * std::sin(2 * M_PI * mFrequencies[k] * offset / 1000);
+    }
+
+    for (unsigned i = 0; i < mNumberOwned; i++) {
+        const float v = pSolution[i * problemDim];
+        float* p_spectrum = &mSpectrum[(size_t)i * 2 * num_bins];
+        for (unsigned k = 0; k < 2 * num_bins; k++)
+            p_spectrum[k] += v * coefficients[k];
+
+        if (std::isnan(mCycleLength[i]))
+            mPhase[i] = std::numeric_limits<float>::quiet_NaN();
+        else
+            mPhase[i] = 2 * M_PI * std::min(1.0, (time - mActivation[i]) / mCycleLength[i]) - M_PI;
+    }
+
+    ExchangeHalo();
+    MeasureVelocities();
+    DetectSingularities(time);
+}
+
+void FibrillationOutputModifier::MeasureVelocities() {
+    const unsigned nodes_per_element = mDim + 1;
+    const unsigned num_elements = mElementWave.size();
+    float delay[3];
+    for (unsigned e = 0; e < num_elements; e++) {
+        const unsigned* p_nodes = &mElementNodes[e * nodes_per_element];
+        const float first = mActivation[p_nodes[0]];
+        float earliest = first, latest = first;
+        bool activated = !std::isnan(first);
+        for (unsigned n = 1; n < nodes_per_element; n++) {
+            const float activation = mActivation[p_nodes[n]];
+            activated &= !std::isnan(activation);
+            delay[n - 1] = activation - first;
+            earliest = std::min(earliest, activation);
+            latest = std::max(latest, activation);
+        }
+
+        // waits until every node has activated in the wave (min and max skip NaN, so check each node)
+        if (!activated || !(latest > mElementWave[e] && latest - earliest <= mMaxSpread))
+            continue;
+        mElementWave[e] = latest;
+
+        // activation time gradient (ms/cm), the inverse transpose of the edge matrix applied to the delays
+        const float* p_inverse = &mInverseJacobian[e * mDim * mDim];
+        double norm = 0;
+        for (unsigned j = 0; j < mDim; j++) {
+            double gradient = 0;
+            for (unsigned i = 0; i < mDim; i++)
+                gradient += p_inverse[i * mDim + j] * delay[i];
+            norm += gradient * gradient;
+        }
+        if (norm <= 0)
+            continue;
+
+        const float velocity = 10 / std::sqrt(norm); // cm/ms to m/s
+        if (velocity > mMaxVelocity)
+            continue;
+
+        for (unsigned n = 0; n < nodes_per_element; n++) {
+            if (p_nodes[n] < mNumberOwned) {
+                mVelocitySum[p_nodes[n]] += velocity;
+                mVelocityCount[p_nodes[n]]++;
+            }
+        }
+    }
+}
+
+/** Phase difference in [-pi, pi] */
+static double WrapPhase(double difference) {
+    return difference - 2 * M_PI * std::round(difference / (2 * M_PI));
+}
+
+void FibrillationOutputModifier::DetectSingularities(double time) {
+    static const unsigned faces[4][3] = {{0, 1, 2}, {0, 1, 3}, {0, 2, 3}, {1, 2, 3}};
+    const unsigned num_faces = mDim == 3 ? 4 : 1;
+    for (unsigned e : mCountedElements) {
+        const unsigned* p_nodes = &mElementNodes[e * (mDim + 1)];
+        for (unsigned f = 0; f < num_faces; f++) {
+            const double a = mPhase[p_nodes[faces[f][0]]];
+            const double b = mPhase[p_nodes[faces[f][1]]];
+            const double c = mPhase[p_nodes[faces[f][2]]];
+            if (std::isnan(a) || std::isnan(b) || std::isnan(c))
+                continue;
+
+            long winding = std::lround((WrapPhase(b - a) + WrapPhase(c - b) + WrapPhase(a - c)) / (2 * M_PI));
+            if (winding == 0)
+                continue;
+
+            mSingularities.push_back(time);
+            mSingularities.insert(mSingularities.end(), &mCentroids[3 * e], &mCentroids[3 * e] + 3);
+            mSingularities.push_back(winding);
+            break;
+        }
+    }
+}
+
+/**
+ * Extends the first dimension of a dataset to numRows and writes the local block at pStart, pCount (row count 0
+ * to write nothing). Collective
+ */
+static void WriteBlock(hid_t fileId, const char* pName, hid_t type, hsize_t numRows, const hsize_t* pStart,
+                       const hsize_t* pCount, const void* pData) {
+    hid_t dataset_id = H5Dopen(fileId, pName, H5P_DEFAULT);
+    hid_t filespace = H5Dget_space(dataset_id);
+    hsize_t dims[2];
+    H5Sget_simple_extent_dims(filespace, dims, nullptr);
+    H5Sclose(filespace);
+    dims[0] = numRows;
+    H5Dset_extent(dataset_id, dims);
+
+    QutemuHdf5::WriteHyperslab(dataset_id, type, pStart, pCount, pData);
+    H5Dclose(dataset_id);
+}
+
+static void CreateDataset(hid_t fileId, const char* pName, hid_t type, hsize_t columns, hsize_t chunkRows) {
+    int rank = columns ? 2 : 1;
+    hsize_t dims[2] = {0, columns};
+    hsize_t max_dims[2] = {H5S_UNLIMITED, columns};
+    hsize_t chunking[2] = {chunkRows, columns};
+
+    hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(dcpl, rank, chunking);
+    hid_t filespace = H5Screate_simple(rank, dims, max_dims);
+    hid_t dataset_id = H5Dcreate(fileId, pName, type, filespace, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+    H5Dclose(dataset_id);
+    H5Sclose(filespace);
+    H5Pclose(dcpl);
+}
+
+void FibrillationOutputModifier::WriteWindow(double time) {
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const unsigned num_bins = mFrequencies.size();
+    std::vector<float> velocity(mNumberOwned), cycle_length(mNumberOwned), frequency(mNumberOwned);
+    for (unsigned i = 0; i < mNumberOwned; i++) {
+        velocity[i] = mVelocityCount[i] ? mVelocitySum[i] / mVelocityCount[i] : nan;
+        cycle_length[i] = mCycleCount[i] ? mCycleSum[i] / mCycleCount[i] : nan;
+
+        frequency[i] = nan;
+        if (mCycleCount[i] == 0)
+            continue;
+        const float* p_spectrum = &mSpectrum[(size_t)i * 2 * num_bins];
+        float peak = 0;
+        for (unsigned k = 0; k < num_bins; k++) {
+            float power = p_spectrum[2 * k] * p_spectrum[2 * k] + p_spectrum[2 * k + 1] * p_spectrum[2 * k + 1];
+            if (power > peak) {
+                peak = power;
+                frequency[i] = mFrequencies[k];
+            }
+        }
+    }
+
+    const bool master = PetscTools::AmMaster();
+    const unsigned row = mNumRows++;
+    hsize_t node_start[2] = {row, mLo};
+    hsize_t node_count[2] = {1, mNumberOwned};
+    WriteBlock(mFileId, "CV", H5T_NATIVE_FLOAT, mNumRows, node_start, node_count, velocity.data());
+    WriteBlock(mFileId, "CycleLength", H5T_NATIVE_FLOAT, mNumRows, node_start, node_count, cycle_length.data());
+    WriteBlock(mFileId, "DominantFrequency", H5T_NATIVE_FLOAT, mNumRows, node_start, node_count, frequency.data());
+
+    unsigned local = mSingularities.size() / SINGULARITY_FIELDS;
+    unsigned offset = 0;
+    MPI_Exscan(&local, &offset, 1, MPI_UNSIGNED, MPI_SUM, PETSC_COMM_WORLD);
+    if (PetscTools::AmMaster())
+        offset = 0;
+    MPI_Allreduce(&local, &mSingularityCount, 1, MPI_UNSIGNED, MPI_SUM, PETSC_COMM_WORLD);
+
+    double duration = time - mWindowStart;
+    hsize_t row_start[1] = {row};
+    hsize_t row_count[1] = {master ? 1u : 0u};
+    WriteBlock(mFileId, "Time", H5T_NATIVE_DOUBLE, mNumRows, row_start, row_count, &time);
+    WriteBlock(mFileId, "Duration", H5T_NATIVE_DOUBLE, mNumRows, row_start, row_count, &duration);
+    WriteBlock(mFileId, "SingularityCount", H5T_NATIVE_UINT, mNumRows, row_start, row_count, &mSingularityCount);
+
+    hsize_t singularity_start[2] = {mNumSingularities + offset, 0};
+    hsize_t singularity_count[2] = {local, SINGULARITY_FIELDS};
+    mNumSingularities += mSingularityCount;
+    WriteBlock(mFileId, "PhaseSingularities", H5T_NATIVE_DOUBLE, mNumSingularities, singularity_start,
+               singularity_count, mSingularities.data());
+}
+
+void FibrillationOutputModifier::ResetWindow(double time) {
+    mWindowStart = time;
+    mNextSample = time + mSampleInterval;
+    std::fill(mCycleSum.begin(), mCycleSum.end(), 0.0f);
+    std::fill(mCycleCount.begin(), mCycleCount.end(), 0u);
+    std::fill(mVelocitySum.begin(), mVelocitySum.end(), 0.0f);
+    std::fill(mVelocityCount.begin(), mVelocityCount.end(), 0u);
+    std::fill(mSpectrum.begin(), mSpectrum.end(), 0.0f);
+    mSingularities.clear();
+}
+
+void FibrillationOutputModifier::InitialiseAtStart(DistributedVectorFactory *pVectorFactory) {
+    if (mDim == 0)
+        EXCEPTION("FibrillationOutputModifier::SetMesh must be called before solving");
+    if (pVectorFactory->GetLow() != mLo || pVectorFactory->GetLocalOwnership() != mNumberOwned)
+        EXCEPTION("FibrillationOutputModifier was set up with a different partition of the mesh");
+
+    OutputFileHandler output_file_handler(HeartConfig::Instance()->GetOutputDirectory(), false);
+    Open(mInitialised && output_file_handler.FindFile(mFilename).IsFile());
+    mInitialised = true;
+}
+
+void FibrillationOutputModifier::Open(bool resume) {
+    OutputFileHandler output_file_handler(HeartConfig::Instance()->GetOutputDirectory(), false);
+    std::string file_name = output_file_handler.FindFile(mFilename).GetAbsolutePath();
+
+    hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
+    H5Pset_fapl_mpio(fapl, PETSC_COMM_WORLD, MPI_INFO_NULL);
+    if (resume)
+        mFileId = H5Fopen(file_name.c_str(), H5F_ACC_RDWR, fapl);
+    else
+        mFileId = H5Fcreate(file_name.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl);
+    H5Pclose(fapl);
+
+    if (mFileId < 0)
+        EXCEPTION("Failed to Create H5F " << file_name << " error code = " << mFileId);
+
+    if (!resume) {
+        CreateDataset(mFileId, "CV", H5T_NATIVE_FLOAT, mNumNodes, 1);
+        CreateDataset(mFileId, "CycleLength", H5T_NATIVE_FLOAT, mNumNodes, 1);
+        CreateDataset(mFileId, "DominantFrequency", H5T_NATIVE_FLOAT, mNumNodes, 1);
+        CreateDataset(mFileId, "Time", H5T_NATIVE_DOUBLE, 0, 64);
+        CreateDataset(mFileId, "Duration", H5T_NATIVE_DOUBLE, 0, 64);
+        CreateDataset(mFileId, "SingularityCount", H5T_NATIVE_UINT, 0, 64);
+        CreateDataset(mFileId, "PhaseSingularities", H5T_NATIVE_DOUBLE, SINGULARITY_FIELDS, 1024);
+        mNumRows = 0;
+        mNumSingularities = 0;
+    }
+}
+
+void FibrillationOutputModifier::FinaliseAtEnd() {
+    Close();
+}
+
+void FibrillationOutputModifier::FlushWindow() {
+    if (!mInitialised || !mStarted || mPreviousTime <= mWindowStart)
+        return;
+
+    Open(true);
+    WriteWindow(mPreviousTime);
+    ResetWindow(mPreviousTime);
+    Close();
+}
+
+void FibrillationOutputModifier::Close() {
+    if (!mFileId)
+        return;
+
+    H5Fclose(mFileId);
+    mFileId = 0;
+}
+
+void FibrillationOutputModifier::ProcessSolutionAtTimeStep(double time, Vec solution, unsigned problemDim) {
+    if (mStarted && time <= mPreviousTime)
+        return;
+
+    TRACE_SCOPE("Fibrillation");
+    double* p_solution;
+    VecGetArray(solution, &p_solution);
+
+    if (!mStarted) {
+        for (unsigned i = 0; i < mNumberOwned; i++)
+            mPreviousVoltage[i] = p_solution[i * problemDim];
+        mStarted = true;
+        ResetWindow(time);
+    }
+    else {
+        DetectActivations(time, p_solution, problemDim);
+        if (time >= mNextSample - 1e-9) {
+            Sample(time, p_solution, problemDim);
+            while (mNextSample <= time + 1e-9)
+                mNextSample += mSampleInterval;
+        }
+    }
+    mPreviousTime = time;
+    VecRestoreArray(solution, &p_solution);
+
+    // windows end on multiples of the window length
+    if (time >= (std::floor(mWindowStart / mWindow + 1e-9) + 1) * mWindow - 1e-9) {
+        WriteWindow(time);
+        ResetWindow(time);
+    }
+}
+
+void FibrillationOutputModifier::ProcessPdeSolutionAtTimeStep(double time, Vec solution, unsigned problemDim) {
+    ProcessSolutionAtTimeStep(time, solution, problemDim);
+}
+
+template void FibrillationOutputModifier::SetMesh<2>(AbstractTetrahedralMesh<2,2>& rMesh);
+template void FibrillationOutputModifier::SetMesh<3>(AbstractTetrahedralMesh<3,3>& rMesh);
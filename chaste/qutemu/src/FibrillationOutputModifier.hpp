@@ -0,0 +1,132 @@
+#pragma once
+
+#include <vector>
+
+#include "AbstractOutputModifier.hpp"
+#include "AbstractTetrahedralMesh.hpp"
+
+/**
+ * Fibrillation metrics computed while the simulation runs, so sweeps don't need full voltage fields on disk.
+ *
+ * Activations are upward crossings of the threshold voltage, interpolated between PDE steps. Every sample
+ * interval (-fibrillation_dt):
+ *  - the voltage of each node is added to a Hann windowed DFT over the dominant frequency band
+ *  - each element whose nodes have all activated in the same wave gives a conduction velocity, 1/|grad t|
+ *    of the linear activation time field, credited to its owned nodes. Waves spanning more than the maximum
+ *    activation spread and velocities above the maximum (collisions, breakthroughs) are left out
+ *  - phase singularities are elements (faces, in 3D) around which the activation phase, 2pi of the last cycle
+ *    length since the last activation, winds by a full turn
+ * The activation times and phases of the halo nodes are exchanged with the neighbouring processes only.
+ *
+ * Windows of simulated time end on multiples of the window length, the last at FlushWindow. Each writes a row of
+ * the HDF5 file:
+ *  /Time, /Duration [row]                   end and length of the window (ms)
+ *  /CV [row][node]                          mean conduction velocity (m/s)
+ *  /CycleLength [row][node]                 mean time between activations (ms)
+ *  /DominantFrequency [row][node]           peak of the voltage spectrum (Hz)
+ *  /SingularityCount [row]                  phase singularity detections over all samples
+ *  /PhaseSingularities [detection][5]       time, x, y, z, winding (+1 or -1) of each detection
+ * Node columns are in mesh order, NaN where a node didn't activate. Elements are counted by the process owning
+ * their lowest node. State is kept between Solve calls, but not archived, so a loaded simulation starts again
+ */
+class FibrillationOutputModifier : public AbstractOutputModifier
+{
+private:
+    double mThresholdVoltage;
+    double mWindow;         ///< ms
+    double mSampleInterval; ///< ms
+    double mMaxSpread = 10; ///< Maximum activation time difference within an element for one wave (ms)
+    double mMaxVelocity = 2; ///< m/s
+
+    unsigned mDim = 0;
+    unsigned mNumNodes = 0;    ///< Global problem size
+    unsigned mLo = 0;
+    unsigned mNumberOwned = 0;
+    unsigned mNumHalo = 0;
+
+    /** Per local element, slots into the node arrays: owned nodes first, then halo nodes */
+    std::vector<unsigned> mElementNodes;
+    std::vector<float> mInverseJacobian;   ///< DIM*DIM per element, row major
+    std::vector<float> mCentroids;         ///< 3 per element
+    std::vector<float> mElementWave;       ///< Latest activation of the last wave measured, per element
+    std::vector<unsigned> mCountedElements; ///< Elements with this process owning their lowest node
+
+    /** Halo exchange: global indices are sorted, so each neighbour's nodes are contiguous */
+    std::vector<int> mRecvRanks, mRecvOffsets; ///< mRecvOffsets has an extra end entry
+    std::vector<int> mSendRanks, mSendOffsets;
+    std::vector<unsigned> mSendNodes;           ///< Owned slots sent to each of mSendRanks in turn
+    std::vector<float> mSendBuffer, mRecvBuffer;
+
+    /** Node state, owned and halo slots */
+    std::vector<float> mActivation;
+    std::vector<float> mPhase;
+
+    /** Node state, owned only */
+    std::vector<float> mPreviousVoltage;
+    std::vector<float> mCycleLength; ///< Last cycle length
+    std::vector<float> mCycleSum;
+    std::vector<unsigned> mCycleCount;
+    std::vector<float> mVelocitySum;
+    std::vector<unsigned> mVelocityCount;
+    std::vector<float> mSpectrum;    ///< Re, im of each frequency, per node
+
+    double mFrequencyMin = 3;
+    double mFrequencyMax = 15;
+    std::vector<double> mFrequencies; ///< Hz, spaced by the window resolution
+
+    double mPreviousTime = 0;
+    double mWindowStart = 0;
+    double mNextSample = 0;
+    bool mStarted = false;
+
+    std::vector<double> mSingularities; ///< 5 per detection this window
+    unsigned mSingularityCount = 0;     ///< Global detections in the last written window
+    unsigned mNumRows = 0;
+    unsigned mNumSingularities = 0;     ///< Rows of /PhaseSingularities
+    bool mInitialised = false;
+    hid_t mFileId = 0;
+
+    template<unsigned DIM>
+    void BuildElements(AbstractTetrahedralMesh<DIM,DIM>& rMesh, std::vector<unsigned>& rHalo);
+    void SetupExchange(const std::vector<unsigned>& rHalo);
+    void ExchangeHalo();
+
+    void DetectActivations(double time, const double* pSolution, unsigned problemDim);
+    void Sample(double time, const double* pSolution, unsigned problemDim);
+    void MeasureVelocities();
+    void DetectSingularities(double time);
+    void WriteWindow(double time);
+    void ResetWindow(double time);
+    void Open(bool resume);
+    void Close();
+
+public:
+    /**
+     * @param window simulated time per output row (ms)
+     * @param sampleInterval time between samples of the spectrum, velocities and singularities (ms)
+     */
+    FibrillationOutputModifier(const std::string& rFilename, double thresholdVoltage, double window, double sampleInterval);
+
+    ~FibrillationOutputModifier() override;
+
+    /** Builds the element geometry and halo exchange for the local elements. Collective, call before Solve */
+    template<unsigned DIM>
+    void SetMesh(AbstractTetrahedralMesh<DIM,DIM>& rMesh);
+
+    /** Band searched for the dominant frequency (Hz). Call before SetMesh */
+    void SetFrequencyBand(double min, double max);
+
+    /**
+     * Writes the part window since the last row, at the end of the simulation. Windows carry on over Solve
+     * calls, so segmented solves (checkpoints, stop checks) give the same rows. Collective
+     */
+    void FlushWindow();
+
+    /** Phase singularity detections in the last written window, over all processes */
+    unsigned GetSingularityCount() const { return mSingularityCount; }
+
+    void InitialiseAtStart(DistributedVectorFactory *pVectorFactory) override;
+    void FinaliseAtEnd() override;
+    void ProcessSolutionAtTimeStep(double time, Vec solution, unsigned problemDim) override;
+    void ProcessPdeSolutionAtTimeStep(double time, Vec solution, unsigned problemDim) override;
+};
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <cmath>
+#include <hdf5.h>
+#include <limits>
+#include <metis.h>
+#include <numeric>
+
+#include "NodeCost.hpp"
+#include "Exception.hpp"
+#include "QutemuHdf5.hpp"
+
+NodeCost::NodeCost() :
+        mMeshHash(0)
+{}
+
+NodeCost::NodeCost(uint64_t meshHash, const std::vector<double>& rCost, const std::vector<unsigned>& rRank) :
+        mMeshHash(meshHash),
+        mCost(rCost),
+        mRank(rRank)
+{
+    if (mCost.size() != mRank.size())
+        EXCEPTION("Node costs have " << mCost.size() << " entries, node ranks have " << mRank.size());
+}
+
+template<typename T>
+static void ReadCostDataset(hid_t fileId, const char* pName, hid_t type, std::vector<T>& rData)
+{
+    hid_t dataset_id = H5Dopen(fileId, pName, H5P_DEFAULT);
+    if (dataset_id <= 0)
+        EXCEPTION("Cost file has no dataset '" << pName << "'");
+
+    hid_t dspace = H5Dget_space(dataset_id);
+    rData.resize(H5Sget_simple_extent_npoints(dspace));
+    H5Sclose(dspace);
+
+    if (!rData.empty())
+        H5Dread(dataset_id, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, &rData[0]);
+    H5Dclose(dataset_id);
+}
+
+template<typename T>
+static void WriteCostDataset(hid_t fileId, const char* pName, hid_t type, const std::vector<T>& rData)
+{
+    hsize_t dims[1] = {rData.size()};
+    hid_t dspace = H5Screate_simple(1, dims, nullptr);
+    hid_t dataset_id = H5Dcreate(fileId, pName, type, dspace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    if (!rData.empty())
+        H5Dwrite(dataset_id, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, &rData[0]);
+    H5Dclose(dataset_id);
+    H5Sclose(dspace);
+}
+
+void NodeCost::Load(const FileFinder& rFile) {
+    std::string file_name = rFile.GetAbsolutePath();
+    if (!rFile.IsFile())
+        EXCEPTION("Couldn't open file: " << file_name);
+
+    hid_t file_id = H5Fopen(file_name.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (file_id <= 0)
+        EXCEPTION("Could not open " << file_name << " , H5Fopen error code = " << file_id);
+
+    mMeshHash = 0;
+    hid_t attr_id = H5Aopen(file_id, "MeshHash", H5P_DEFAULT);
+    if (attr_id > 0) {
+        H5Aread(attr_id, H5T_NATIVE_UINT64, &mMeshHash);
+        H5Aclose(attr_id);
+    }
+
+    try {
+        ReadCostDataset(file_id, "Cost", H5T_NATIVE_DOUBLE, mCost);
+        ReadCostDataset(file_id, "Rank", H5T_NATIVE_UINT, mRank);
+    }
+    catch (const Exception&) {
+        H5Fclose(file_id);
+        throw;
+    }
+    H5Fclose(file_id);
+
+    if (mCost.size() != mRank.size())
+        EXCEPTION("Cost file " << file_name << " has " << mCost.size() << " costs and " << mRank.size() << " ranks");
+}
+
+void NodeCost::Save(const FileFinder& rFile) const {
+    std::string file_name = rFile.GetAbsolutePath();
+    hid_t file_id = H5Fcreate(file_name.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if (file_id <= 0)
+        EXCEPTION("Could not create " << file_name << " , H5Fcreate error code = " << file_id);
+
+    WriteCostDataset(file_id, "Cost", H5T_NATIVE_DOUBLE, mCost);
+    WriteCostDataset(file_id, "Rank", H5T_NATIVE_UINT, mRank);
+
+    QutemuHdf5::WriteAttribute(file_id, "MeshHash", H5T_NATIVE_UINT64, &mMeshHash);
+    H5Fclose(file_id);
+}
+
+std::vector<double> NodeCost::GetProcessCosts(const std::vector<unsigned>& rRanks, unsigned numProcs) const {
+    std::vector<double> costs(numProcs, 0.0);
+    for (unsigned i = 0; i < mCost.size(); i++)
+        if (rRanks[i] < numProcs)
+            costs[rRanks[i]] += mCost[i];
+
+    return costs;
+}
+
+double NodeCost::GetImbalance(const std::vector<double>& rProcessCosts) {
+    double total = std::accumulate(rProcessCosts.begin(), rProcessCosts.end(), 0.0);
+    if (total <= 0)
+        return 1.0;
+
+    return *std::max_element(rProcessCosts.begin(), rProcessCosts.end()) * rProcessCosts.size() / total;
+}
+
+std::vector<unsigned> NodeCost::Partition(const uint32_t* pElements, unsigned numElements, unsigned nodesPerElement,
+                                          unsigned numProcs) const {
+    std::vector<unsigned> ranks(mCost.size(), 0);
+    if (numProcs <= 1 || mCost.empty())
+        return ranks;
+
+    // METIS takes integer weights, scaled so the total fits in an idx_t
+    double min_cost = std::numeric_limits<double>::max();
+    double total = 0;
+    for (double cost : mCost) {
+        if (cost > 0)
+            min_cost = std::min(min_cost, cost);
+        total += cost;
+    }
+    if (total <= 0)
+        EXCEPTION("Cost file has no recorded costs");
+
+    const double mean_weight = std::min(1000.0, 1e9 / mCost.size());
+    const double scale = mean_weight * mCost.size() / total;
+    std::vector<idx_t> weights(mCost.size());
+    for (unsigned i = 0; i < mCost.size(); i++)
+        weights[i] = std::max((idx_t)1, (idx_t)std::lround((mCost[i] > 0 ? mCost[i] : min_cost) * scale));
+
+    idx_t num_elements = numElements;
+    idx_t num_nodes = mCost.size();
+    idx_t num_parts = numProcs;
+    std::vector<idx_t> element_ptr(numElements + 1);
+    std::vector<idx_t> element_nodes((size_t)numElements * nodesPerElement);
+    for (unsigned e = 0; e <= numElements; e++)
+        element_ptr[e] = (idx_t)e * nodesPerElement;
+    for (size_t i = 0; i < element_nodes.size(); i++) {
+        if (pElements[i] >= mCost.size())
+            EXCEPTION("Element node " << pElements[i] << " is not in the cost file of " << mCost.size() << " nodes");
+        element_nodes[i] = pElements[i];
+    }
+
+    idx_t options[METIS_NOPTIONS];
+    METIS_SetDefaultOptions(options);
+    idx_t edge_cut;
+    std::vector<idx_t> element_parts(numElements);
+    std::vector<idx_t> node_parts(mCost.size());
+    int result = METIS_PartMeshNodal(&num_elements, &num_nodes, &element_ptr[0], &element_nodes[0], &weights[0],
+                                     nullptr, &num_parts, nullptr, options, &edge_cut, &element_parts[0], &node_parts[0]);
+    if (result != METIS_OK)
+        EXCEPTION("METIS_PartMeshNodal failed with error " << result);
+
+    for (unsigned i = 0; i < ranks.size(); i++)
+        ranks[i] = node_parts[i];
+    return ranks;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "FileFinder.hpp"
+
+/**
+ * Integration cost of each node of a mesh, recorded with -record_cost (see CostRecordingCell) and used with
+ * -cost_weights to partition the mesh so each process has the same cost rather than the same number of nodes.
+ *
+ * HDF5 cost files contain
+ *  /Cost (double) seconds spent integrating the cell of each .node file node
+ *  /Rank (uint)   process which owned each .node file node in the recorded run
+ *  MeshHash attribute (uint64) identifying the mesh, 0 if it was not loaded through the mesh cache
+ */
+class NodeCost
+{
+private:
+    uint64_t mMeshHash;
+    std::vector<double> mCost;
+    std::vector<unsigned> mRank;
+
+public:
+    NodeCost();
+
+    NodeCost(uint64_t meshHash, const std::vector<double>& rCost, const std::vector<unsigned>& rRank);
+
+    /** Called on the master only */
+    void Load(const FileFinder& rFile);
+
+    /** Called on the master only */
+    void Save(const FileFinder& rFile) const;
+
+    uint64_t GetMeshHash() const { return mMeshHash; }
+    unsigned GetNumNodes() const { return mCost.size(); }
+    const std::vector<double>& rGetCost() const { return mCost; }
+    const std::vector<unsigned>& rGetRank() const { return mRank; }
+
+    /** Cost of the nodes of each of numProcs processes, with the nodes on rRanks */
+    std::vector<double> GetProcessCosts(const std::vector<unsigned>& rRanks, unsigned numProcs) const;
+
+    /** Slowest process cost over the mean, 1 for a perfect balance */
+    static double GetImbalance(const std::vector<double>& rProcessCosts);
+
+    /**
+     * Partitions the nodal graph of a mesh with METIS, weighting the nodes by cost. Nodes without a recorded
+     * cost weigh as much as the cheapest recorded node.
+     * @param pElements node indices of each element, nodesPerElement each, numbered as the cost
+     * @return the process of each node
+     */
+    std::vector<unsigned> Partition(const uint32_t* pElements, unsigned numElements, unsigned nodesPerElement,
+                                    unsigned numProcs) const;
+};
@@ -0,0 +1,140 @@
+#include <hdf5.h>
+#include <numeric>
+#include <sstream>
+
+#include "NodePartition.hpp"
+#include "Exception.hpp"
+#include "PetscTools.hpp"
+#include "QutemuHdf5.hpp"
+
+NodePartition::NodePartition() :
+        mMeshHash(0)
+{}
+
+NodePartition::NodePartition(uint64_t meshHash, const std::vector<unsigned>& rOwnership, const std::vector<unsigned>& rPermutation) :
+        mMeshHash(meshHash),
+        mOwnership(rOwnership),
+        mPermutation(rPermutation)
+{
+    if (!mPermutation.empty() && mPermutation.size() != GetNumNodes())
+        EXCEPTION("Node permutation has " << mPermutation.size() << " entries, the partition has " << GetNumNodes() << " nodes");
+}
+
+NodePartition NodePartition::FromNodeRanks(uint64_t meshHash, const std::vector<unsigned>& rRanks, unsigned numProcs) {
+    std::vector<unsigned> ownership(numProcs, 0);
+    for (unsigned rank : rRanks) {
+        if (rank >= numProcs)
+            EXCEPTION("Node assigned to process " << rank << " of " << numProcs);
+        ownership[rank]++;
+    }
+
+    std::vector<unsigned> next(numProcs, 0);
+    std::partial_sum(ownership.begin(), ownership.end() - 1, next.begin() + 1);
+    std::vector<unsigned> permutation(rRanks.size());
+    for (unsigned i = 0; i < rRanks.size(); i++)
+        permutation[i] = next[rRanks[i]]++;
+
+    return NodePartition(meshHash, ownership, permutation);
+}
+
+std::string NodePartition::GetFileName(const std::string& rCacheName, unsigned numProcs) {
+    std::stringstream ss;
+    ss << rCacheName << ".partition" << numProcs << ".h5";
+    return ss.str();
+}
+
+unsigned NodePartition::GetNumNodes() const {
+    return std::accumulate(mOwnership.begin(), mOwnership.end(), 0u);
+}
+
+unsigned NodePartition::GetLow(unsigned rank) const {
+    return std::accumulate(mOwnership.begin(), mOwnership.begin() + rank, 0u);
+}
+
+static void ReadPartitionDataset(hid_t fileId, const char* pName, std::vector<unsigned>& rData)
+{
+    hid_t dataset_id = H5Dopen(fileId, pName, H5P_DEFAULT);
+    if (dataset_id <= 0)
+        EXCEPTION("Partition file has no dataset '" << pName << "'");
+
+    hid_t dspace = H5Dget_space(dataset_id);
+    rData.resize(H5Sget_simple_extent_npoints(dspace));
+    H5Sclose(dspace);
+
+    if (!rData.empty())
+        H5Dread(dataset_id, H5T_NATIVE_UINT, H5S_ALL, H5S_ALL, H5P_DEFAULT, &rData[0]);
+    H5Dclose(dataset_id);
+}
+
+static void WritePartitionDataset(hid_t fileId, const char* pName, const std::vector<unsigned>& rData)
+{
+    hsize_t dims[1] = {rData.size()};
+    hid_t dspace = H5Screate_simple(1, dims, nullptr);
+    hid_t dataset_id = H5Dcreate(fileId, pName, H5T_NATIVE_UINT, dspace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    if (!rData.empty())
+        H5Dwrite(dataset_id, H5T_NATIVE_UINT, H5S_ALL, H5S_ALL, H5P_DEFAULT, &rData[0]);
+    H5Dclose(dataset_id);
+    H5Sclose(dspace);
+}
+
+bool NodePartition::Load(const FileFinder& rFile) {
+    unsigned sizes[2] = {0, 0};
+    if (PetscTools::AmMaster() && rFile.IsFile()) {
+        hid_t file_id = H5Fopen(rFile.GetAbsolutePath().c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+        if (file_id > 0) {
+            mMeshHash = 0;
+            hid_t attr_id = H5Aopen(file_id, "MeshHash", H5P_DEFAULT);
+            if (attr_id > 0) {
+                H5Aread(attr_id, H5T_NATIVE_UINT64, &mMeshHash);
+                H5Aclose(attr_id);
+            }
+
+            try {
+                ReadPartitionDataset(file_id, "Ownership", mOwnership);
+                ReadPartitionDataset(file_id, "Permutation", mPermutation);
+                if (!mOwnership.empty() && (mPermutation.empty() || mPermutation.size() == GetNumNodes())) {
+                    sizes[0] = mOwnership.size();
+                    sizes[1] = mPermutation.size();
+                }
+            }
+            catch (const Exception&) {
+                // an unreadable partition is recomputed
+            }
+            H5Fclose(file_id);
+        }
+    }
+
+    MPI_Bcast(sizes, 2, MPI_UNSIGNED, 0, PETSC_COMM_WORLD);
+    if (sizes[0] == 0)
+        return false;
+
+    Broadcast();
+    return true;
+}
+
+void NodePartition::Broadcast() {
+    unsigned sizes[2] = {(unsigned)mOwnership.size(), (unsigned)mPermutation.size()};
+    MPI_Bcast(sizes, 2, MPI_UNSIGNED, 0, PETSC_COMM_WORLD);
+
+    unsigned long long hash = mMeshHash;
+    MPI_Bcast(&hash, 1, MPI_UNSIGNED_LONG_LONG, 0, PETSC_COMM_WORLD);
+    mMeshHash = hash;
+    mOwnership.resize(sizes[0]);
+    mPermutation.resize(sizes[1]);
+    MPI_Bcast(&mOwnership[0], sizes[0], MPI_UNSIGNED, 0, PETSC_COMM_WORLD);
+    if (sizes[1] > 0)
+        MPI_Bcast(&mPermutation[0], sizes[1], MPI_UNSIGNED, 0, PETSC_COMM_WORLD);
+}
+
+void NodePartition::Save(const FileFinder& rFile) const {
+    std::string file_name = rFile.GetAbsolutePath();
+    hid_t file_id = H5Fcreate(file_name.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if (file_id <= 0)
+        EXCEPTION("Could not create " << file_name << " , H5Fcreate error code = " << file_id);
+
+    WritePartitionDataset(file_id, "Permutation", mPermutation);
+    WritePartitionDataset(file_id, "Ownership", mOwnership);
+
+    QutemuHdf5::WriteAttribute(file_id, "MeshHash", H5T_NATIVE_UINT64, &mMeshHash);
+    H5Fclose(file_id);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "FileFinder.hpp"
+
+/**
+ * The node ownership and permutation of a partitioned mesh. Saved next to the mesh cache, so later runs on the
+ * same mesh and number of processes can skip partitioning, and to the output as permutation.h5 for post processing.
+ *
+ * HDF5 partition files contain
+ *  /Permutation (uint) mesh (Chaste) index of each .node file node, empty if the mesh is not permuted
+ *  /Ownership   (uint) number of nodes owned by each process, in rank order
+ *  MeshHash attribute (uint64) identifying the mesh the partition belongs to
+ */
+class NodePartition
+{
+private:
+    uint64_t mMeshHash;
+    std::vector<unsigned> mOwnership;
+    std::vector<unsigned> mPermutation;
+
+public:
+    NodePartition();
+
+    NodePartition(uint64_t meshHash, const std::vector<unsigned>& rOwnership, const std::vector<unsigned>& rPermutation);
+
+    /**
+     * The partition putting each node on rRanks[node], numProcs processes. Nodes are numbered by process, keeping
+     * their file order within each process
+     */
+    static NodePartition FromNodeRanks(uint64_t meshHash, const std::vector<unsigned>& rRanks, unsigned numProcs);
+
+    /** Partition sidecar of a mesh cache for numProcs processes */
+    static std::string GetFileName(const std::string& rCacheName, unsigned numProcs);
+
+    /**
+     * Collective, the master reads the file and broadcasts it.
+     * @return false if the file is missing or unreadable. Check the mesh hash and number of processes before use
+     */
+    bool Load(const FileFinder& rFile);
+
+    /** Collective, sends the partition on the master to every process */
+    void Broadcast();
+
+    /** Called on the master only */
+    void Save(const FileFinder& rFile) const;
+
+    uint64_t GetMeshHash() const { return mMeshHash; }
+    unsigned GetNumProcs() const { return mOwnership.size(); }
+    unsigned GetNumNodes() const;
+
+    /** First node owned by rank, in mesh order */
+    unsigned GetLow(unsigned rank) const;
+
+    const std::vector<unsigned>& rGetOwnership() const { return mOwnership; }
+    const std::vector<unsigned>& rGetPermutation() const { return mPermutation; }
+};
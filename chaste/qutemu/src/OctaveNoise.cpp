@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <hdf5.h>
+
+#include "OctaveNoise.hpp"
+#include "Exception.hpp"
+#include "PetscTools.hpp"
+
+static const unsigned BLOCK_SIZE = 64; ///< Points per block, sized so the block working set stays in L1
+
+OctaveNoise::OctaveNoise(unsigned numHarmonics, unsigned seed) :
+        mHarmonics(numHarmonics)
+{
+    InitGradients();
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> unit_dist(0.0, 1.0);
+    for (Harmonic& h : mHarmonics) {
+        for (unsigned d = 0; d < 3; d++) {
+            std::iota(h.mTable[d], h.mTable[d] + 256, 0);
+            std::shuffle(h.mTable[d], h.mTable[d] + 256, rng);
+        }
+        for (unsigned d = 0; d < 3; d++)
+            h.mOffset[d] = unit_dist(rng);
+    }
+}
+
+OctaveNoise::OctaveNoise(const FileFinder& rSeedFile)
+{
+    InitGradients();
+
+    std::string file_name = rSeedFile.GetAbsolutePath();
+    if (!rSeedFile.Exists())
+        EXCEPTION("Could not open " << file_name << " , as it does not exist.");
+
+    hid_t file_id = H5Fopen(file_name.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (file_id <= 0)
+        EXCEPTION("Could not open " << file_name << " , H5Fopen error code = " << file_id);
+
+    hid_t table_id = H5Dopen(file_id, "Table", H5P_DEFAULT);
+    hid_t offset_id = H5Dopen(file_id, "Offset", H5P_DEFAULT);
+    if (table_id <= 0 || offset_id <= 0)
+    {
+        if (table_id > 0) H5Dclose(table_id);
+        if (offset_id > 0) H5Dclose(offset_id);
+        H5Fclose(file_id);
+        EXCEPTION("Opened " << file_name << " but could not find the datasets 'Table' and 'Offset'");
+    }
+
+    hid_t dspace = H5Dget_space(table_id);
+    hsize_t n = H5Sget_simple_extent_npoints(dspace) / (3*256);
+    H5Sclose(dspace);
+    dspace = H5Dget_space(offset_id);
+    hsize_t n_offsets = H5Sget_simple_extent_npoints(dspace) / 3;
+    H5Sclose(dspace);
+    if (n == 0 || n != n_offsets)
+    {
+        H5Dclose(table_id);
+        H5Dclose(offset_id);
+        H5Fclose(file_id);
+        EXCEPTION("Seed file " << file_name << " has mismatched Table and Offset sizes");
+    }
+
+    std::vector<int> tables(n*3*256);
+    std::vector<double> offsets(n*3);
+    H5Dread(table_id, H5T_NATIVE_INT, H5S_ALL, H5S_ALL, H5P_DEFAULT, &tables[0]);
+    H5Dread(offset_id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, &offsets[0]);
+    H5Dclose(table_id);
+    H5Dclose(offset_id);
+    H5Fclose(file_id);
+
+    mHarmonics.resize(n);
+    for (unsigned i = 0; i < n; i++) {
+        for (unsigned d = 0; d < 3; d++) {
+            for (unsigned j = 0; j < 256; j++)
+                mHarmonics[i].mTable[d][j] = tables[(i*3 + d)*256 + j] & 0xFF;
+            mHarmonics[i].mOffset[d] = offsets[i*3 + d];
+        }
+    }
+}
+
+void OctaveNoise::InitGradients() {
+    //sphere_fibonacci_grid_points(256)
+    const int ng = 256;
+    const double phi = (1.0 + sqrt(5.0)) / 2.0;
+    for (int j = 0; j < ng; j++) {
+        double i = -(ng - 1) + 2*j;
+        double theta = 2 * M_PI * i / phi;
+        double cphi = sqrt((ng + i) * (ng - i)) / ng;
+        mGradients[0][j] = cphi * sin(theta);
+        mGradients[1][j] = cphi * cos(theta);
+        mGradients[2][j] = i / ng;
+    }
+}
+
+void OctaveNoise::AddPerlin(const Harmonic& rHarmonic, unsigned numPoints, const double* pX, const double* pY, const double* pZ,
+                            double scale, double weight, double* pNoise) const
+{
+    const double* p_pts[3] = {pX, pY, pZ};
+
+    for (unsigned base = 0; base < numPoints; base += BLOCK_SIZE) {
+        unsigned n = std::min(BLOCK_SIZE, numPoints - base);
+
+        // integer and fractional parts of grid, faded weights and permuted box corners per axis
+        double t[3][BLOCK_SIZE];
+        double fade[3][BLOCK_SIZE];
+        int perm_min[3][BLOCK_SIZE];
+        int perm_max[3][BLOCK_SIZE];
+        for (unsigned d = 0; d < 3; d++) {
+            const double* p_in = p_pts[d] ? p_pts[d] + base : nullptr;
+            const double offset = rHarmonic.mOffset[d];
+            const int* p_table = rHarmonic.mTable[d];
+            for (unsigned i = 0; i < n; i++) {
+                double x = p_in ? p_in[i] * scale + offset : 0.0; //2D as octave.m twoD, z and its offset 0
+                double boxmin = floor(x);
+                double boxmax = ceil(x); //note, not floor+1 (matches MATLAB for integer coordinates)
+                double tt = x - boxmin;
+                t[d][i] = tt;
+                fade[d][i] = tt * tt * tt * (tt * (tt * 6 - 15) + 10);
+                perm_min[d][i] = p_table[(((int)boxmin % 256) + 256) % 256];
+                perm_max[d][i] = p_table[(((int)boxmax % 256) + 256) % 256];
+            }
+        }
+
+        // gradient dot products at the 8 corners. Corner c uses the max side of x, y, z for bits 4, 2, 1
+        double corner[8][BLOCK_SIZE];
+        for (unsigned c = 0; c < 8; c++) {
+            const int* kx = (c & 4) ? perm_max[0] : perm_min[0];
+            const int* ky = (c & 2) ? perm_max[1] : perm_min[1];
+            const int* kz = (c & 1) ? perm_max[2] : perm_min[2];
+            const double sx = (c & 4) ? 1.0 : 0.0;
+            const double sy = (c & 2) ? 1.0 : 0.0;
+            const double sz = (c & 1) ? 1.0 : 0.0;
+            for (unsigned i = 0; i < n; i++) {
+                int k = kx[i] ^ ky[i] ^ kz[i];
+                corner[c][i] = mGradients[0][k] * (t[0][i] - sx) +
+                               mGradients[1][k] * (t[1][i] - sy) +
+                               mGradients[2][k] * (t[2][i] - sz);
+            }
+        }
+
+        // lerp between the 8 sample points
+        double* p_out = pNoise + base;
+        for (unsigned i = 0; i < n; i++) {
+            double fx = fade[0][i], fy = fade[1][i], fz = fade[2][i];
+            double x0 = corner[0][i] * (1 - fx) + corner[4][i] * fx;
+            double x1 = corner[1][i] * (1 - fx) + corner[5][i] * fx;
+            double x2 = corner[2][i] * (1 - fx) + corner[6][i] * fx;
+            double x3 = corner[3][i] * (1 - fx) + corner[7][i] * fx;
+            double y0 = x0 * (1 - fy) + x2 * fy;
+            double y1 = x1 * (1 - fy) + x3 * fy;
+            p_out[i] = p_out[i] + (y0 * (1 - fz) + y1 * fz) * weight;
+        }
+    }
+}
+
+void OctaveNoise::Sample(unsigned numPoints, const double* pX, const double* pY, const double* pZ,
+                         double unit, unsigned harmonics, double roughness, double* pNoise) const
+{
+    if (harmonics < 1 || harmonics > mHarmonics.size())
+        EXCEPTION("Requested " << harmonics << " harmonics, but only " << mHarmonics.size() << " are seeded");
+
+    // pts / unit, computed once rather than per harmonic
+    std::vector<double> scaled(3*numPoints);
+    const double* p_pts[3] = {pX, pY, pZ};
+    const double* p_scaled[3] = {nullptr, nullptr, nullptr};
+    for (unsigned d = 0; d < 3; d++) {
+        if (!p_pts[d])
+            continue;
+        double* p = &scaled[d*numPoints];
+        for (unsigned i = 0; i < numPoints; i++)
+            p[i] = p_pts[d][i] / unit;
+        p_scaled[d] = p;
+    }
+
+    std::fill(pNoise, pNoise + numPoints, 0.0);
+    double max = 0;
+    for (unsigned h = 0; h < harmonics; h++) {
+        double weight = pow(roughness, h);
+        AddPerlin(mHarmonics[h], numPoints, p_scaled[0], p_scaled[1], p_scaled[2], pow(2.0, h), weight, pNoise);
+        max += weight;
+    }
+
+    for (unsigned i = 0; i < numPoints; i++)
+        pNoise[i] = pNoise[i] / max;
+}
+
+double OctaveNoise::FindLevel(const std::vector<double>& rValues, const std::vector<bool>& rCounted, double threshold) {
+    const unsigned num_bins = 1000;
+
+    double range[2] = {std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity()};//min, -max
+    for (unsigned i = 0; i < rValues.size(); i++) {
+        if (rCounted[i]) {
+            range[0] = std::min(range[0], rValues[i]);
+            range[1] = std::min(range[1], -rValues[i]);
+        }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, range, 2, MPI_DOUBLE, MPI_MIN, PETSC_COMM_WORLD);
+    double min = range[0];
+    double max = -range[1];
+    if (!(max > min))
+        return max;
+
+    double width = (max - min) / num_bins;
+    std::vector<double> bins(num_bins, 0.0);
+    for (unsigned i = 0; i < rValues.size(); i++) {
+        if (rCounted[i]) {
+            unsigned k = std::min((unsigned)((rValues[i] - min) / width), num_bins - 1);
+            bins[k]++;
+        }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &bins[0], num_bins, MPI_DOUBLE, MPI_SUM, PETSC_COMM_WORLD);
+
+    double total = std::accumulate(bins.begin(), bins.end(), 0.0);
+    double cumsum = 0;
+    double best = std::numeric_limits<double>::infinity();
+    unsigned best_k = 0;
+    for (unsigned k = 0; k < num_bins; k++) {
+        cumsum += bins[k];
+        double err = fabs(cumsum / total - threshold);
+        if (err < best) {
+            best = err;
+            best_k = k;
+        }
+    }
+
+    return best_k + 1 == num_bins ? max : min + (best_k + 1) * width;
+}
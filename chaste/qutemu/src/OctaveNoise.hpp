@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+
+#include "FileFinder.hpp"
+
+/**
+ * Octave Perlin noise generator. A port of MATLAB/perlin/octave.m and perlin.m which
+ * produces the same noise field when given the same seed tables (see MATLAB/perlin/export_octave_seed.m)
+ */
+class OctaveNoise
+{
+private:
+    struct Harmonic
+    {
+        int mTable[3][256]; ///< Permutation tables (0-255) for x, y and z
+        double mOffset[3];  ///< Offset in the unit cube, removes grid alignment between harmonics
+    };
+
+    std::vector<Harmonic> mHarmonics;
+    double mGradients[3][256]; ///< 256 fibonacci sphere points, stored per component
+
+    void InitGradients();
+    void AddPerlin(const Harmonic& rHarmonic, unsigned numPoints, const double* pX, const double* pY, const double* pZ,
+                   double scale, double weight, double* pNoise) const;
+
+public:
+    /** Random seed tables. Will not match MATLAB's randperm/rand for the same seed */
+    OctaveNoise(unsigned numHarmonics, unsigned seed);
+
+    /** Seed tables from a HDF5 file with datasets /Table (n x 3 x 256) and /Offset (n x 3) */
+    OctaveNoise(const FileFinder& rSeedFile);
+
+    unsigned GetNumHarmonics() const { return mHarmonics.size(); }
+
+    /**
+     * Equivalent to octave(pts / unit, tables(1:harmonics), roughness) in MATLAB.
+     * Points are given as separate coordinate arrays, pZ may be NULL for 2D meshes, which is
+     * octave([pts / unit, zeros], tables(1:harmonics), roughness, true)
+     */
+    void Sample(unsigned numPoints, const double* pX, const double* pY, const double* pZ,
+                double unit, unsigned harmonics, double roughness, double* pNoise) const;
+
+    /**
+     * Parallel port of MATLAB/perlin/find_level.m. Returns the level f such that the fraction
+     * of values <= f is closest to threshold, using a 1000 bin cumulative histogram.
+     * Collective, rCounted selects which local values contribute (so halo entries are not counted twice)
+     */
+    static double FindLevel(const std::vector<double>& rValues, const std::vector<bool>& rCounted, double threshold);
+};
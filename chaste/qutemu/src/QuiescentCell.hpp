@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+#include "AbstractIvpOdeSolver.hpp"
+#include "AbstractStimulusFunction.hpp"
+
+/** Cell steps of the QuiescentCells on one process, shared by the cells of a factory */
+struct QuiescentStatistics
+{
+    unsigned long long mSteps = 0;   ///< Calls to SolveAndUpdateState
+    unsigned long long mSkipped = 0; ///< Steps not integrated because the cell was frozen
+    unsigned long long mWakes = 0;   ///< Frozen cells woken by a voltage change or a stimulus
+};
+
+/**
+ * Stops integrating a cell once it has settled at rest. After mSettleSteps consecutive steps without a stimulus,
+ * where every state variable (including the voltage set from the PDE solution) changes by less than
+ * mTolerance per ms, relative to its magnitude, the state is frozen and SolveAndUpdateState returns straight
+ * away. The tissue still sets the voltage and takes the ionic current from the frozen state, so diffusion
+ * carries on. The cell is woken as soon as its voltage moves mWakeVoltage from where it was frozen, or its
+ * stimulus is on, which happens well before an approaching wavefront reaches threshold.
+ *
+ * Cells are not archived, so this is only used for simulations which are not saved
+ */
+template<class CELL>
+class QuiescentCell : public CELL
+{
+private:
+    boost::shared_ptr<QuiescentStatistics> mpStatistics;
+    double mTolerance;
+    double mWakeVoltage;
+    unsigned mSettleSteps;
+
+    std::vector<double> mLastState; ///< State after the previous integrated step, empty after waking
+    unsigned mQuietSteps;
+    bool mFrozen;
+    double mFrozenVoltage;
+
+    /** State magnitudes below this are compared absolutely, gates close to 0 would never settle otherwise */
+    static constexpr double MIN_SCALE = 1e-3;
+
+    bool IsStimulated(double tStart, double tEnd) {
+        return this->GetStimulus(tStart) != 0.0 || this->GetStimulus(tEnd) != 0.0;
+    }
+
+public:
+    QuiescentCell(boost::shared_ptr<AbstractIvpOdeSolver> pSolver, boost::shared_ptr<AbstractStimulusFunction> pStimulus,
+                  boost::shared_ptr<QuiescentStatistics> pStatistics, double tolerance, double wakeVoltage, unsigned settleSteps) :
+            CELL(pSolver, pStimulus),
+            mpStatistics(pStatistics),
+            mTolerance(tolerance),
+            mWakeVoltage(wakeVoltage),
+            mSettleSteps(settleSteps),
+            mQuietSteps(0),
+            mFrozen(false),
+            mFrozenVoltage(0)
+    {}
+
+    bool IsFrozen() const { return mFrozen; }
+
+    void SolveAndUpdateState(double tStart, double tEnd) override {
+        mpStatistics->mSteps++;
+        bool stimulated = IsStimulated(tStart, tEnd);
+        if (mFrozen) {
+            if (!stimulated && fabs(this->GetVoltage() - mFrozenVoltage) < mWakeVoltage) {
+                mpStatistics->mSkipped++;
+                return;
+            }
+
+            mFrozen = false;
+            mQuietSteps = 0;
+            mLastState.clear();
+            mpStatistics->mWakes++;
+        }
+
+        CELL::SolveAndUpdateState(tStart, tEnd);
+
+        // read in place, GetStdVecStateVariables would allocate a copy every step
+        const unsigned num_state = this->GetNumberOfStateVariables();
+        double rate = std::numeric_limits<double>::infinity();
+        if (mLastState.size() == num_state) {
+            double change = 0;
+            for (unsigned i = 0; i < num_state; i++) {
+                const double value = this->GetStateVariable(i);
+                change = std::max(change, fabs(value - mLastState[i]) / fmax(fabs(value), MIN_SCALE));
+                mLastState[i] = value;
+            }
+            rate = change / (tEnd - tStart);
+        }
+        else {
+            mLastState.resize(num_state); // within the capacity after the first step
+            for (unsigned i = 0; i < num_state; i++)
+                mLastState[i] = this->GetStateVariable(i);
+        }
+
+        mQuietSteps = (!stimulated && rate < mTolerance) ? mQuietSteps + 1 : 0;
+        if (mQuietSteps >= mSettleSteps) {
+            mFrozen = true;
+            mFrozenVoltage = this->GetVoltage();
+        }
+    }
+};
@@ -0,0 +1,68 @@
+#include "QutemuHdf5.hpp"
+
+static void TransferHyperslab(hid_t datasetId, hid_t memType, const hsize_t* pStart, const hsize_t* pCount,
+                              void* pData, bool write) {
+    hid_t hyperslab_space = H5Dget_space(datasetId);
+    int rank = H5Sget_simple_extent_ndims(hyperslab_space);
+    hsize_t size = 1;
+    for (int d = 0; d < rank; d++)
+        size *= pCount[d];
+
+    hid_t memspace;
+    if (size != 0) {
+        memspace = H5Screate_simple(1, &size, nullptr);
+        H5Sselect_hyperslab(hyperslab_space, H5S_SELECT_SET, pStart, nullptr, pCount, nullptr);
+    }
+    else {
+        H5Sclose(hyperslab_space);
+        memspace = H5Screate(H5S_NULL);
+        hyperslab_space = H5Screate(H5S_NULL);
+    }
+
+    hid_t property_list_id = H5Pcreate(H5P_DATASET_XFER);
+    H5Pset_dxpl_mpio(property_list_id, H5FD_MPIO_COLLECTIVE);
+    if (write)
+        H5Dwrite(datasetId, memType, memspace, hyperslab_space, property_list_id, size ? pData : nullptr);
+    else
+        H5Dread(datasetId, memType, memspace, hyperslab_space, property_list_id, size ? pData : nullptr);
+
+    H5Sclose(memspace);
+    H5Sclose(hyperslab_space);
+    H5Pclose(property_list_id);
+}
+
+void QutemuHdf5::WriteHyperslab(hid_t datasetId, hid_t memType, const hsize_t* pStart, const hsize_t* pCount,
+                                const void* pData) {
+    TransferHyperslab(datasetId, memType, pStart, pCount, const_cast<void*>(pData), true);
+}
+
+void QutemuHdf5::ReadHyperslab(hid_t datasetId, hid_t memType, const hsize_t* pStart, const hsize_t* pCount, void* pData) {
+    TransferHyperslab(datasetId, memType, pStart, pCount, pData, false);
+}
+
+void QutemuHdf5::WriteAttribute(hid_t objectId, const char* pName, hid_t type, const void* pValue) {
+    hid_t space = H5Screate(H5S_SCALAR);
+    hid_t attr_id = H5Acreate(objectId, pName, type, space, H5P_DEFAULT, H5P_DEFAULT);
+    H5Awrite(attr_id, type, pValue);
+    H5Aclose(attr_id);
+    H5Sclose(space);
+}
+
+void QutemuHdf5::WriteAttribute(hid_t objectId, const char* pName, double value) {
+    WriteAttribute(objectId, pName, H5T_NATIVE_DOUBLE, &value);
+}
+
+double QutemuHdf5::ReadDoubleAttribute(hid_t objectId, const char* pName) {
+    double value = 0;
+    hid_t attr_id = H5Aopen(objectId, pName, H5P_DEFAULT);
+    H5Aread(attr_id, H5T_NATIVE_DOUBLE, &value);
+    H5Aclose(attr_id);
+    return value;
+}
+
+void QutemuHdf5::WriteAttribute(hid_t objectId, const char* pName, const std::string& rValue) {
+    hid_t type = H5Tcopy(H5T_C_S1);
+    H5Tset_size(type, rValue.size());
+    WriteAttribute(objectId, pName, type, rValue.c_str());
+    H5Tclose(type);
+}
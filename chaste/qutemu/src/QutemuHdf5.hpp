@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <hdf5.h>
+
+/**
+ * HDF5 helpers shared by the output modifiers. Hyperslab transfers are collective: a process with nothing to
+ * transfer (a 0 in its count) still takes part, with H5S_NULL selections
+ */
+class QutemuHdf5
+{
+public:
+    /** Collective write of the block at pStart, pCount of a dataset, from contiguous pData */
+    static void WriteHyperslab(hid_t datasetId, hid_t memType, const hsize_t* pStart, const hsize_t* pCount,
+                               const void* pData);
+
+    /** Collective read of the block at pStart, pCount of a dataset, into contiguous pData */
+    static void ReadHyperslab(hid_t datasetId, hid_t memType, const hsize_t* pStart, const hsize_t* pCount, void* pData);
+
+    /** Creates a scalar attribute of type, written from pValue */
+    static void WriteAttribute(hid_t objectId, const char* pName, hid_t type, const void* pValue);
+
+    static void WriteAttribute(hid_t objectId, const char* pName, double value);
+
+    static double ReadDoubleAttribute(hid_t objectId, const char* pName);
+
+    /** Fixed length string attribute */
+    static void WriteAttribute(hid_t objectId, const char* pName, const std::string& rValue);
+};
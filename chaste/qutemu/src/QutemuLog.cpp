@@ -12,4 +12,9 @@ void QutemuLog::Log(const std::string &s)
 
 std::string QutemuLog::GetLog() {
     return log_stream.str();
+}
+
+void QutemuLog::Clear() {
+    log_stream.str("");
+    log_stream.clear();
 }
\ No newline at end of file
@@ -16,4 +16,6 @@ class QutemuLog
 public:
     static void Log(const std::string &s);
     static std::string GetLog();
+    /** Starts a new log, for each member of an ensemble */
+    static void Clear();
 };
\ No newline at end of file
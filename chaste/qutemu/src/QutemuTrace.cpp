@@ -0,0 +1,128 @@
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#include "QutemuTrace.hpp"
+#include "Exception.hpp"
+#include "PetscTools.hpp"
+
+namespace
+{
+    struct TraceEvent
+    {
+        const char* mpName;
+        double mStart;
+        double mDuration;
+    };
+
+    struct ThreadBuffer
+    {
+        unsigned mThread;
+        std::vector<TraceEvent> mEvents;
+        unsigned long long mDropped = 0;
+    };
+
+    /** Per thread, so about 100MB of events at most */
+    const size_t MAX_EVENTS_PER_THREAD = 1 << 22;
+
+    std::mutex registry_mutex;
+    std::vector<std::unique_ptr<ThreadBuffer> > registry; ///< Every thread's buffer, kept after the thread exits
+    std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+
+    ThreadBuffer& GetThreadBuffer() {
+        thread_local ThreadBuffer* p_buffer = nullptr;
+        if (!p_buffer) {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            registry.emplace_back(new ThreadBuffer());
+            p_buffer = registry.back().get();
+            p_buffer->mThread = registry.size() - 1;
+        }
+        return *p_buffer;
+    }
+}
+
+bool QutemuTrace::IsEnabled() {
+#ifdef QUTEMU_TRACE
+    return true;
+#else
+    return false;
+#endif
+}
+
+double QutemuTrace::Now() {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void QutemuTrace::Start() {
+    MPI_Barrier(PETSC_COMM_WORLD);
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (auto& p_buffer : registry) {
+        p_buffer->mEvents.clear();
+        p_buffer->mDropped = 0;
+    }
+    origin = std::chrono::steady_clock::now();
+}
+
+void QutemuTrace::Record(const char* pName, double start, double duration) {
+    ThreadBuffer& r_buffer = GetThreadBuffer();
+    if (r_buffer.mEvents.size() >= MAX_EVENTS_PER_THREAD) {
+        r_buffer.mDropped++;
+        return;
+    }
+    r_buffer.mEvents.push_back({pName, start, duration});
+}
+
+void QutemuTrace::Write(const FileFinder& rFile) {
+    const unsigned rank = PetscTools::GetMyRank();
+    std::stringstream events;
+    events.precision(3);
+    events << std::fixed;
+    events << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << rank << ", \"args\": {\"name\": \"rank " << rank << "\"}}";
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (auto& p_buffer : registry) {
+            for (const TraceEvent& r_event : p_buffer->mEvents)
+                events << ",\n{\"name\": \"" << r_event.mpName << "\", \"ph\": \"X\", \"pid\": " << rank << ", \"tid\": "
+                       << p_buffer->mThread << ", \"ts\": " << r_event.mStart << ", \"dur\": " << r_event.mDuration << "}";
+
+            if (p_buffer->mDropped > 0)
+                events << ",\n{\"name\": \"dropped " << p_buffer->mDropped << " events\", \"ph\": \"i\", \"s\": \"t\", \"pid\": "
+                       << rank << ", \"tid\": " << p_buffer->mThread << ", \"ts\": " << Now() << "}";
+        }
+    }
+
+    // opened before the events are sent, so every rank throws if the master can not write the file
+    std::ofstream file;
+    if (PetscTools::AmMaster()) {
+        std::string file_name = rFile.GetAbsolutePath();
+        file.open(file_name.c_str());
+        if (!file.is_open()) {
+            PetscTools::ReplicateException(true);
+            EXCEPTION("Couldn't open file: " << file_name);
+        }
+    }
+    PetscTools::ReplicateException(false);
+
+    // merged on the master, one rank at a time so it never holds more than its own and one other rank's events
+    std::string local = events.str();
+    if (!PetscTools::AmMaster()) {
+        unsigned long long size = local.size();
+        MPI_Send(&size, 1, MPI_UNSIGNED_LONG_LONG, 0, 0, PETSC_COMM_WORLD);
+        MPI_Send(&local[0], size, MPI_CHAR, 0, 1, PETSC_COMM_WORLD);
+        return;
+    }
+
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n" << local;
+    std::string received;
+    for (unsigned source = 1; source < PetscTools::GetNumProcs(); source++) {
+        unsigned long long size;
+        MPI_Recv(&size, 1, MPI_UNSIGNED_LONG_LONG, source, 0, PETSC_COMM_WORLD, MPI_STATUS_IGNORE);
+        received.resize(size);
+        MPI_Recv(&received[0], size, MPI_CHAR, source, 1, PETSC_COMM_WORLD, MPI_STATUS_IGNORE);
+        file << ",\n" << received;
+    }
+    file << "\n]}\n";
+}
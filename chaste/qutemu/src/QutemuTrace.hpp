@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+
+#include "FileFinder.hpp"
+
+/**
+ * Scoped tracing, compiled in with -DQUTEMU_TRACE=ON. TRACE_SCOPE("name") records the wall time from the macro to the
+ * end of the enclosing scope, and compiles to nothing otherwise. Names must be string literals.
+ *
+ * Events are kept in a buffer per thread, and QutemuTrace::Write gathers every rank's events into one Chrome trace
+ * (chrome://tracing or https://ui.perfetto.dev), with a process per rank and a thread per thread
+ */
+#ifdef QUTEMU_TRACE
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) QutemuTraceScope TRACE_CONCAT(__trace_scope_, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name)
+#endif
+
+class QutemuTrace
+{
+public:
+    /** Whether tracing is compiled in */
+    static bool IsEnabled();
+
+    /** Microseconds since the trace origin */
+    static double Now();
+
+    /**
+     * Restarts the trace, discarding the events so far and taking the time origin after a barrier, so the ranks
+     * line up. Collective
+     */
+    static void Start();
+
+    /** A complete event on the calling thread, times in microseconds */
+    static void Record(const char* pName, double start, double duration);
+
+    /** Writes the events of every rank to rFile as a Chrome trace. Collective */
+    static void Write(const FileFinder& rFile);
+};
+
+/** Records its lifetime, see TRACE_SCOPE */
+class QutemuTraceScope
+{
+private:
+    const char* mpName;
+    double mStart;
+
+public:
+    QutemuTraceScope(const char* pName) :
+            mpName(pName),
+            mStart(QutemuTrace::Now())
+    {}
+
+    ~QutemuTraceScope() {
+        QutemuTrace::Record(mpName, mStart, QutemuTrace::Now() - mStart);
+    }
+};
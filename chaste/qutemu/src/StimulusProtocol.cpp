@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <hdf5.h>
+
+#include "StimulusProtocol.hpp"
+#include "TimedStimulus.hpp"
+#include "Exception.hpp"
+
+/** Reads a whole 1D dataset, or leaves rData empty when optional and missing */
+template<typename T>
+static void ReadProtocolDataset(hid_t fileId, const std::string& rFileName, const char* pName, hid_t type,
+                                std::vector<T>& rData, bool optional=false)
+{
+    if (optional && H5Lexists(fileId, pName, H5P_DEFAULT) <= 0)
+        return;
+
+    hid_t dataset_id = H5Dopen(fileId, pName, H5P_DEFAULT);
+    if (dataset_id <= 0)
+    {
+        H5Fclose(fileId);
+        EXCEPTION("Opened " << rFileName << " but could not find the dataset '" << pName << "'");
+    }
+
+    hid_t dspace = H5Dget_space(dataset_id);
+    rData.resize(H5Sget_simple_extent_npoints(dspace));
+    H5Sclose(dspace);
+
+    if (!rData.empty())
+        H5Dread(dataset_id, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, &rData[0]);
+    H5Dclose(dataset_id);
+}
+
+StimulusProtocol::StimulusProtocol(const FileFinder& rFile) {
+    std::string file_name = rFile.GetAbsolutePath();
+    if (!rFile.Exists())
+        EXCEPTION("Could not open " << file_name << " , as it does not exist.");
+
+    hid_t file_id = H5Fopen(file_name.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (file_id <= 0)
+        EXCEPTION("Could not open " << file_name << " , H5Fopen error code = " << file_id);
+
+    ReadProtocolDataset(file_id, file_name, "SiteTimes", H5T_NATIVE_DOUBLE, mSiteTimes);
+    ReadProtocolDataset(file_id, file_name, "SiteOffsets", H5T_NATIVE_UINT, mSiteOffsets);
+    ReadProtocolDataset(file_id, file_name, "Site", H5T_NATIVE_INT, mNodeSite);
+    ReadProtocolDataset(file_id, file_name, "Delay", H5T_NATIVE_DOUBLE, mNodeDelay, true);
+    H5Fclose(file_id);
+
+    Validate();
+}
+
+StimulusProtocol::StimulusProtocol(const std::vector<std::vector<double> >& rSiteTimes,
+                                   const std::vector<int>& rNodeSite, const std::vector<double>& rNodeDelay) :
+        mSiteOffsets(1, 0),
+        mNodeSite(rNodeSite),
+        mNodeDelay(rNodeDelay)
+{
+    for (const std::vector<double>& times : rSiteTimes) {
+        mSiteTimes.insert(mSiteTimes.end(), times.begin(), times.end());
+        mSiteOffsets.push_back(mSiteTimes.size());
+    }
+
+    Validate();
+}
+
+void StimulusProtocol::Validate() {
+    if (mSiteOffsets.empty() || mSiteOffsets[0] != 0 || mSiteOffsets.back() != mSiteTimes.size())
+        EXCEPTION("Stimulus protocol site offsets do not cover the " << mSiteTimes.size() << " site times");
+
+    for (unsigned s = 0; s < GetNumSites(); s++) {
+        if (mSiteOffsets[s] > mSiteOffsets[s + 1])
+            EXCEPTION("Stimulus protocol site offsets are not ascending at site " << s);
+
+        // times are sorted on load so lookups can binary search
+        std::sort(mSiteTimes.begin() + mSiteOffsets[s], mSiteTimes.begin() + mSiteOffsets[s + 1]);
+    }
+
+    if (!mNodeDelay.empty() && mNodeDelay.size() != mNodeSite.size())
+        EXCEPTION("Stimulus protocol has " << mNodeSite.size() << " node sites but " << mNodeDelay.size() << " delays");
+
+    for (unsigned i = 0; i < mNodeSite.size(); i++)
+        if (mNodeSite[i] < -1 || mNodeSite[i] >= (int)GetNumSites())
+            EXCEPTION("Unknown stimulus site " << mNodeSite[i] << " at node " << i);
+}
+
+void StimulusProtocol::ApplyPermutation(const std::vector<unsigned>& rPermutation) {
+    if (rPermutation.empty())
+        return;
+
+    std::vector<int> sites(mNodeSite.size());
+    for (unsigned i = 0; i < mNodeSite.size(); i++)
+        sites[rPermutation[i]] = mNodeSite[i];
+    mNodeSite.swap(sites);
+
+    if (!mNodeDelay.empty()) {
+        std::vector<double> delays(mNodeDelay.size());
+        for (unsigned i = 0; i < mNodeDelay.size(); i++)
+            delays[rPermutation[i]] = mNodeDelay[i];
+        mNodeDelay.swap(delays);
+    }
+}
+
+std::vector<double> StimulusProtocol::GetAllTimes() const {
+    std::vector<double> times(mSiteTimes);
+    std::sort(times.begin(), times.end());
+    times.erase(std::unique(times.begin(), times.end()), times.end());
+    return times;
+}
+
+double StimulusProtocol::GetMaxDelay() const {
+    double max_delay = 0;
+    for (unsigned i = 0; i < mNodeDelay.size(); i++)
+        if (mNodeSite[i] >= 0)
+            max_delay = std::max(max_delay, mNodeDelay[i]);
+    return max_delay;
+}
+
+ProtocolStimulus::ProtocolStimulus(boost::shared_ptr<const StimulusProtocol> pProtocol, unsigned site, double delay,
+                                   double magnitude, double duration) :
+        mpProtocol(pProtocol),
+        mpTimes(pProtocol->GetSiteTimes(site)),
+        mNumTimes(pProtocol->GetNumSiteTimes(site)),
+        mDelay(delay),
+        mMagnitude(magnitude),
+        mDuration(duration),
+        mCursor(0),
+        mLastTime(0),
+        mLastStim(0)
+{}
+
+double ProtocolStimulus::GetStimulus(double time) {
+    if (time == mLastTime)
+        return mLastStim;
+
+    mLastTime = time;
+    bool active = mNumTimes > 0 && TimedStimulus::IsActive(mpTimes, mNumTimes, mDuration, time - mDelay, mCursor);
+    return mLastStim = active ? mMagnitude : 0;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+#include "AbstractStimulusFunction.hpp"
+#include "FileFinder.hpp"
+
+/**
+ * A pacing protocol of stimulus sites, each with its own sorted start times, and a site and delay per node.
+ * Site times are stored once in CSR form (mSiteTimes, mSiteOffsets) and shared by every node on that site.
+ *
+ * HDF5 protocol files contain
+ *  /SiteTimes   (double) all site start times, concatenated
+ *  /SiteOffsets (int)    numSites+1 offsets into SiteTimes
+ *  /Site        (int)    per node (in .node file order), -1 for unpaced nodes
+ *  /Delay       (double) per node, optional. Added to the site times of that node
+ */
+class StimulusProtocol
+{
+private:
+    std::vector<double> mSiteTimes;
+    std::vector<unsigned> mSiteOffsets;
+    std::vector<int> mNodeSite;
+    std::vector<double> mNodeDelay;
+
+    void Validate();
+
+public:
+    StimulusProtocol(const FileFinder& rFile);
+
+    /** Per node delays may be empty for no delay */
+    StimulusProtocol(const std::vector<std::vector<double> >& rSiteTimes,
+                     const std::vector<int>& rNodeSite, const std::vector<double>& rNodeDelay);
+
+    unsigned GetNumSites() const { return mSiteOffsets.size() - 1; }
+    unsigned GetNumNodes() const { return mNodeSite.size(); }
+
+    int GetSite(unsigned node) const { return mNodeSite[node]; }
+    double GetDelay(unsigned node) const { return mNodeDelay.empty() ? 0.0 : mNodeDelay[node]; }
+
+    const double* GetSiteTimes(unsigned site) const { return mSiteTimes.data() + mSiteOffsets[site]; }
+    unsigned GetNumSiteTimes(unsigned site) const { return mSiteOffsets[site + 1] - mSiteOffsets[site]; }
+
+    /** Reorders the per node data from .node file order to mesh order, perm[file index] = mesh index */
+    void ApplyPermutation(const std::vector<unsigned>& rPermutation);
+
+    /** All distinct site start times (without node delays), sorted */
+    std::vector<double> GetAllTimes() const;
+
+    /** Largest delay of a paced node, 0 without delays */
+    double GetMaxDelay() const;
+};
+
+/** Stimulus of one protocol site, shifted by a delay. Shares the site times with the protocol */
+class ProtocolStimulus : public AbstractStimulusFunction
+{
+private:
+    boost::shared_ptr<const StimulusProtocol> mpProtocol;
+    const double* mpTimes;
+    unsigned mNumTimes;
+    double mDelay;
+    double mMagnitude;
+    double mDuration;
+
+    unsigned mCursor; ///Optimisation
+    double mLastTime; ///Cache variable
+    double mLastStim; ///Cache variable
+
+public:
+    ProtocolStimulus(boost::shared_ptr<const StimulusProtocol> pProtocol, unsigned site, double delay,
+                     double magnitude, double duration);
+
+    double GetStimulus(double time) override;
+};
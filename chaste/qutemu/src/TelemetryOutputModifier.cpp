@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sys/resource.h>
+
+#include "TelemetryOutputModifier.hpp"
+#include "HeartConfig.hpp"
+#include "HeartEventHandler.hpp"
+#include "OutputFileHandler.hpp"
+
+TelemetryOutputModifier::TelemetryOutputModifier(const std::string& rFilename, double interval) :
+        AbstractOutputModifier(rFilename),
+        mInterval(interval),
+        mNextTime(0),
+        mStartWall(0),
+        mLastTime(0),
+        mLast(NUM_TIMES, 0.0)
+{
+    if (interval <= 0)
+        EXCEPTION("Telemetry interval must be positive");
+}
+
+double TelemetryOutputModifier::GetPeakMemory() {
+    struct rusage rusage;
+    getrusage(RUSAGE_SELF, &rusage);
+    return rusage.ru_maxrss / 1024.0; // KB to MB
+}
+
+std::vector<double> TelemetryOutputModifier::Sample() {
+    std::vector<double> sample(NUM_FIELDS, 0.0);
+    sample[ODE] = HeartEventHandler::GetElapsedTime(HeartEventHandler::SOLVE_ODES) / 1000;
+    sample[ASSEMBLY] = (HeartEventHandler::GetElapsedTime(HeartEventHandler::ASSEMBLE_SYSTEM)
+                        + HeartEventHandler::GetElapsedTime(HeartEventHandler::ASSEMBLE_RHS)) / 1000;
+    sample[LINEAR] = HeartEventHandler::GetElapsedTime(HeartEventHandler::SOLVE_LINEAR_SYSTEM) / 1000;
+    sample[COMMUNICATION] = HeartEventHandler::GetElapsedTime(HeartEventHandler::COMMUNICATION) / 1000;
+    sample[OUTPUT] = HeartEventHandler::GetElapsedTime(HeartEventHandler::WRITE_OUTPUT) / 1000;
+    for (auto& p_map : mActivationMaps) {
+        sample[MODIFIERS] += p_map->GetProcessTime();
+        sample[SNAPSHOT_WRITE] += p_map->GetWriteTime();
+    }
+    sample[PEAK_RSS] = GetPeakMemory();
+    return sample;
+}
+
+void TelemetryOutputModifier::InitialiseAtStart(DistributedVectorFactory *pVectorFactory) {
+    if (!mInitialised) {
+        mStartWall = MPI_Wtime();
+        mLast = Sample();
+        mLast.resize(NUM_TIMES);
+    }
+
+    if (PetscTools::AmMaster()) {
+        OutputFileHandler output_file_handler(HeartConfig::Instance()->GetOutputDirectory(), false);
+        std::string file_name = output_file_handler.FindFile(mFilename).GetAbsolutePath();
+        mFile.open(file_name.c_str(), (mInitialised || mAppend) ? std::ios::app : std::ios::trunc);
+        if (!mFile.is_open())
+            EXCEPTION("Couldn't open file: " << file_name);
+    }
+    mInitialised = true;
+}
+
+void TelemetryOutputModifier::FinaliseAtEnd() {
+    // the part interval at the end of the segment
+    if (mLastTime > mNextTime - mInterval)
+        Record(mLastTime);
+
+    if (mFile.is_open())
+        mFile.close();
+}
+
+void TelemetryOutputModifier::ProcessSolutionAtTimeStep(double time, Vec solution, unsigned problemDim) {
+    mLastTime = time;
+    if (mNextTime == 0)
+        mNextTime = (std::floor(time / mInterval + 1e-9) + 1) * mInterval;
+    if (time < mNextTime - 1e-9)
+        return;
+
+    Record(time);
+    while (mNextTime <= time + 1e-9)
+        mNextTime += mInterval;
+}
+
+void TelemetryOutputModifier::ProcessPdeSolutionAtTimeStep(double time, Vec solution, unsigned problemDim) {
+    ProcessSolutionAtTimeStep(time, solution, problemDim);
+}
+
+static void WriteArray(std::ostream& rOut, const char* pName, const std::vector<double>& rAll, unsigned field,
+                       unsigned numFields) {
+    rOut << ", \"" << pName << "\": [";
+    for (unsigned rank = 0; rank * numFields < rAll.size(); rank++)
+        rOut << (rank ? ", " : "") << rAll[rank * numFields + field];
+    rOut << "]";
+}
+
+static double Imbalance(const std::vector<double>& rAll, unsigned field, unsigned numFields) {
+    double max = 0, total = 0;
+    unsigned num_ranks = rAll.size() / numFields;
+    for (unsigned rank = 0; rank < num_ranks; rank++) {
+        max = std::max(max, rAll[rank * numFields + field]);
+        total += rAll[rank * numFields + field];
+    }
+    return total > 0 ? max * num_ranks / total : 1.0;
+}
+
+void TelemetryOutputModifier::Record(double time) {
+    std::vector<double> sample = Sample();
+    std::vector<double> delta(sample);
+    for (unsigned i = 0; i < NUM_TIMES; i++) {
+        delta[i] = sample[i] - mLast[i];
+        mLast[i] = sample[i];
+    }
+
+    std::vector<double> all(PetscTools::AmMaster() ? NUM_FIELDS * PetscTools::GetNumProcs() : 0);
+    MPI_Gather(&delta[0], NUM_FIELDS, MPI_DOUBLE, all.data(), NUM_FIELDS, MPI_DOUBLE, 0, PETSC_COMM_WORLD);
+    if (!mFile.is_open())
+        return;
+
+    mFile << std::fixed << std::setprecision(4) << "{\"time\": " << time << ", \"wall\": " << MPI_Wtime() - mStartWall;
+    WriteArray(mFile, "ode", all, ODE, NUM_FIELDS);
+    WriteArray(mFile, "assembly", all, ASSEMBLY, NUM_FIELDS);
+    WriteArray(mFile, "linear", all, LINEAR, NUM_FIELDS);
+    WriteArray(mFile, "communication", all, COMMUNICATION, NUM_FIELDS);
+    WriteArray(mFile, "output", all, OUTPUT, NUM_FIELDS);
+    WriteArray(mFile, "modifiers", all, MODIFIERS, NUM_FIELDS);
+    WriteArray(mFile, "snapshot_write", all, SNAPSHOT_WRITE, NUM_FIELDS);
+    mFile << std::setprecision(1);
+    WriteArray(mFile, "peak_rss_mb", all, PEAK_RSS, NUM_FIELDS);
+    mFile << std::setprecision(3) << ", \"imbalance\": {\"ode\": " << Imbalance(all, ODE, NUM_FIELDS)
+          << ", \"linear\": " << Imbalance(all, LINEAR, NUM_FIELDS) << "}}" << std::endl;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <fstream>
+#include <boost/shared_ptr.hpp>
+
+#include "AbstractOutputModifier.hpp"
+#include "ActivationMapOutputModifier.hpp"
+
+/**
+ * Appends one JSON line per interval of simulated time to a file in the output directory, with the wall time each
+ * process spent in each phase over the interval and its peak RSS, so load imbalance and memory growth can be
+ * watched while a long run is going:
+ *
+ *  {"time": 100, "wall": 12.5, "ode": [...], "assembly": [...], "linear": [...], "communication": [...],
+ *   "output": [...], "modifiers": [...], "snapshot_write": [...], "peak_rss_mb": [...],
+ *   "imbalance": {"ode": 1.08, "linear": 1.01}}
+ *
+ * Arrays are indexed by rank, times are seconds. The phases are the HeartEventHandler events, except modifiers
+ * (processing by the activation maps, including their snapshot writes) and snapshot_write. Imbalance is the
+ * slowest process over the mean. The values are gathered to the master and each line is flushed when written.
+ * Add it after the activation maps, so it sees their time for the step
+ */
+class TelemetryOutputModifier : public AbstractOutputModifier
+{
+private:
+    enum Field
+    {
+        ODE, ASSEMBLY, LINEAR, COMMUNICATION, OUTPUT, MODIFIERS, SNAPSHOT_WRITE, NUM_TIMES, PEAK_RSS = NUM_TIMES, NUM_FIELDS
+    };
+
+    double mInterval;
+    double mNextTime;
+    double mStartWall;
+    double mLastTime;
+    bool mInitialised = false; ///< Later Solve segments append to the file
+    bool mAppend = false;
+    std::vector<boost::shared_ptr<ActivationMapOutputModifier> > mActivationMaps;
+    std::vector<double> mLast; ///< Cumulative times at the last record
+    std::ofstream mFile;       ///< Open on the master
+
+    /** Cumulative times (s) and the current peak RSS of this process */
+    std::vector<double> Sample();
+
+    /** Collective */
+    void Record(double time);
+
+public:
+    /** @param interval simulated time between records (ms) */
+    TelemetryOutputModifier(const std::string& rFilename, double interval);
+
+    void AddActivationMap(boost::shared_ptr<ActivationMapOutputModifier> pMap) { mActivationMaps.push_back(pMap); }
+
+    /** Continue an existing file rather than replacing it, for runs resumed with -loaddir */
+    void SetAppend(bool append) { mAppend = append; }
+
+    /** Peak resident set size of this process (MB) */
+    static double GetPeakMemory();
+
+    void InitialiseAtStart(DistributedVectorFactory *pVectorFactory) override;
+    void FinaliseAtEnd() override;
+    void ProcessSolutionAtTimeStep(double time, Vec solution, unsigned problemDim) override;
+    void ProcessPdeSolutionAtTimeStep(double time, Vec solution, unsigned problemDim) override;
+};
@@ -1,23 +1,26 @@
+#include <algorithm>
+
 #include "TimedStimulus.hpp"
 
 double TimedStimulus::GetStimulus(double time) {
     if (time == mLastTime)
         return mLastStim;
 
-    if (time < mLastTime)
-        mStimIndex = 0;
-
     mLastTime = time;
+    bool active = !mTimes.empty() && IsActive(&mTimes[0], mTimes.size(), mDuration, time, mStimIndex);
+    return mLastStim = active ? mMagnitudeOfStimulus : 0;
+}
 
-    for (unsigned i = mStimIndex; i < mTimes.size(); i++) {
-        double startTime = mTimes[i];
-        if (startTime >= time)
-            break;
-
-        mStimIndex = i;
-        if (time >= startTime && time <= startTime + mDuration)
-            return mLastStim = mMagnitudeOfStimulus;
+bool TimedStimulus::IsActive(const double* pTimes, unsigned numTimes, double duration, double time, unsigned& rCursor) {
+    // the cursor stays valid while pTimes[rCursor] < time <= pTimes[rCursor+1]
+    bool valid = rCursor < numTimes && pTimes[rCursor] < time && (rCursor + 1 == numTimes || time <= pTimes[rCursor + 1]);
+    if (!valid) {
+        // first start >= time, the one before it is the latest start
+        unsigned next = std::lower_bound(pTimes, pTimes + numTimes, time) - pTimes;
+        if (next == 0)
+            return false;
+        rCursor = next - 1;
     }
 
-    return mLastStim = 0;
+    return time <= pTimes[rCursor] + duration;
 }
@@ -28,4 +28,10 @@ public:
     {}
 
     double GetStimulus(double time) override;
-};
\ No newline at end of file
+
+    /**
+     * True if time is within (start, start + duration] of the last start before it, in the sorted pTimes.
+     * rCursor caches the index of that start, so monotonic times are O(1) and jumps fall back to a binary search
+     */
+    static bool IsActive(const double* pTimes, unsigned numTimes, double duration, double time, unsigned& rCursor);
+};
@@ -0,0 +1,73 @@
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#include "TissueConductivityTable.hpp"
+#include "Exception.hpp"
+
+TissueConductivityTable::TissueConductivityTable() {
+    const unsigned atrial_wall[] = {32, 33, 76, 111, 112, 161, 162, 192, 193, 194, 195, 196, 197, 198, 199};
+    for (unsigned c : atrial_wall)
+        Set(c, 2.0, 1.0);
+
+    // sinus node and surroundings
+    for (unsigned c = 80; c <= 86; c++)
+        Set(c, 0.5, 0.5);
+
+    // crista terminalis
+    Set(72, 7.7, 0.7);
+
+    // pectinatae muscles, Bachman Bundle
+    const unsigned bundles[] = {74, 98, 102, 103};
+    for (unsigned c : bundles)
+        Set(c, 5.5, 2.75);
+
+    Set(104, 1.1, 1.1);
+}
+
+TissueConductivityTable::TissueConductivityTable(const FileFinder& rFile) {
+    std::string file_name = rFile.GetAbsolutePath();
+    std::ifstream file(file_name.c_str(), std::ios::in);
+    if (!file.is_open())
+        EXCEPTION("Couldn't open file: " + file_name);
+
+    std::string line;
+    unsigned line_number = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+        std::stringstream ss(line);
+        std::string first;
+        if (!(ss >> first) || first[0] == '#')
+            continue;
+
+        unsigned tissue_class;
+        double gll, gtt;
+        std::stringstream class_ss(first);
+        if (!(class_ss >> tissue_class) || !(ss >> gll >> gtt))
+            EXCEPTION("Invalid tissue conductivity entry '" << line << "' on line " << line_number << " of " << file_name);
+
+        Set(tissue_class, gll, gtt);
+    }
+}
+
+void TissueConductivityTable::Set(unsigned tissueClass, double gll, double gtt) {
+    if (tissueClass >= mLongitudinal.size()) {
+        mLongitudinal.resize(tissueClass + 1, std::numeric_limits<double>::quiet_NaN());
+        mTransverse.resize(tissueClass + 1, std::numeric_limits<double>::quiet_NaN());
+    }
+
+    mLongitudinal[tissueClass] = gll;
+    mTransverse[tissueClass] = gtt;
+}
+
+bool TissueConductivityTable::IsDefined(unsigned tissueClass) const {
+    return tissueClass < mLongitudinal.size() && !std::isnan(mLongitudinal[tissueClass]);
+}
+
+unsigned TissueConductivityTable::GetNumClasses() const {
+    unsigned n = 0;
+    for (unsigned c = 0; c < mLongitudinal.size(); c++)
+        n += IsDefined(c);
+    return n;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "FileFinder.hpp"
+
+/**
+ * Longitudinal and transverse conductivities by tissue class (the first element attribute).
+ * Stored densely by class number so lookups are a single index.
+ */
+class TissueConductivityTable
+{
+private:
+    std::vector<double> mLongitudinal; ///< gll by class, NaN for undefined classes
+    std::vector<double> mTransverse;   ///< gtt by class
+
+public:
+    /** The default atrial table, see Set calls in the constructor for the anatomical regions */
+    TissueConductivityTable();
+
+    /**
+     * Reads a table file with one "class gll gtt" entry per line. Blank lines and lines starting with # are ignored.
+     * Only the classes in the file are defined
+     */
+    TissueConductivityTable(const FileFinder& rFile);
+
+    void Set(unsigned tissueClass, double gll, double gtt);
+
+    bool IsDefined(unsigned tissueClass) const;
+
+    double GetLongitudinal(unsigned tissueClass) const { return mLongitudinal[tissueClass]; }
+    double GetTransverse(unsigned tissueClass) const { return mTransverse[tissueClass]; }
+
+    /** Number of defined classes */
+    unsigned GetNumClasses() const;
+};
@@ -0,0 +1,46 @@
+#include <algorithm>
+
+#include "TraceOutputModifier.hpp"
+#include "HeartEventHandler.hpp"
+#include "QutemuTrace.hpp"
+
+TraceOutputModifier::TraceOutputModifier() :
+        AbstractOutputModifier("trace"),
+        mLastStep(0)
+{
+    std::fill(mLast, mLast + NUM_PHASES, 0.0);
+}
+
+void TraceOutputModifier::Sample(double* pTimes) {
+    pTimes[ODE] = HeartEventHandler::GetElapsedTime(HeartEventHandler::SOLVE_ODES);
+    pTimes[ASSEMBLY] = HeartEventHandler::GetElapsedTime(HeartEventHandler::ASSEMBLE_SYSTEM)
+                       + HeartEventHandler::GetElapsedTime(HeartEventHandler::ASSEMBLE_RHS);
+    pTimes[LINEAR] = HeartEventHandler::GetElapsedTime(HeartEventHandler::SOLVE_LINEAR_SYSTEM);
+    pTimes[OUTPUT] = HeartEventHandler::GetElapsedTime(HeartEventHandler::WRITE_OUTPUT);
+}
+
+void TraceOutputModifier::InitialiseAtStart(DistributedVectorFactory *pVectorFactory) {
+    Sample(mLast);
+    mLastStep = QutemuTrace::Now();
+}
+
+void TraceOutputModifier::ProcessPdeSolutionAtTimeStep(double time, Vec solution, unsigned problemDim) {
+    static const char* names[NUM_PHASES] = {"ODE", "Assembly", "Linear", "Output"};
+
+    const double now = QutemuTrace::Now();
+    QutemuTrace::Record("Step", mLastStep, now - mLastStep);
+
+    double times[NUM_PHASES];
+    Sample(times);
+    double start = mLastStep;
+    for (unsigned i = 0; i < NUM_PHASES; i++) {
+        // ms to us, clamped so a phase never spills out of its step
+        double duration = std::min((times[i] - mLast[i]) * 1000, now - start);
+        if (duration > 0) {
+            QutemuTrace::Record(names[i], start, duration);
+            start += duration;
+        }
+        mLast[i] = times[i];
+    }
+    mLastStep = now;
+}
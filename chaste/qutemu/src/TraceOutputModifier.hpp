@@ -0,0 +1,31 @@
+#pragma once
+
+#include "AbstractOutputModifier.hpp"
+
+/**
+ * Splits each PDE step of a traced run (see QutemuTrace) into its phases. Chaste doesn't expose the loop, so the
+ * step is recorded as a span from the previous step, holding sequential ODE, assembly, linear solve and output
+ * spans sized by the HeartEventHandler time spent in each. The order within the step is approximate, the
+ * durations are not
+ */
+class TraceOutputModifier : public AbstractOutputModifier
+{
+private:
+    enum Phase
+    {
+        ODE, ASSEMBLY, LINEAR, OUTPUT, NUM_PHASES
+    };
+
+    double mLastStep;
+    double mLast[NUM_PHASES]; ///< Cumulative times (ms) at the last step
+
+    void Sample(double* pTimes);
+
+public:
+    TraceOutputModifier();
+
+    void InitialiseAtStart(DistributedVectorFactory *pVectorFactory) override;
+    void FinaliseAtEnd() override {}
+    void ProcessSolutionAtTimeStep(double time, Vec solution, unsigned problemDim) override {}
+    void ProcessPdeSolutionAtTimeStep(double time, Vec solution, unsigned problemDim) override;
+};
@@ -0,0 +1,101 @@
+#ifndef TESTBATCHEDCELL_HPP_
+#define TESTBATCHEDCELL_HPP_
+
+#include <cxxtest/TestSuite.h>
+
+#include "AtrialCellModels.hpp"
+#include "BatchedCell.hpp"
+#include "MonodomainProblem.hpp"
+#include "ReplicatableVector.hpp"
+#include "SimpleStimulus.hpp"
+#include "TetrahedralMesh.hpp"
+#include "PetscSetupAndFinalize.hpp"
+
+/** Courtemanche SR cells with solver, stimulated on the x = 0 face */
+class BatchedSlabCellFactory : public AbstractCardiacCellFactory<3>
+{
+private:
+    CellSolver mSolver;
+    boost::shared_ptr<SimpleStimulus> mpStimulus;
+    boost::shared_ptr<CourtemancheBatch> mpBatch;
+
+public:
+    BatchedSlabCellFactory(CellSolver solver) :
+            AbstractCardiacCellFactory<3>(),
+            mSolver(solver),
+            mpStimulus(new SimpleStimulus(-5e5, 1.0))
+    {}
+
+    AbstractCardiacCellInterface* CreateCardiacCellForTissueNode(Node<3>* pNode)
+    {
+        boost::shared_ptr<AbstractStimulusFunction> stimulus = pNode->rGetLocation()[0] < 1e-6 ?
+                (boost::shared_ptr<AbstractStimulusFunction>) mpStimulus : mpZeroStimulus;
+
+        if (mSolver != BATCHED_RUSH_LARSEN)
+            return CreateAtrialCell(COURTEMANCHE_SR, mSolver, false, mpSolver, stimulus);
+
+        if (!mpBatch)
+            mpBatch.reset(new CourtemancheBatch(GetBatchParameters(COURTEMANCHE_SR), HeartConfig::Instance()->GetOdeTimeStep(),
+                                                HeartConfig::Instance()->GetCapacitance()));
+        return new BatchedCell(mpSolver, stimulus, mpBatch, pNode->GetIndex());
+    }
+
+    /** As AtrialCellFactory::ConnectBatch */
+    void ConnectBatch(AbstractCardiacTissue<3>* pTissue) {
+        if (!mpBatch)
+            return;
+
+        ReplicatableVector& r_iionic = pTissue->rGetIionicCacheReplicated();
+        mpBatch->SetIonicCurrentCallback([&r_iionic](unsigned globalIndex, double iionic) {
+            r_iionic[globalIndex] = iionic;
+        });
+    }
+};
+
+class TestBatchedCell : public CxxTest::TestSuite
+{
+private:
+    /** Voltage at every node of a 1 x 0.2 x 0.2mm slab of 99 nodes, after 10ms of a planar wave along x */
+    std::vector<double> SolveSlab(CellSolver solver)
+    {
+        HeartConfig::Instance()->Reset();
+        HeartConfig::Instance()->SetSimulationDuration(10.0);
+        HeartConfig::Instance()->SetOutputDirectory("TestBatchedCell/" + GetCellSolverName(solver));
+        HeartConfig::Instance()->SetOutputFilenamePrefix("results");
+        HeartConfig::Instance()->SetOdePdeAndPrintingTimeSteps(0.02, 0.1, 1.0);
+
+        TetrahedralMesh<3,3> mesh;
+        mesh.ConstructRegularSlabMesh(0.01, 0.1, 0.02, 0.02);
+
+        BatchedSlabCellFactory cell_factory(solver);
+        MonodomainProblem<3> problem(&cell_factory);
+        problem.SetMesh(&mesh);
+        problem.Initialise();
+        cell_factory.ConnectBatch(problem.GetTissue());
+        problem.Solve();
+
+        ReplicatableVector voltage(problem.GetSolution());
+        return std::vector<double>(&voltage[0], &voltage[0] + voltage.GetSize());
+    }
+
+public:
+    /**
+     * The batch against the scalar Rush-Larsen cells it vectorises. 99 nodes make a full group of 64 and a partial
+     * one, whose ionic currents reach the tissue through the callback
+     */
+    void TestBatchedAgainstRushLarsen() throw(Exception)
+    {
+        std::vector<double> scalar = SolveSlab(RUSH_LARSEN);
+        std::vector<double> batched = SolveSlab(BATCHED_RUSH_LARSEN);
+        TS_ASSERT_EQUALS(batched.size(), 99u);
+
+        // nodes along x, the last well past the first group
+        const unsigned nodes[] = {0, 5, 10, 71, 98};
+        for (unsigned node : nodes) {
+            TS_ASSERT_LESS_THAN(-20.0, scalar[node]);
+            TS_ASSERT_DELTA(batched[node], scalar[node], 2.0);
+        }
+    }
+};
+
+#endif /*TESTBATCHEDCELL_HPP_*/
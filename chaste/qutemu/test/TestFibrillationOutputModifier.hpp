@@ -0,0 +1,73 @@
+#ifndef TESTFIBRILLATIONOUTPUTMODIFIER_HPP_
+#define TESTFIBRILLATIONOUTPUTMODIFIER_HPP_
+
+#include <cxxtest/TestSuite.h>
+#include <cmath>
+
+#include "FibrillationOutputModifier.hpp"
+#include "DistributedVector.hpp"
+#include "HeartConfig.hpp"
+#include "OutputFileHandler.hpp"
+#include "TetrahedralMesh.hpp"
+#include "TrianglesMeshReader.hpp"
+#include "PetscSetupAndFinalize.hpp"
+
+class TestFibrillationOutputModifier : public CxxTest::TestSuite
+{
+public:
+    /**
+     * A planar wave at 0.5m/s across two triangles, {0, 1, 2} and {1, 3, 2}, which never reaches node 3. Only the
+     * first triangle measures a velocity, the second must not be measured before its last node has activated
+     */
+    void TestVelocityWithUnactivatedNode() throw(Exception)
+    {
+        OutputFileHandler handler("TestFibrillationOutputModifier");
+        if (PetscTools::AmMaster()) {
+            *handler.OpenOutputFile("square.node") << "4 2 0 0\n0 0 0\n1 0.1 0\n2 0 0.1\n3 0.1 0.1\n";
+            *handler.OpenOutputFile("square.ele") << "2 3 0\n0 0 1 2\n1 1 3 2\n";
+            *handler.OpenOutputFile("square.edge") << "4 0\n0 0 1\n1 1 3\n2 3 2\n3 2 0\n";
+        }
+        PetscTools::Barrier("TestVelocityWithUnactivatedNode");
+
+        TrianglesMeshReader<2,2> reader(handler.GetOutputDirectoryFullPath() + "square");
+        TetrahedralMesh<2,2> mesh;
+        mesh.ConstructFromMeshReader(reader);
+        HeartConfig::Instance()->SetOutputDirectory("TestFibrillationOutputModifier");
+
+        FibrillationOutputModifier modifier("fibrillation.h5", -40, 1000, 1);
+        modifier.SetMesh(mesh);
+        DistributedVectorFactory* p_factory = mesh.GetDistributedVectorFactory();
+        modifier.InitialiseAtStart(p_factory);
+
+        Vec voltage = p_factory->CreateVec();
+        for (unsigned step = 0; step <= 200; step++) {
+            const double time = 0.5 * step;
+            DistributedVector distributed = p_factory->CreateDistributedVector(voltage);
+            for (DistributedVector::Iterator it = distributed.Begin(); it != distributed.End(); ++it) {
+                const double activation = 5 + mesh.GetNode(it.Global)->rGetLocation()[0] / 0.05;
+                distributed[it] = it.Global != 3 && time >= activation ? 20 : -80;
+            }
+            distributed.Restore();
+            modifier.ProcessPdeSolutionAtTimeStep(time, voltage, 1);
+        }
+        modifier.FinaliseAtEnd();
+        modifier.FlushWindow();
+        PetscTools::Destroy(voltage);
+
+        if (PetscTools::AmMaster()) {
+            std::string file_name = handler.FindFile("fibrillation.h5").GetAbsolutePath();
+            hid_t file_id = H5Fopen(file_name.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+            hid_t dataset_id = H5Dopen(file_id, "CV", H5P_DEFAULT);
+            float velocity[4];
+            H5Dread(dataset_id, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, velocity);
+            H5Dclose(dataset_id);
+            H5Fclose(file_id);
+
+            for (unsigned i = 0; i < 3; i++)
+                TS_ASSERT_DELTA(velocity[i], 0.5, 1e-4);
+            TS_ASSERT(std::isnan(velocity[3]));
+        }
+    }
+};
+
+#endif /*TESTFIBRILLATIONOUTPUTMODIFIER_HPP_*/
@@ -0,0 +1,111 @@
+#ifndef TESTOCTAVENOISE_HPP_
+#define TESTOCTAVENOISE_HPP_
+
+#include <cxxtest/TestSuite.h>
+#include <cmath>
+#include <hdf5.h>
+
+#include "OctaveNoise.hpp"
+#include "OutputFileHandler.hpp"
+#include "PetscSetupAndFinalize.hpp"
+
+class TestOctaveNoise : public CxxTest::TestSuite
+{
+public:
+    void TestSampling() throw(Exception)
+    {
+        OctaveNoise noise(4, 1234);
+        TS_ASSERT_EQUALS(noise.GetNumHarmonics(), 4u);
+
+        const unsigned n = 1000;
+        std::vector<double> x(n), y(n), z(n);
+        for (unsigned i = 0; i < n; i++) {
+            x[i] = 0.37 * i;
+            y[i] = 0.11 * i * i / n;
+            z[i] = -0.53 * i;
+        }
+
+        std::vector<double> a(n), b(n);
+        noise.Sample(n, &x[0], &y[0], &z[0], 5.0, 4, 0.5, &a[0]);
+        OctaveNoise(4, 1234).Sample(n, &x[0], &y[0], &z[0], 5.0, 4, 0.5, &b[0]);
+        for (unsigned i = 0; i < n; i++) {
+            TS_ASSERT_EQUALS(a[i], b[i]);
+            TS_ASSERT_LESS_THAN(std::fabs(a[i]), 1.0);
+        }
+
+        TS_ASSERT_THROWS_CONTAINS(noise.Sample(n, &x[0], &y[0], &z[0], 5.0, 5, 0.5, &a[0]), "harmonics");
+    }
+
+    /**
+     * Against octave(pts, tables, 0.5) and octave([x y 0], tables, 0.5, true) of MATLAB/perlin for two harmonics with
+     * table h, axis d: j -> (j * (37 + 64d + 2h) + 11(h + 1) + 50d) mod 256, and offset (0.13 + 0.2h, 0.57 - 0.1h,
+     * 0.71 + 0.05h), written as a seed file
+     */
+    void TestMatchesMatlab() throw(Exception)
+    {
+        OutputFileHandler handler("TestOctaveNoise");
+        FileFinder seed_file = handler.FindFile("seed.h5");
+        if (PetscTools::AmMaster()) {
+            std::vector<unsigned char> tables(2*3*256);
+            std::vector<double> offsets(2*3);
+            for (unsigned h = 0; h < 2; h++) {
+                for (unsigned d = 0; d < 3; d++)
+                    for (unsigned j = 0; j < 256; j++)
+                        tables[(h*3 + d)*256 + j] = (j * (37 + 64*d + 2*h) + 11*(h + 1) + 50*d) % 256;
+                offsets[h*3] = 0.13 + 0.2*h;
+                offsets[h*3 + 1] = 0.57 - 0.1*h;
+                offsets[h*3 + 2] = 0.71 + 0.05*h;
+            }
+
+            hid_t file_id = H5Fcreate(seed_file.GetAbsolutePath().c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+            hsize_t table_dims[3] = {2, 3, 256};
+            hid_t dspace = H5Screate_simple(3, table_dims, nullptr);
+            hid_t dataset_id = H5Dcreate(file_id, "Table", H5T_NATIVE_UCHAR, dspace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+            H5Dwrite(dataset_id, H5T_NATIVE_UCHAR, H5S_ALL, H5S_ALL, H5P_DEFAULT, &tables[0]);
+            H5Dclose(dataset_id);
+            H5Sclose(dspace);
+            hsize_t offset_dims[2] = {2, 3};
+            dspace = H5Screate_simple(2, offset_dims, nullptr);
+            dataset_id = H5Dcreate(file_id, "Offset", H5T_NATIVE_DOUBLE, dspace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+            H5Dwrite(dataset_id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, &offsets[0]);
+            H5Dclose(dataset_id);
+            H5Sclose(dspace);
+            H5Fclose(file_id);
+        }
+        PetscTools::Barrier("TestMatchesMatlab");
+
+        OctaveNoise noise(seed_file);
+        const double x[] = {0.3, -1.25, 10.6, 100.45, 3.0};
+        const double y[] = {1.7, 0.4, -3.3, 42.8, 2.0};
+        const double z[] = {2.2, 5.9, 0.05, -7.1, 1.0};
+        const double expected_3d[] = {-0.298651580877, -0.181470060983, 0.003176280729, -0.032448674741, -0.152450544362};
+        const double expected_2d[] = {-0.206547004613, -0.027598883531, -0.109836801126, 0.016659835683, -0.347041514030};
+
+        double result[5];
+        noise.Sample(5, x, y, z, 1.0, 2, 0.5, result);
+        for (unsigned i = 0; i < 5; i++)
+            TS_ASSERT_DELTA(result[i], expected_3d[i], 1e-10);
+
+        noise.Sample(5, x, y, nullptr, 1.0, 2, 0.5, result);
+        for (unsigned i = 0; i < 5; i++)
+            TS_ASSERT_DELTA(result[i], expected_2d[i], 1e-10);
+    }
+
+    void TestFindLevel() throw(Exception)
+    {
+        // each rank holds a slice of 0..999, so the result is independent of the number of processes
+        std::vector<double> values;
+        std::vector<bool> counted;
+        for (unsigned i = PetscTools::GetMyRank(); i < 1000; i += PetscTools::GetNumProcs()) {
+            values.push_back(i);
+            counted.push_back(true);
+        }
+        values.push_back(1e6);//a halo duplicate, ignored
+        counted.push_back(false);
+
+        TS_ASSERT_DELTA(OctaveNoise::FindLevel(values, counted, 0.25), 250.0, 1.0);
+        TS_ASSERT_DELTA(OctaveNoise::FindLevel(values, counted, 0.8), 800.0, 1.0);
+    }
+};
+
+#endif /*TESTOCTAVENOISE_HPP_*/
@@ -0,0 +1,69 @@
+#ifndef TESTSTIMULUSPROTOCOL_HPP_
+#define TESTSTIMULUSPROTOCOL_HPP_
+
+#include <cxxtest/TestSuite.h>
+#include <boost/make_shared.hpp>
+
+#include "TimedStimulus.hpp"
+#include "StimulusProtocol.hpp"
+#include "PetscSetupAndFinalize.hpp"
+
+class TestStimulusProtocol : public CxxTest::TestSuite
+{
+public:
+    void TestTimedStimulusLookup() throw(Exception)
+    {
+        std::vector<double> times = {10.0, 20.0, 30.0};
+        TimedStimulus stimulus(-1.0, 2.0, times);
+
+        // active on (start, start + duration]
+        TS_ASSERT_EQUALS(stimulus.GetStimulus(5.0), 0.0);
+        TS_ASSERT_EQUALS(stimulus.GetStimulus(10.0), 0.0);
+        TS_ASSERT_EQUALS(stimulus.GetStimulus(10.5), -1.0);
+        TS_ASSERT_EQUALS(stimulus.GetStimulus(12.0), -1.0);
+        TS_ASSERT_EQUALS(stimulus.GetStimulus(12.5), 0.0);
+        TS_ASSERT_EQUALS(stimulus.GetStimulus(31.0), -1.0);
+        TS_ASSERT_EQUALS(stimulus.GetStimulus(100.0), 0.0);
+
+        // going backwards
+        TS_ASSERT_EQUALS(stimulus.GetStimulus(21.0), -1.0);
+        TS_ASSERT_EQUALS(stimulus.GetStimulus(11.0), -1.0);
+        TS_ASSERT_EQUALS(stimulus.GetStimulus(1.0), 0.0);
+    }
+
+    void TestProtocol() throw(Exception)
+    {
+        std::vector<std::vector<double> > site_times = {{30.0, 10.0}, {15.0}};
+        std::vector<int> sites = {-1, 0, 1, 0};
+        std::vector<double> delays = {0.0, 0.0, 0.0, 5.0};
+        boost::shared_ptr<StimulusProtocol> protocol = boost::make_shared<StimulusProtocol>(site_times, sites, delays);
+
+        TS_ASSERT_EQUALS(protocol->GetNumSites(), 2u);
+        TS_ASSERT_EQUALS(protocol->GetNumSiteTimes(0), 2u);
+        TS_ASSERT_EQUALS(protocol->GetSiteTimes(0)[0], 10.0); // sorted on load
+
+        std::vector<double> all_times = protocol->GetAllTimes();
+        TS_ASSERT_EQUALS(all_times.size(), 3u);
+        TS_ASSERT_EQUALS(all_times[1], 15.0);
+        TS_ASSERT_EQUALS(protocol->GetMaxDelay(), 5.0);
+
+        // node 3 is site 0 delayed by 5ms
+        ProtocolStimulus delayed(protocol, protocol->GetSite(3), protocol->GetDelay(3), -1.0, 1.0);
+        TS_ASSERT_EQUALS(delayed.GetStimulus(10.5), 0.0);
+        TS_ASSERT_EQUALS(delayed.GetStimulus(15.5), -1.0);
+        TS_ASSERT_EQUALS(delayed.GetStimulus(35.5), -1.0);
+
+        // permutation reorders the node data, perm[file] = mesh
+        std::vector<unsigned> perm = {3, 2, 1, 0};
+        protocol->ApplyPermutation(perm);
+        TS_ASSERT_EQUALS(protocol->GetSite(3), -1);
+        TS_ASSERT_EQUALS(protocol->GetSite(1), 1);
+        TS_ASSERT_EQUALS(protocol->GetDelay(0), 5.0);
+
+        std::vector<int> bad_sites = {2};
+        TS_ASSERT_THROWS_THIS(StimulusProtocol(site_times, bad_sites, std::vector<double>()),
+                              "Unknown stimulus site 2 at node 0");
+    }
+};
+
+#endif /*TESTSTIMULUSPROTOCOL_HPP_*/
@@ -28,6 +28,13 @@ def write_vtu(ugrid):
 
 
 def read_permutation():
+    perm_path = path.join(path.dirname(argv[2]), "permutation.h5")
+    if path.isfile(perm_path):
+        print('permuting: ' + perm_path)
+        with h5py.File(perm_path, 'r') as perm_file:
+            return perm_file['Permutation'][:].astype(np.int32)
+
+    # outputs from before permutation.h5
     perm_path = path.join(path.dirname(argv[2]), "permutation.txt")
     print('permuting: ' + perm_path)
     if not path.isfile(perm_path):
@@ -82,6 +89,11 @@ def add_datasets(ugrid, perm, h5file):
     pdata = ugrid.GetPointData()
     cdata = ugrid.GetCellData()
 
+    # snapshots written with -original_order are already in .node order
+    if h5file.attrs.get('OriginalOrder', 0):
+        print('original order, not permuting')
+        perm = None
+
     for key in h5file.keys():
         dataset = h5file[key]
 
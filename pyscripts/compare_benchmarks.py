@@ -0,0 +1,49 @@
+from sys import argv, exit
+import json
+
+# compare_benchmarks.py baseline.json current.json [threshold]
+#
+# Compares QutemuBenchmark results by benchmark and size. Flags any result slower than the
+# baseline by more than threshold (default 0.1 = 10%) and exits with 1 if there are any.
+
+
+def load(json_path):
+    with open(json_path, 'r') as json_file:
+        data = json.load(json_file)
+    return data, {(r['name'], r['size']): r['ns_per_op'] for r in data['results']}
+
+
+def main():
+    if len(argv) < 3:
+        print('usage: compare_benchmarks.py baseline.json current.json [threshold]')
+        exit(2)
+
+    threshold = float(argv[3]) if len(argv) > 3 else 0.1
+    base_data, base = load(argv[1])
+    cur_data, cur = load(argv[2])
+    if base_data.get('procs') != cur_data.get('procs'):
+        print('warning: process counts differ (%s vs %s)' % (base_data.get('procs'), cur_data.get('procs')))
+
+    regressions = 0
+    print('%-20s %10s %12s %12s %8s' % ('benchmark', 'size', 'base ns/op', 'ns/op', 'ratio'))
+    for key in sorted(set(base) | set(cur)):
+        if key not in base or key not in cur:
+            print('%-20s %10d %s' % (key[0], key[1], 'only in ' + ('current' if key in cur else 'baseline')))
+            continue
+
+        ratio = cur[key] / base[key]
+        flag = ''
+        if ratio > 1 + threshold:
+            flag = ' REGRESSION'
+            regressions += 1
+        elif ratio < 1 - threshold:
+            flag = ' improved'
+        print('%-20s %10d %12.4g %12.4g %8.3f%s' % (key[0], key[1], base[key], cur[key], ratio, flag))
+
+    if regressions:
+        print('%d regressions beyond %g%%' % (regressions, threshold * 100))
+        exit(1)
+
+
+if __name__ == '__main__':
+    main()
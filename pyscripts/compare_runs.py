@@ -0,0 +1,82 @@
+from sys import argv, exit
+from os import path
+import h5py
+import numpy as np
+
+# compare_runs.py reference_dir test_dir
+#
+# Error of a simulation against a reference run of the same mesh, eg. one with -quiescent against one without.
+# Compares the voltage traces of results.h5 and the activation times of snapshots.h5, in .node file order
+# so the runs may have different partitions.
+
+
+def read_permutation(run_dir):
+    perm_path = path.join(run_dir, 'permutation.h5')
+    if path.isfile(perm_path):
+        with h5py.File(perm_path, 'r') as perm_file:
+            return perm_file['Permutation'][:].astype(np.int32)
+
+    perm_path = path.join(run_dir, 'permutation.txt')
+    if path.isfile(perm_path):
+        return np.genfromtxt(perm_path, skip_header=1, dtype=np.int32)[:, 1]
+
+    return None
+
+
+def read_dataset(run_dir, file_name, dataset_name):
+    h5_path = path.join(run_dir, file_name)
+    if not path.isfile(h5_path):
+        return None
+
+    with h5py.File(h5_path, 'r') as h5file:
+        if dataset_name not in h5file:
+            return None
+
+        data = h5file[dataset_name][...]
+        if data.ndim > 2:
+            data = data[..., 0]
+
+        perm = None if h5file.attrs.get('OriginalOrder', 0) else read_permutation(run_dir)
+        if perm is not None and data.shape[1] == len(perm):
+            data = data[:, perm]
+
+        return data
+
+
+def compare(name, ref, test):
+    if ref is None or test is None:
+        print('%-12s missing' % name)
+        return
+
+    rows = min(ref.shape[0], test.shape[0])
+    if ref.shape[1] != test.shape[1]:
+        print('%-12s different node counts (%d vs %d)' % (name, ref.shape[1], test.shape[1]))
+        return
+    if ref.shape[0] != test.shape[0]:
+        print('%-12s comparing the first %d rows (%d vs %d)' % (name, rows, ref.shape[0], test.shape[0]))
+
+    # unactivated nodes are NaN, mismatched where only one run activated them
+    ref = ref[:rows].astype(np.float64)
+    test = test[:rows].astype(np.float64)
+    valid = np.isfinite(ref) & np.isfinite(test)
+    mismatched = np.count_nonzero(np.isfinite(ref) != np.isfinite(test))
+
+    diff = np.abs(ref - test)[valid]
+    if diff.size == 0:
+        print('%-12s nothing to compare' % name)
+        return
+    print('%-12s max %10.4g  rms %10.4g  mismatched %d/%d' % (name, diff.max(), np.sqrt(np.mean(diff ** 2)), mismatched, ref.size))
+
+
+def main():
+    if len(argv) < 3:
+        print('usage: compare_runs.py reference_dir test_dir')
+        exit(2)
+
+    ref_dir, test_dir = argv[1], argv[2]
+    compare('voltage', read_dataset(ref_dir, 'results.h5', 'Data'), read_dataset(test_dir, 'results.h5', 'Data'))
+    compare('activation', read_dataset(ref_dir, 'snapshots.h5', 'Activation'), read_dataset(test_dir, 'snapshots.h5', 'Activation'))
+
+
+if __name__ == '__main__':
+    main()
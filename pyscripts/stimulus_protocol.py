@@ -0,0 +1,41 @@
+from sys import argv
+import h5py
+import numpy as np
+
+# stimulus_protocol.py mesh.node sinus_times extra_times output.h5
+#
+# Converts the pacing site column (second .node attribute) into a protocol file for -protocol.
+# Times are comma separated lists of absolute times (ms). Site 1 (sinus) becomes protocol site 0, site 2 (extra) becomes site 1.
+# Use write_protocol directly for more sites or per-node delays.
+
+
+def write_protocol(out_path, site_times, node_sites, node_delays=None):
+    """site_times: list of time lists per site. node_sites: per node site (-1 for none), in .node file order"""
+    offsets = np.cumsum([0] + [len(t) for t in site_times])
+    times = np.concatenate([np.asarray(t, dtype=np.float64) for t in site_times]) if site_times else np.zeros(0)
+    with h5py.File(out_path, 'w') as f:
+        f.create_dataset('SiteTimes', data=times)
+        f.create_dataset('SiteOffsets', data=offsets.astype(np.int32))
+        f.create_dataset('Site', data=np.asarray(node_sites, dtype=np.int32))
+        if node_delays is not None:
+            f.create_dataset('Delay', data=np.asarray(node_delays, dtype=np.float64))
+
+
+def read_pacing_sites(node_path):
+    with open(node_path, 'r') as node_file:
+        header = node_file.readline().split()
+        num_nodes, dim, num_attributes = int(header[0]), int(header[1]), int(header[2])
+        if num_attributes < 2:
+            raise ValueError(node_path + ' has no pacing site attribute')
+
+        data = np.loadtxt(node_file, max_rows=num_nodes, comments='#')
+        return data[:, 1 + dim + 1].astype(np.int32)
+
+
+def parse_times(s):
+    return [float(t) for t in s.split(',') if t.strip()]
+
+
+if __name__ == '__main__':
+    pacing = read_pacing_sites(argv[1])
+    write_protocol(argv[4], [parse_times(argv[2]), parse_times(argv[3])], pacing - 1)